@@ -42,7 +42,8 @@ struct MIPD_Infeasibility_Exception {
 namespace MiniZinc {
 
   /// Linearize domain constraints in \a env
-  void MIPdomains(Env& env, bool fVerbose = false);
+  /// The cliques are analysed by \a nThreads threads
+  void MIPdomains(Env& env, bool fVerbose = false, int nThreads = 1);
   
   enum EnumStatIdx__MIPD { 
     N_POSTs__all,                     // N all POSTs in the model
@@ -81,6 +81,67 @@ namespace MiniZinc {
     
     /// Location used for un-allocated expressions
     static Location nonalloc;
+  protected:
+    friend class LocationTable;
+    /// Id of the table entry this location was copied from
+    /// (only a hint, see LocationTable::intern)
+    unsigned int _lid;
+  };
+
+  /**
+   * \brief Side table of the locations of expressions and items
+   *
+   * Nodes only store the id of their location. Equal locations share an
+   * entry, which makes the many nodes created with the location of an
+   * existing node (or Location().introduce()) cheap. Like the constants,
+   * the table is shared by all threads. Adding entries takes a lock;
+   * entries never move, so reading them does not, and neither does
+   * finding the entry a location was copied from or the last entry the
+   * thread interned.
+   *
+   * Entries are stored in chunks. After a collection, chunks that no
+   * live node refers to are released and their ids reused. This is only
+   * done while a single thread has a GC heap, as the collector cannot
+   * see the nodes of other heaps. The file names of the entries are
+   * kept alive by the collector.
+   */
+  class LocationTable {
+  public:
+    /// Return the id of location \a l, adding it if necessary
+    static unsigned int intern(const Location& l);
+    /// Return the location with id \a id
+    static const Location& get(unsigned int id) {
+      return _chunks[id >> chunkBits][id & chunkMask];
+    }
+    /// Return the number of entries
+    static unsigned int size(void);
+    /// Mark the file names of all entries as alive
+    static void mark(void);
+    /// Return the file names of all entries
+    static std::vector<ASTString> files(void);
+    /// Record the chunk of the location of \a e in \a live
+    static void used(const Expression* e, std::vector<bool>& live);
+    /// Record the chunk of the location of \a i in \a live
+    static void used(const Item* i, std::vector<bool>& live);
+    /// Release all chunks not recorded in \a live
+    static void release(const std::vector<bool>& live);
+    /// Register a new GC heap
+    static void addHeap(void);
+    /// Unregister a GC heap that has been destroyed
+    static void removeHeap(void);
+  protected:
+    static const unsigned int chunkBits = 16;
+    static const unsigned int chunkMask = (1u << chunkBits)-1;
+    /// Chunks are not reused, so every id has a slot of its own
+    static const unsigned int maxChunks = 1u << (32-chunkBits);
+    /// Entries in chunks of fixed size, so that they never move
+    static Location* _chunks[maxChunks];
+    /// Whether entry \a id exists and equals \a l
+    static bool isEntry(unsigned int id, const Location& l);
+    /// Return the id of location \a l, with the lock held
+    static unsigned int internLocked(const Location& l);
+    /// Append \a l as a new entry, with the lock held
+    static unsigned int add(const Location& l);
   };
 
   /// Output operator for locations
@@ -136,15 +197,16 @@ namespace MiniZinc {
    * \brief Base class for expressions
    */
   class Expression : public ASTNode {
+    friend class LocationTable;
   protected:
+    /// The %MiniZinc type of the expression (fills the node header)
+    Type _type;
     /// The annotations
     Annotation _ann;
-    /// The location of the expression
-    Location _loc;
-    /// The %MiniZinc type of the expression
-    Type _type;
     /// The hash value of the expression
     size_t _hash;
+    /// The location of the expression in the LocationTable
+    unsigned int _lid;
   public:
     /// Identifier of the concrere expression type
     enum ExpressionId {
@@ -160,11 +222,11 @@ namespace MiniZinc {
     }
 
     const Location& loc(void) const {
-      return isUnboxedInt() ? Location::nonalloc : _loc;
+      return isUnboxedInt() ? Location::nonalloc : LocationTable::get(_lid);
     }
     void loc(const Location& l) {
       if (!isUnboxedInt())
-        _loc = l;
+        _lid = LocationTable::intern(l);
     }
     const Type& type(void) const {
       return isUnboxedInt() ? Type::unboxedint : _type;
@@ -192,7 +254,7 @@ namespace MiniZinc {
 
     /// Constructor
     Expression(const Location& loc, const ExpressionId& eid, const Type& t)
-      : ASTNode(eid), _loc(loc), _type(t) {}
+      : ASTNode(eid), _type(t), _lid(LocationTable::intern(loc)) {}
 
   public:
     bool isUnboxedInt(void) const {
@@ -947,9 +1009,10 @@ namespace MiniZinc {
    * \brief Base-class for items
    */
   class Item : public ASTNode {
+    friend class LocationTable;
   protected:
-    /// Location of the item
-    Location _loc;
+    /// Location of the item in the LocationTable
+    unsigned int _lid;
   public:
     /// Identifier of the concrete item type
     enum ItemId {
@@ -961,12 +1024,12 @@ namespace MiniZinc {
     }
     
     const Location& loc(void) const {
-      return _loc;
+      return LocationTable::get(_lid);
     }
   protected:
     /// Constructor
     Item(const Location& loc, const ItemId& iid)
-      : ASTNode(iid), _loc(loc) { _flag_1 = false; }
+      : ASTNode(iid), _lid(LocationTable::intern(loc)) { _flag_1 = false; }
 
   public:
 
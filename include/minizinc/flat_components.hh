@@ -0,0 +1,80 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MINIZINC_FLAT_COMPONENTS_HH__
+#define __MINIZINC_FLAT_COMPONENTS_HH__
+
+#include <minizinc/flatten.hh>
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace MiniZinc {
+
+  class VarOccurrences;
+
+  /// Independent components of a (final) flat model
+  ///
+  /// Two variables are in the same component if they occur in a common
+  /// constraint. A linear objective that only sums terms of different
+  /// components is split, so that each part optimises its own share.
+  /// The components are grouped into parts which can be written as
+  /// separate FlatZinc models; their solutions are merged back into
+  /// assignments for the output of the whole model.
+  class FlatComponents {
+  public:
+    /// Analyse the flat model of \a env
+    FlatComponents(Env& env);
+    /// Number of components
+    int size(void) const { return _nComponents; }
+    /// Group the components into at most \a n parts of similar size
+    void group(int n);
+    /// Number of parts
+    int nParts(void) const { return _nParts; }
+    /// Whether the objective has been split among the parts
+    bool objectiveSplit(void) const { return _objDef != NULL; }
+    /// Write part \a p as a FlatZinc model. All variables needed for the
+    /// output of the whole model are output variables of their part.
+    /// Search annotations are not kept.
+    void writePart(int p, std::ostream& os);
+    /// Merge the last solutions of all parts (in the FlatZinc output
+    /// format, one per part) into a solution of the whole model
+    std::string mergeSolutions(const std::vector<std::string>& sols);
+  protected:
+    Env& _env;
+    /// Part of each item of the flat model, or one of the values below
+    std::vector<int> _itemPart;
+    enum { ALL_PARTS = -1, NO_PART = -2 };
+    /// Component of each item, or ALL_PARTS / NO_PART
+    std::vector<int> _itemComponent;
+    std::vector<int> _componentSize;
+    /// Index of the item of each variable declaration
+    std::unordered_map<VarDecl*,int> _declIdx;
+    int _nComponents = 0;
+    int _nParts = 0;
+    /// Variables that are output because they occur in an output array
+    std::vector<VarDecl*> _outputElements;
+    /// The objective variable and the constraint defining it as a sum,
+    /// if the objective is split
+    VarDecl* _obj = NULL;
+    Item* _objDef = NULL;
+    /// Coefficient of the objective variable, right hand side and terms
+    Expression* _objCoef = NULL;
+    Expression* _objRhs = NULL;
+    std::vector<std::pair<Expression*,VarDecl*> > _objTerms;
+    /// Name of the variable holding the share of the objective of part \a p
+    std::string partObjective(int p) const;
+    /// Write the objective and solve item of part \a p
+    void writeObjective(int p, std::ostream& os);
+    /// Detect an objective defined as a sum of terms
+    void findObjectiveSum(VarOccurrences& vo);
+  };
+
+}
+
+#endif
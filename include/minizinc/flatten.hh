@@ -37,9 +37,16 @@ namespace MiniZinc {
     enum OutputMode {
       OUTPUT_ITEM, OUTPUT_DZN, OUTPUT_JSON
     } outputMode;
+    /// Canonicalise flat calls so that equal constraints are shared
+    bool hashCons;
+    /// Specialise function bodies for the shape of their arguments
+    bool decompositionTemplates;
+    /// Remove dominated and duplicate linear constraints when optimizing
+    bool mergeLinear;
     /// Default constructor
     FlatteningOptions(void)
-    : keepOutputInFzn(false), onlyRangeDomains(false), outputMode(OUTPUT_ITEM) {}
+    : keepOutputInFzn(false), onlyRangeDomains(false), outputMode(OUTPUT_ITEM), hashCons(false),
+      decompositionTemplates(false), mergeLinear(false) {}
   };
   
   /// Flatten model \a m
@@ -69,10 +76,26 @@ namespace MiniZinc {
     int n_float_ct;
     /// Number of set constraints
     int n_set_ct;
+    /// Number of expressions reused by common subexpression elimination
+    long long int n_cse_hits;
+    /// Number of calls put into canonical form by hash-consing
+    long long int n_hashcons_reordered;
+    /// Number of function bodies flattened from a decomposition template
+    long long int n_template_hits;
+    /// Number of function bodies that could have used a decomposition template
+    long long int n_template_misses;
+    /// Number of linear constraints removed as dominated
+    long long int n_linear_dominated;
+    /// Number of duplicate linear equalities removed
+    long long int n_linear_duplicates;
+    /// Number of linear constraints turned into variable bounds
+    long long int n_linear_bounds;
     /// Constructor
     FlatModelStatistics(void)
     : n_int_vars(0), n_bool_vars(0), n_float_vars(0), n_set_vars(0),
-      n_bool_ct(0), n_int_ct(0), n_float_ct(0), n_set_ct(0) {}
+      n_bool_ct(0), n_int_ct(0), n_float_ct(0), n_set_ct(0),
+      n_cse_hits(0), n_hashcons_reordered(0), n_template_hits(0), n_template_misses(0),
+      n_linear_dominated(0), n_linear_duplicates(0), n_linear_bounds(0) {}
   };
   
   /// Compute statistics for flat model in \a m
@@ -0,0 +1,53 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MINIZINC_FLATTEN_CACHE_HH__
+#define __MINIZINC_FLATTEN_CACHE_HH__
+
+#include <minizinc/model.hh>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace MiniZinc {
+
+  /// On-disk cache of flattened models
+  ///
+  /// An entry is a .fzn and an .ozn file named after the SHA-256 digest
+  /// of everything the flattening depends on: the contents of all files
+  /// the parser read (model, includes and library), the data and the
+  /// options. Entries are evicted least recently used first when the
+  /// cache grows beyond its size limit.
+  class FlatteningCache {
+  public:
+    /// Cache in directory \a dir, holding at most \a maxBytes
+    FlatteningCache(const std::string& dir, unsigned long long maxBytes);
+    /// Compute the key of parsed model \a m (with its includes), the
+    /// data files (or cmd:/ data) \a datafiles and the options \a options
+    std::string key(Model* m, const std::vector<std::string>& datafiles,
+                    const std::string& options);
+    /// Look up \a key, setting \a fzn and \a ozn to the files of the entry
+    bool lookup(const std::string& key, std::string& fzn, std::string& ozn);
+    /// Store the flat and output model of \a env under \a key
+    void store(const std::string& key, Env& env);
+    /// Print hit/miss statistics of this run and of the cache overall
+    void printStatistics(std::ostream& os);
+  protected:
+    std::string _dir;
+    unsigned long long _maxBytes;
+    int _hits = 0;
+    int _misses = 0;
+    int _evicted = 0;
+    /// Add \a hits and \a misses to the statistics file of the cache
+    void updateStatistics(int hits, int misses);
+    /// Remove least recently used entries until the cache fits
+    void evict(void);
+  };
+
+}
+
+#endif
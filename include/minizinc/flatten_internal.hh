@@ -63,6 +63,70 @@ namespace MiniZinc {
   /// Negate context \a c
   BCtx operator -(const BCtx& c);
   
+  class EnvI;
+
+  /// Bodies of functions and predicates specialised for the shape of
+  /// their arguments: the values of the par arguments and the index sets
+  /// of the var arrays. A body is analysed once for par subexpressions
+  /// that only depend on the shape. When a call of the same shape is
+  /// flattened repeatedly, a copy of the body with these subexpressions
+  /// evaluated is flattened instead of the body itself.
+  class DecompositionTemplates {
+  public:
+    /// Return the body to flatten for \a decl, whose parameters are
+    /// bound to the arguments of a call. Must be matched by release.
+    Expression* instantiate(EnvI& env, FunctionI* decl);
+    /// End the instantiation of \a decl
+    void release(FunctionI* decl);
+    /// Whether the result of \a fi only depends on its arguments
+    bool pure(FunctionI* fi);
+  protected:
+    /// Shape of a call
+    struct Key {
+      /// Values of the par arguments, and of the bounds calls on var arguments
+      std::vector<KeepAlive> values;
+      /// Index sets of the var array arguments
+      std::vector<long long int> bounds;
+      size_t hash;
+    };
+    struct KeyHash {
+      size_t operator()(const Key& k) const { return k.hash; }
+    };
+    struct KeyEq {
+      bool operator()(const Key& k0, const Key& k1) const;
+    };
+    struct Template {
+      /// Number of calls of this shape
+      int n;
+      /// The specialised body
+      KeepAlive body;
+      Template(void) : n(0) {}
+    };
+    typedef UNORDERED_NAMESPACE::unordered_map<Key,Template,KeyHash,KeyEq> Templates;
+    struct FnInfo {
+      /// Whether templates are used for this function
+      bool enabled;
+      /// Number of instantiations currently being flattened
+      int active;
+      /// Maximal subexpressions of the body that only depend on the shape
+      std::vector<Expression*> shapeExps;
+      /// Calls of lb, ub or dom on var parameters, part of the shape
+      std::vector<Expression*> boundsCalls;
+      /// Declarations referenced but not declared by the body
+      std::vector<VarDecl*> outerDecls;
+      Templates templates;
+      unsigned int n_templates;
+      unsigned long long n_hits;
+      FnInfo(void) : enabled(false), active(0), n_templates(0), n_hits(0) {}
+    };
+    UNORDERED_NAMESPACE::unordered_map<FunctionI*,FnInfo> _fns;
+    UNORDERED_NAMESPACE::unordered_map<FunctionI*,bool> _pure;
+    /// Analyse the body of \a decl
+    void analyse(EnvI& env, FunctionI* decl, FnInfo& info);
+    /// Compute the shape of the current arguments of \a decl
+    bool key(EnvI& env, FunctionI* decl, const FnInfo& info, Key& k);
+  };
+
   class EnvI {
   public:
     Model* orig;
@@ -88,6 +152,27 @@ namespace MiniZinc {
     std::vector<int> modifiedVarDecls;
     int in_redundant_constraint;
     int in_maybe_partial;
+    /// Whether flat calls are brought into canonical form before CSE lookup
+    bool hashCons;
+    /// Number of successful CSE lookups
+    unsigned long long n_cse_hits;
+    /// Number of calls whose arguments were reordered by hash-consing
+    unsigned long long n_hashcons_reordered;
+    /// Whether function bodies are specialised for the shape of their arguments
+    bool decompositionTemplates;
+    DecompositionTemplates templates;
+    /// Number of function bodies flattened from a decomposition template
+    unsigned long long n_template_hits;
+    /// Number of function bodies flattened without a decomposition template
+    unsigned long long n_template_misses;
+    /// Whether optimize merges dominated and duplicate linear constraints
+    bool mergeLinear;
+    /// Number of linear constraints removed because another one dominates them
+    unsigned long long n_linear_dominated;
+    /// Number of linear equalities removed because they duplicate another one
+    unsigned long long n_linear_duplicates;
+    /// Number of linear constraints on a single variable turned into a domain
+    unsigned long long n_linear_bounds;
   protected:
     Map map;
     Model* _flat;
@@ -137,6 +222,11 @@ namespace MiniZinc {
 
   EE flat_exp(EnvI& env, Ctx ctx, Expression* e, VarDecl* r, VarDecl* b);
 
+  /// Bring flat call \a c into canonical form for CSE (if enabled in \a env):
+  /// arguments of commutative builtins are ordered, elements of
+  /// conjunctions/disjunctions and the terms of linear constraints are sorted
+  void hashcons_call(EnvI& env, Call* c);
+
   class CmpExpIdx {
   public:
     std::vector<KeepAlive>& x;
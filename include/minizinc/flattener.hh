@@ -21,10 +21,12 @@
 
 #include <minizinc/model.hh>
 #include <minizinc/parser.hh>
+#include <minizinc/json_parser.hh>
 #include <minizinc/typecheck.hh>
 #include <minizinc/astexception.hh>
 
 #include <minizinc/flatten.hh>
+#include <minizinc/flatten_cache.hh>
 #include <minizinc/flatten_internal.hh>  // temp., TODO
 #include <minizinc/MIPdomains.hh>
 #include <minizinc/optimize.hh>
@@ -77,8 +79,23 @@ namespace MiniZinc {
     bool flag_werror = false;
     bool flag_only_range_domains = false;
     bool flag_noMIPdomains = false;
+    int flag_MIPdomains_threads = 1;
+    bool flag_hashcons = false;
+    bool flag_decomposition_templates = false;
+    bool flag_merge_linear = false;
     bool flag_statistics = false;
     bool flag_stdinInput = false;
+    bool flag_stdinJSONData = false;
+    int flag_typecheck_threads = 1;
+    /// Heap page size in KB, 0 for the default
+    int flag_gc_page_size = 0;
+    bool flag_gc_mmap = false;
+    bool flag_gc_huge_pages = false;
+    bool flag_gc_release_pages = false;
+    /// Directory of the flattening cache, empty for none
+    std::string flag_fzn_cache;
+    /// Size limit of the flattening cache in MB
+    int flag_fzn_cache_size = 1024;
 
     std::string std_lib_dir;
     std::string globals_dir;
@@ -94,10 +111,21 @@ namespace MiniZinc {
     bool flag_model_interface_only = false;
     FlatteningOptions::OutputMode flag_output_mode = FlatteningOptions::OUTPUT_ITEM;
     FlatteningOptions fopts;
+    /// Flatten separately for each data file, sharing parsing and type checking
+    bool flag_batch = false;
+    /// Number of batch instances flattened concurrently
+    int flag_batch_jobs = 1;
+    /// Whether the model was type checked before the data of the instance was added
+    bool batch_typechecked = false;
 
     clock_t starttime01;
     clock_t lasttime;
 
+    /// Type check \a m (unless its enums are defined by data) and fork a process
+    /// for each data file of the batch. Returns in those processes, after adding
+    /// the data file to \a m; the parent waits for all of them and exits.
+    void forkBatch(Env& env, Model* m);
+
   };
 
 }
@@ -15,6 +15,7 @@
 #include <cstdlib>
 #include <cassert>
 #include <new>
+#include <iosfwd>
 #include <minizinc/stl_map_set.hh>
 
 namespace MiniZinc {
@@ -111,6 +112,76 @@ namespace MiniZinc {
   class WeakRef;
 
   class ASTNodeWeakMap;
+
+  /// Statistics of the garbage collector, see GC::trackStats
+  struct GCStats {
+    /// Number of node kinds (ASTNode, Expression and Item ids)
+    static const int n_kinds = 28;
+    /// Number of buckets in the pause histogram
+    static const int n_pauseBuckets = 24;
+    /// Name of node kind \a k
+    static const char* kindName(int k);
+
+    /// Number of collections
+    unsigned long long collections;
+    /// Total bytes reclaimed by all collections
+    unsigned long long reclaimed;
+    /// Bytes reclaimed by the last collection
+    size_t lastReclaimed;
+    /// Total and longest pause in seconds
+    double totalPause;
+    double maxPause;
+    /// pauses[i] counts collections that took less than 2^i microseconds
+    /// (the last bucket also counts all longer ones)
+    unsigned long long pauses[n_pauseBuckets];
+    /// Live nodes and bytes per kind after the last collection
+    size_t liveCount[n_kinds];
+    size_t liveBytes[n_kinds];
+    /// Nodes and bytes reclaimed per kind over all collections
+    unsigned long long freedCount[n_kinds];
+    unsigned long long freedBytes[n_kinds];
+    /// Completely free pages given back after collections
+    unsigned long long releasedPages;
+
+    GCStats(void) { clear(); }
+    void clear(void);
+  };
+
+  /// Where the garbage collected heap takes its pages from, see GC::pageOptions
+  struct GCPageOptions {
+    /// Size of a standard heap page in bytes
+    size_t pageSize;
+    /// Carve standard pages out of large regions reserved with mmap
+    /// instead of allocating each one with malloc
+    bool mmapRegions;
+    /// Ask for transparent huge pages for the mmap regions
+    bool hugePages;
+    /// After each collection, give back standard pages that no longer
+    /// contain live nodes (returned to the OS with madvise for mmap regions)
+    bool releasePages;
+    GCPageOptions(void)
+      : pageSize(1<<20), mmapRegions(false), hugePages(false), releasePages(false) {}
+  };
+
+  /// Snapshot of the heap, see GC::inspect
+  struct GCHeapInfo {
+    /// Number of free list size classes
+    static const int n_freeLists = 11;
+    /// Number of heap pages and their total size in bytes
+    size_t pages;
+    size_t pageBytes;
+    /// Bytes at the end of pages that have never been handed out
+    size_t unusedBytes;
+    /// Nodes and bytes on each free list
+    size_t freeListCount[n_freeLists];
+    size_t freeListBytes[n_freeLists];
+    /// Nodes and bytes per kind, including unreachable nodes that
+    /// have not been collected yet
+    size_t nodeCount[GCStats::n_kinds];
+    size_t nodeBytes[GCStats::n_kinds];
+
+    GCHeapInfo(void);
+  };
   
   /// Garbage collector
   class GC {
@@ -130,6 +201,8 @@ namespace MiniZinc {
     static GC*& gc(void);
     /// Constructor
     GC(void);
+    /// Destructor, frees the heap
+    ~GC(void);
 
     /// Allocate garbage collected memory
     void* alloc(size_t size);
@@ -162,6 +235,29 @@ namespace MiniZinc {
     
     /// Return maximum allocated memory (high water mark)
     static size_t maxMem(void);
+
+    /// Set the page options for this thread's collector. They apply to
+    /// pages allocated from now on. Regions and huge pages are only
+    /// available where mmap is, otherwise malloc is used
+    static void pageOptions(const GCPageOptions& o);
+    /// Return the page options of this thread's collector
+    static const GCPageOptions& pageOptions(void);
+
+    /// Enable or disable statistics for this thread's collector.
+    /// Enabling resets the statistics. When disabled, collections only
+    /// pay for one test of a flag.
+    static void trackStats(bool b);
+    /// Return whether statistics are collected
+    static bool trackingStats(void);
+    /// Return the statistics collected since trackStats(true)
+    static const GCStats& stats(void);
+    /// Walk the heap and summarise its current contents into \a hi
+    static void inspect(GCHeapInfo& hi);
+    /// Print statistics and a summary of the heap to \a os
+    static void printStats(std::ostream& os);
+    /// Destroy the heap of the calling thread, unless it still has roots.
+    /// Called when a thread that used the collector exits
+    static void threadExit(void);
   };
 
   /// Automatic garbage collection lock
@@ -30,6 +30,10 @@ namespace MiniZinc {
     
   };
 
+  /// Streaming parser for JSON data files.
+  /// Input is read through a fixed-size buffer, so data can come from
+  /// pipes or standard input. Numeric arrays are parsed in a tight loop
+  /// that does not go through the generic tokenizer.
   class JSONParser {
   protected:
     enum TokenT { T_LIST_OPEN, T_LIST_CLOSE, T_OBJ_OPEN, T_OBJ_CLOSE, T_COMMA, T_COLON,
@@ -40,19 +44,45 @@ namespace MiniZinc {
     int line;
     int column;
     std::string filename;
+
+    /// Input buffer
+    std::istream* _is;
+    std::vector<char> _buf;
+    size_t _bufPos;
+    size_t _bufEnd;
+    /// Refill buffer, return false at end of input
+    bool fill(void);
+    /// Return next character without consuming it, or -1 at end of input
+    int peek(void) { return (_bufPos<_bufEnd || fill()) ? static_cast<unsigned char>(_buf[_bufPos]) : -1; }
+    /// Consume and return next character, or -1 at end of input
+    int get(void) {
+      if (_bufPos>=_bufEnd && !fill())
+        return -1;
+      ++column;
+      return static_cast<unsigned char>(_buf[_bufPos++]);
+    }
+    /// Skip white space, return next character without consuming it
+    int skipSpace(void);
+
     Location errLocation(void) const;
-    Token readToken(std::istream& is);
-    void expectToken(std::istream& is, TokenT t);
-    std::string expectString(std::istream& is);
-    Expression* parseExp(std::istream& is);
-    ArrayLit* parseArray(std::istream& is);
+    Token readToken(void);
+    /// Read a number whose first character is \a c0 (already consumed)
+    Token readNumber(int c0);
+    std::string readString(void);
+    void expectToken(TokenT t);
+    std::string expectString(void);
+    Expression* parseExp(void);
+    ArrayLit* parseArray(void);
     
-    SetLit* parseSetLit(std::istream& is);
+    SetLit* parseSetLit(void);
     
   public:
-    JSONParser(EnvI& env0) : env(env0) {}
+    JSONParser(EnvI& env0) : env(env0), _is(NULL), _bufPos(0), _bufEnd(0) {}
     /// Parses \a filename as MiniZinc data and creates assign items in \a m
     void parse(Model* m, std::string filename);
+    /// Parses MiniZinc data from stream \a is (e.g. std::cin) and creates assign items in \a m.
+    /// \a filename is only used for error messages
+    void parse(Model* m, std::istream& is, std::string filename="stdin");
   };
   
 }
@@ -25,7 +25,9 @@ namespace MiniZinc {
   /// Copy all dependent variable declarations
   void outputVarDecls(EnvI& env, Item* ci, Expression* e);
   
-  /// Create initial output model
+  /// Create initial output model. This is done even when no .ozn is
+  /// written: it decides which flat variables get output_var/output_array
+  /// annotations and are kept and renamed, so the FlatZinc depends on it
   void createOutput(EnvI& e, std::vector<VarDecl*>& deletedFlatVarDecls,
                     FlatteningOptions::OutputMode outputMode);
   /// Finalise output model after flattening is complete
@@ -0,0 +1,104 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MINIZINC_OUTPUT_PIPELINE_HH__
+#define __MINIZINC_OUTPUT_PIPELINE_HH__
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace MiniZinc {
+
+  class Expression;
+
+  /// Raw value of one scalar output variable, taken without touching the AST
+  struct SolutionValue {
+    enum Kind { SV_INT, SV_FLOAT, SV_BOOL, SV_EXPR, SV_TEXT };
+    Kind kind;
+    long long int i;      // SV_INT, SV_BOOL
+    double f;             // SV_FLOAT
+    Expression* e;        // SV_EXPR: any other value, only valid while it is alive
+    std::string s;        // SV_TEXT: an SV_EXPR value printed
+    SolutionValue() : kind(SV_EXPR), i(0), f(0.0), e(NULL) {}
+    static SolutionValue mkInt(long long int v) { SolutionValue r; r.kind=SV_INT; r.i=v; return r; }
+    static SolutionValue mkFloat(double v) { SolutionValue r; r.kind=SV_FLOAT; r.f=v; return r; }
+    static SolutionValue mkBool(bool v) { SolutionValue r; r.kind=SV_BOOL; r.i=v; return r; }
+    static SolutionValue mkExpr(Expression* v) { SolutionValue r; r.kind=SV_EXPR; r.e=v; return r; }
+    static SolutionValue mkText(const std::string& v) { SolutionValue r; r.kind=SV_TEXT; r.s=v; return r; }
+  };
+
+  /// Snapshot of all output variables of one solution, in the order
+  /// of SolverInstanceBase2::_varsWithOutput (arrays flattened)
+  class SolutionSnapshot {
+  public:
+    std::vector<SolutionValue> values;
+    /// Statistics text captured together with the solution
+    std::string statistics;
+    /// Reset contents, keeping the storage
+    void clear() { values.clear(); statistics.clear(); }
+  };
+
+  /// Bounded ring buffer of solution snapshots rendered by a separate thread.
+  /// The producer (the solver's solution callback) copies the raw values,
+  /// the renderer only formats and flushes them. As the GC heap and the
+  /// literal caches belong to the producer's thread, the renderer must
+  /// not allocate or evaluate AST nodes, and snapshots must not contain
+  /// SV_EXPR values.
+  /// With coalescing, a full buffer drops the oldest pending snapshot
+  /// instead of blocking the solver, so the latest solution is always rendered.
+  class SolutionPipeline {
+  public:
+    typedef std::function<void(SolutionSnapshot&)> Filler;
+    typedef std::function<void(SolutionSnapshot&)> Renderer;
+
+    SolutionPipeline(Renderer r, int capacity=4, bool fCoalesce=false);
+    /// Renders all pending snapshots and joins the thread
+    ~SolutionPipeline();
+
+    /// Fill the next free slot using \a f and queue it for rendering
+    void push(const Filler& f);
+    /// Wait until all queued snapshots are rendered
+    void drain();
+
+    /// Statistics
+    unsigned long long nPushed() const { return _nPushed; }
+    unsigned long long nRendered() const { return _nRendered; }
+    unsigned long long nCoalesced() const { return _nCoalesced; }
+
+  private:
+    void run();
+
+    Renderer _render;
+    std::vector<SolutionSnapshot> _ring;
+    /// The snapshot currently rendered, swapped out of the ring
+    SolutionSnapshot _current;
+    size_t _head = 0;
+    size_t _size = 0;
+    bool _fCoalesce;
+    bool _fBusy = false;
+    bool _fStop = false;
+    unsigned long long _nPushed = 0;
+    unsigned long long _nRendered = 0;
+    unsigned long long _nCoalesced = 0;
+
+    /// Serializes producers (solver callbacks can come from several threads)
+    std::mutex _mtxPush;
+    std::mutex _mtx;
+    std::condition_variable _cvFilled;
+    std::condition_variable _cvFree;
+    std::thread _thread;
+
+    SolutionPipeline(const SolutionPipeline&);
+    SolutionPipeline& operator= (const SolutionPipeline&);
+  };
+
+}
+
+#endif  // __MINIZINC_OUTPUT_PIPELINE_HH__
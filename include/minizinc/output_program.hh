@@ -0,0 +1,91 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MINIZINC_OUTPUT_PROGRAM_HH__
+#define __MINIZINC_OUTPUT_PROGRAM_HH__
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+
+#include <minizinc/output_pipeline.hh>
+
+namespace MiniZinc {
+
+  class EnvI;
+  class VarDecl;
+  class Call;
+  class Comprehension;
+
+  /// The output item compiled into literal text and typed value slots.
+  /// Everything that does not depend on the solution (string literals,
+  /// par expressions, comprehensions over par sets) is evaluated once;
+  /// rendering a solution only formats the slot values into a reused buffer.
+  /// Supports string concatenation, concat(), join(), par if-then-else and
+  /// show()/show_int() of solver variables, their elements and fix() of them.
+  /// Anything else makes compile() fail, and the output item is evaluated
+  /// as before.
+  class OutputProgram {
+  public:
+    /// Compile \a outputExpr of the output model. The variables in \a solVars
+    /// are assigned by the solver, all others are derived from them or par.
+    bool compile(EnvI& env, Expression* outputExpr,
+                 const std::vector<VarDecl*>& solVars);
+    bool compiled() const { return _fCompiled; }
+
+    /// Output model variables used by the program. Their values are
+    /// expected in this order, arrays flattened
+    const std::vector<VarDecl*>& vars() const { return _vars; }
+    /// Number of values of vars()[i]
+    int varSize(int i) const { return _varSize[i]; }
+    /// Number of values of all vars()
+    int nValues() const { return _nValues; }
+
+    /// Collect the values from the right hand sides of vars().
+    /// Returns false if some value is not a literal
+    bool readValues(std::vector<SolutionValue>& values) const;
+    /// Render the output for \a values into \a buf, replacing its contents.
+    /// Only SV_EXPR values are printed from the AST
+    void render(const std::vector<SolutionValue>& values, std::string& buf) const;
+
+  private:
+    enum OpKind { OP_TEXT, OP_VALUE, OP_ARRAY };
+    struct Op {
+      OpKind kind;
+      int a;          // text offset / first value
+      int b;          // text length / number of values
+      int justify;    // for show_int()
+    };
+    std::vector<Op> _ops;
+    std::string _text;
+    std::vector<VarDecl*> _vars;
+    std::vector<int> _varSize;
+    std::vector<int> _varFirst;
+    int _nValues = 0;
+    bool _fCompiled = false;
+
+    /// Compilation state
+    EnvI* _env = 0;
+    std::unordered_set<VarDecl*> _solVars;
+    std::unordered_set<VarDecl*> _derived;
+    std::unordered_map<VarDecl*, int> _varIdx;
+    std::vector<std::vector<std::pair<long long int, long long int> > > _varRanges;
+
+    bool dependsOnSolution(Expression* e) const;
+    int findVar(VarDecl* vd);
+    void addText(const std::string& s);
+    bool compileString(Expression* e);
+    bool compileShow(Expression* e, int justify);
+    bool compileStringArray(Expression* e, const std::string* sep, bool& fFirst);
+    bool compileElement(Expression* e, const std::string* sep, bool& fFirst);
+    bool compileComprehension(Comprehension* c, const std::string* sep, bool& fFirst);
+    friend class EvalOutputElement;
+  };
+
+}
+
+#endif  // __MINIZINC_OUTPUT_PROGRAM_HH__
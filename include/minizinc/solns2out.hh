@@ -18,6 +18,7 @@
 #include <set>
 #include <ctime>
 #include <memory>
+#include <mutex>
 #include <iomanip>
 #include <unordered_map>
 
@@ -33,6 +34,7 @@
 #include <minizinc/utils.hh>
 #include <minizinc/file_utils.hh>
 #include <minizinc/solver_instance.hh>
+#include <minizinc/output_program.hh>
 
 namespace MiniZinc {
   
@@ -59,6 +61,11 @@ namespace MiniZinc {
       bool flag_output_comments = true;
       bool flag_output_flush = true;
       bool flag_output_time = false;
+      bool flag_output_async = false;
+      int flag_output_async_buffer = 4;
+      bool flag_output_coalesce = false;
+      bool flag_output_json_lines = false;
+      bool flag_output_compiled = false;
       int flag_ignore_lines = 0;
       bool flag_unique = 0;
       bool flag_canonicalize = 0;
@@ -109,6 +116,9 @@ namespace MiniZinc {
 
     /// This can be used by assignSolutionToOutput()    
     DE& findOutputVar( ASTString );
+    /// Build the output variable map now, e.g. before
+    /// the output model is handed over to a rendering thread
+    void prepareOutputMap() { if ( declmap.empty() ) createOutputMap(); }
     
     /// In the other case,
     /// the evaluation procedures print output/status to os
@@ -119,10 +129,24 @@ namespace MiniZinc {
     /// These functions should only be called explicitly
     /// from SolverInstance
     virtual bool evalOutput();
+    /// Print a solution given as \a values in the layout of getOutputProgram()->vars(),
+    /// without assigning them to the output model. As evalOutput(), prints
+    /// nothing unless declNewOutput() was called for the solution
+    virtual bool evalOutput(const std::vector<SolutionValue>& values);
+    /// As evalOutput(values), but neither the output model nor any other AST
+    /// is accessed, so it can be called from a rendering thread. Requires
+    /// getOutputProgram() to have succeeded and no SV_EXPR in \a values
+    bool renderOutput(const std::vector<SolutionValue>& values);
+    /// The output item compiled on first use, or NULL if not supported
+    /// or not applicable (JSON-lines output)
+    OutputProgram* getOutputProgram();
     /// This means the solver exits
     virtual bool evalStatus(SolverInstance::Status status);
 
     virtual void printStatistics(std::ostream& );
+    /// Print solver statistics \a stats (text, as from SolverInstanceBase::printStatistics)
+    /// as a JSON object in JSON-lines mode. Returns false if not in JSON-lines mode
+    virtual bool evalStatisticsJSON(const std::string& stats);
     
     virtual Env* getEnv() const { assert(pEnv); return pEnv; }
     virtual Model* getModel() const { assert(getEnv()->output()); return getEnv()->output(); }
@@ -134,7 +158,20 @@ namespace MiniZinc {
     std::unique_ptr<std::ostream> pOfs_non_canon;
     std::unique_ptr<std::ostream> pOfs_raw;
     int nSolns = 0;
+    /// Output vars assigned by the solver, in output model order, for JSON-lines mode
+    std::vector<std::pair<std::string, VarDecl*> > jsonVars;
     std::set<std::string> sSolsCanon;
+    OutputProgram outputProgram;
+    bool fOutputProgramTried = false;
+    /// Values passed to evalOutput(values), or read from the output model
+    const std::vector<SolutionValue>* pOutputValues = 0;
+    std::vector<SolutionValue> outputValues;
+    std::string outputBuffer;
+    std::string renderBuffer;
+    /// Guards the printed state (comments, nSolns, sSolsCanon, status and the
+    /// output streams): with --async-output, solutions are printed by the
+    /// rendering thread while the solver thread may print status and statistics
+    std::mutex mtxPrint;
     std::string line_part;   // non-finished line from last chunk
 
   protected:
@@ -146,10 +183,18 @@ namespace MiniZinc {
     std::map<std::string, SolverInstance::Status> mapInputStatus;
     void createInputMap();
     void restoreDefaults();
+    /// Print the solution text \a sol with comments etc.
+    /// Returns false if it is a repeated solution
+    bool printSolutionText( const std::string& sol );
     /// Parsing fznsolver's complete raw text output
     void parseAssignments( std::string& );
     
     virtual bool __evalOutput(std::ostream& os, bool flag_flush);
+    /// Print the current solution as one JSON object on a single line
+    virtual bool __evalOutputJSON(std::ostream& os);
+    /// Print a JSON-lines record of \a type with the elapsed time and, if nonempty,
+    /// field \a key with the string \a text
+    void printJSONRecord(std::ostream& os, const char* type, const char* key, const std::string& text);
     virtual bool __evalOutputFinal( bool flag_flush );
     virtual bool __evalStatusMsg(SolverInstance::Status status);
     
@@ -13,6 +13,7 @@
 #define __MINIZINC_SOLVER_INSTANCE_BASE_HH__
 
 #include <iostream>
+#include <memory>
 
 #include <minizinc/model.hh>
 #include <minizinc/flatten.hh>
@@ -21,6 +22,7 @@
 #include <minizinc/statistics.hh>
 #include <minizinc/solver_instance.hh>
 #include <minizinc/solns2out.hh>
+#include <minizinc/output_pipeline.hh>
 
 namespace MiniZinc {
 
@@ -53,6 +55,11 @@ namespace MiniZinc {
 
     virtual void printSolution();
 //     virtual void printSolution(ostream& );  // deprecated
+    /// Start asynchronous solution output if requested by the Solns2Out options.
+    /// Should be called from the main thread before solve()
+    virtual void startOutput() { }
+    /// Render all pending solutions and stop asynchronous output
+    virtual void finishOutput() { }
     /// print statistics in form of comments
     virtual void printStatistics(std::ostream&, bool fLegend=0) { }
     virtual void printStatisticsLine(std::ostream&, bool fLegend=0) { }
@@ -89,22 +96,107 @@ namespace MiniZinc {
   class SolverInstanceBase2 : public SolverInstanceBase {
   protected:
     virtual Expression* getSolutionValue(Id* id) = 0;
+    /// Raw solution value of a variable for snapshotSolution().
+    /// Default converts the result of getSolutionValue(); solvers can
+    /// override it to avoid allocating AST nodes in the solution callback
+    virtual SolutionValue getRawSolutionValue(Id* id);
 
   public:
     /// Assign output for all vars: need public for callbacks
     // Default impl requires a Solns2Out object set up
     virtual void assignSolutionToOutput();
+    /// Copy the values of all output vars into \a snap, without AST allocation
+    virtual void snapshotSolution(SolutionSnapshot& snap);
+    /// Assign a snapshot taken by snapshotSolution() to the output model
+    virtual void assignSnapshotToOutput(const SolutionSnapshot& snap);
     /// Print solution to setup dest
     virtual void printSolution();
+    virtual void startOutput();
+    virtual void finishOutput();
     
   protected:
     std::vector<VarDecl*> _varsWithOutput;    // this is to extract fzn vars. Identical to output()?  TODO
+    /// Collect _varsWithOutput from the flat model, if not done by the solver
+    void collectVarsWithOutput();
+    /// Evaluate the dimensions of an output_array annotation
+    void getOutputArrayDims(Call* output_array_ann, std::vector<std::pair<int,int> >& dims_v);
+    /// Asynchronous output, active between startOutput() and finishOutput()
+    std::unique_ptr<SolutionPipeline> _pipeline;
+    /// Set up _outputProgramMap if the output item could be compiled
+    bool mapOutputProgram();
+    /// Print a snapshot with the compiled output program
+    void evalOutputProgram(const SolutionSnapshot& snap);
+    /// For each value of the compiled output program, its index in a snapshot
+    std::vector<int> _outputProgramMap;
+    int _fOutputProgramMapped = -1;
+    SolutionSnapshot _snap;
+    std::vector<SolutionValue> _outputValues;
 
   public:
     SolverInstanceBase2(Env& env, const Options& options=Options())
       : SolverInstanceBase(env, options) {}
+    virtual ~SolverInstanceBase2() { finishOutput(); }
   };
   
+  /// Table from flat variables to solver variables, indexed by the dense
+  /// number oldflatzinc() stores in each VarDecl's payload. Variables
+  /// without a valid number (e.g. when reading FlatZinc directly) are
+  /// numbered on insertion.
+  template<class T>
+  class VarIdTable {
+  protected:
+    /// Solver variables, by index
+    std::vector<T> _vars;
+    /// The identifier of the VarDecl owning each index, or NULL
+    std::vector<Id*> _ids;
+  public:
+    /// Index of \a ident, or -1 if it is not in the table
+    int index(Id* ident) const {
+      VarDecl* vd = ident->decl();
+      if (vd==NULL)
+        return -1;
+      int i = vd->payload();
+      if (i >= 0 && i < static_cast<int>(_ids.size()) && _ids[i]==vd->id())
+        return i;
+      return -1;
+    }
+    /// Insert mapping from \a e to \a t, unless \a e is already mapped
+    void insert(Id* e, const T& t) {
+      assert(e != NULL && e->decl() != NULL);
+      VarDecl* vd = e->decl();
+      int i = vd->payload();
+      if (i < 0 || (i < static_cast<int>(_ids.size()) && _ids[i] != NULL && _ids[i] != vd->id())) {
+        i = static_cast<int>(_ids.size());
+        vd->payload(i);
+      }
+      if (i >= static_cast<int>(_ids.size())) {
+        _ids.resize(i+1, NULL);
+        _vars.resize(i+1, t);
+      }
+      if (_ids[i]==NULL) {
+        _ids[i] = vd->id();
+        _vars[i] = t;
+      }
+    }
+    /// Return the solver variable of \a ident
+    T& get(Id* ident) {
+      int i = index(ident);
+      if (i < 0)
+        throw InternalError("Id not found");
+      return _vars[i];
+    }
+    /// Number of indices, including unused ones
+    size_t size(void) const { return _ids.size(); }
+    /// Identifier at index \a i, or NULL if unused
+    Id* id(size_t i) const { return _ids[i]; }
+    /// Solver variable at index \a i
+    T& operator[](size_t i) { return _vars[i]; }
+    /// Reserve space for \a n variables
+    void reserve(size_t n) { _ids.reserve(n); _vars.reserve(n); }
+    /// Remove all elements from the table
+    void clear(void) { _ids.clear(); _vars.clear(); }
+  };
+
   typedef void (*poster) (SolverInstanceBase&, const Call* call);
   class Registry {
   protected:
@@ -128,7 +220,7 @@ namespace MiniZinc {
     typedef typename Solver::Variable VarId;
 
   protected:
-    IdMap<VarId> _variableMap;      // this to find solver's variables given an Id
+    VarIdTable<VarId> _variableMap;      // this to find solver's variables given an Id
     Registry _constraintRegistry;
 
   public:
@@ -0,0 +1,79 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __MIP_LPWRITE_WRAPPER_H__
+#define __MIP_LPWRITE_WRAPPER_H__
+
+#include <minizinc/solvers/MIP/MIP_wrap.hh>
+
+/// A MIP wrapper without a solver: solve() writes the model to an LP
+/// or (free) MPS file, e.g. to solve it elsewhere. Needs no solver library.
+/// Rows are kept in compressed sparse form until solve(); the file is then
+/// written through a large buffer.
+class MIP_lpwrite_wrapper : public MIP_wrapper {
+    int nCols = 0;
+    /// The rows: coefficients of row i are rowInd/rowVal[rowStart[i]..rowStart[i+1])
+    std::vector<int> rowStart;
+    std::vector<int> rowInd;
+    std::vector<double> rowVal;
+    std::vector<LinConType> rowSense;
+    std::vector<double> rowRhs;
+    std::vector<int> rowMask;
+    std::vector<std::string> rowNames;
+    int objSense = -1;
+
+  public:
+    MIP_lpwrite_wrapper() { rowStart.push_back(0); }
+    virtual ~MIP_lpwrite_wrapper() { }
+
+    /// Columns are kept by MIP_wrapper, just count them
+    virtual void doAddVars(size_t n, double *obj, double *lb, double *ub,
+      VarType *vt, std::string *names) {
+      nCols += n;
+    }
+
+    /// adding a linear constraint
+    virtual void addRow(int nnz, int *rmatind, double* rmatval,
+                        LinConType sense, double rhs,
+                        int mask = MaskConsType_Normal,
+                        std::string rowName = "");
+    virtual void setObjSense(int s) { objSense = s; }   // +/-1 for max/min
+
+    /// The usual infinity of LP files
+    virtual double getInfBound() { return 1e20; }
+
+    virtual int getNCols() { return nCols; }
+    virtual int getNRows() { return static_cast<int>(rowSense.size()); }
+
+    /// Write the model to the file given by --writeModel
+    virtual void solve();
+
+    /// Write the model to \a filename, in MPS format if the name ends
+    /// with .mps and in CPLEX LP format otherwise
+    void writeModel(const std::string& filename);
+
+    /// OUTPUT: there is no solution
+    virtual const double* getValues() { return output.x; }
+    virtual double getObjValue() { return output.objVal; }
+    virtual double getBestBound() { return output.bestBound; }
+    virtual double getCPUTime() { return output.dCPUTime; }
+
+    virtual Status getStatus()  { return output.status; }
+    virtual std::string getStatusName() { return output.statusName; }
+
+    virtual int getNNodes() { return output.nNodes; }
+    virtual int getNOpen() { return output.nOpenNodes; }
+
+  protected:
+    /// Buffered output file
+    class File;
+    /// Names usable in LP and MPS files, unique
+    void makeNames(std::vector<std::string>& colN, std::vector<std::string>& rowN);
+    void writeLP(File& f, const std::vector<std::string>& colN, const std::vector<std::string>& rowN);
+    void writeMPS(File& f, const std::vector<std::string>& colN, const std::vector<std::string>& rowN);
+};
+
+#endif  // __MIP_LPWRITE_WRAPPER_H__
@@ -16,6 +16,12 @@
 #include <minizinc/solver.hh>
 #include <minizinc/solvers/MIP/MIP_wrap.hh>
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
 namespace MiniZinc {
   
   // can be redefined as compilation parameter
@@ -53,12 +59,82 @@ namespace MiniZinc {
     void print( std::ostream& );
   };
 
+  /// Pool of the user cuts passed to the solver, to discard repeated ones.
+  /// Cuts are compared in normalised form: sense <=, sorted indices,
+  /// largest absolute coefficient 1
+  class CutPool {
+  public:
+    enum Verdict { NEW, DUPLICATE, WEAK };
+    /// Check \a cut against the pool and the point \a x, add it if NEW.
+    /// WEAK if its normalised violation is below \a dMinViol,
+    /// DUPLICATE if a pooled cut has the same coefficients and a rhs as tight
+    Verdict add( const MIP_wrapper::CutDef& cut, const double* x, int nCols, double dMinViol );
+    /// Forget all cuts. A pooled cut still violated by a later point is
+    /// not in the LP any more (purged, or local to another node), so the
+    /// pool only deduplicates the cuts of one callback
+    void clear() { rhs.clear(); }
+    size_t size() const { return rhs.size(); }
+  protected:
+    struct Key {
+      vector<int> ind;
+      vector<long long> val;   // coefficients rounded to 1e-9
+      size_t hash = 0;
+      bool operator==( const Key& k ) const { return ind==k.ind && val==k.val; }
+    };
+    struct KeyHash {
+      size_t operator()( const Key& k ) const { return k.hash; }
+    };
+    /// Tightest rhs for each normalised coefficient vector
+    std::unordered_map<Key, double, KeyHash> rhs;
+  };
+
+  /// Worker threads running the cut generators of a callback in parallel
+  class CutGenThreads {
+  public:
+    CutGenThreads( int nThreads );
+    ~CutGenThreads();
+    /// Run \a task(i) for i in [0, n) in this thread and the workers
+    void run( size_t n, const std::function<void(size_t)>& task );
+  protected:
+    void work();
+    vector<std::thread> aWorkers;
+    std::mutex mtx;
+    std::condition_variable cvStart, cvDone;
+    const std::function<void(size_t)>* pTask = 0;
+    size_t nTasks = 0;
+    std::atomic<size_t> iNext;
+    int nBusy = 0;
+    unsigned long nRound = 0;
+    bool fStop = false;
+  };
+
   class MIP_solverinstance : public SolverInstanceImpl<MIP_solver> {
     protected:
       
       const unique_ptr<MIP_wrapper> mip_wrap;
       vector< unique_ptr<CutGen> > cutGenerators;
       
+      /// Separation in parallel and cut deduplication, set up in solve()
+      unique_ptr<CutGenThreads> cutThreads;
+      CutPool cutPool;
+      /// Solvers may call the cut callback from several threads
+      std::mutex mtxCuts;
+      /// Cut callback statistics
+      struct CutStats {
+        int nCalls = 0;
+        double dTime = 0.0;         // whole callback, sec
+        double dTimeSep = 0.0;      // running the generators, sec
+        long nGenerated = 0, nDuplicate = 0, nWeak = 0, nAdded = 0;
+      } cutStats;
+
+      /// For each scalar output value (in snapshot order), its column,
+      /// or -1 if the value is fixed in the flat model
+      vector<int> outputColumns;
+      /// Snapshot template: the kind of each column value, or the fixed value
+      vector<SolutionValue> outputValuesFixed;
+      /// Set up outputColumns, once all variables are added
+      void mapOutputColumns();
+      
     public:
       void registerCutGenerator( unique_ptr<CutGen>&& pCG ) {
         getMIPWrapper()->cbui.cutMask |= pCG->getMask();
@@ -98,6 +174,10 @@ namespace MiniZinc {
       double exprToConst(Expression* e);
 
       Expression* getSolutionValue(Id* id);
+      /// Copy only the output columns, without creating AST nodes
+      virtual void snapshotSolution(SolutionSnapshot& snap);
+      /// Literals are created from a snapshot, just for rendering
+      virtual void printSolution();
 
       void registerConstraints(void);
   };  // MIP_solverinstance
@@ -106,10 +186,9 @@ namespace MiniZinc {
   public:
     SolverInstanceBase* doCreateSI(Env& env)   { return new MIP_solverinstance(env); }
     
-    bool processOption(int& i, int argc, const char** argv)
-      { return MIP_WrapperFactory::processOption(i, argc, argv); }
+    bool processOption(int& i, int argc, const char** argv);
     string getVersion( );
-    void printHelp(std::ostream& os) { MIP_WrapperFactory::printHelp(os); }
+    void printHelp(std::ostream& os);
   };
 
 }
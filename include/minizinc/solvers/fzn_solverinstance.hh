@@ -46,6 +46,11 @@ namespace MiniZinc {
 
     protected:
       Expression* getSolutionValue(Id* id);
+      /// Solve the independent components of the model with separate
+      /// solver processes, grouped into at most \a nParts parts
+      Status solveComponents(std::vector<std::string>& cmd_line, int nParts);
+      /// Run the solvers given by --portfolio in parallel with the main one
+      Status solvePortfolio(std::vector<std::string>& cmd_line);
   };
 
 }
@@ -203,6 +203,11 @@ namespace MiniZinc {
     bool _run_sac;
     bool _run_shave;
     unsigned int _pre_passes;
+    /// Number of threads for SAC/shaving probes (1 = sequential)
+    unsigned int _sac_threads;
+    /// SAC statistics
+    unsigned long long _sac_probes;
+    unsigned long long _sac_removed;
     unsigned int _n_max_solutions;
     unsigned int _n_found_solutions;
     Model* _flat;
@@ -234,9 +239,13 @@ namespace MiniZinc {
     // names in the given Model* m.
     bool presolve(Model* m = NULL);
     bool sac(bool toFixedPoint, bool shaving);
+    /// SAC with probes distributed over _sac_threads cloned spaces
+    bool sac_parallel(bool toFixedPoint, bool shaving);
     void print_stats();
 
     virtual Expression* getSolutionValue(Id* id);
+    /// Reads the value from _solution without creating a literal
+    virtual SolutionValue getRawSolutionValue(Id* id);
 
     Gecode::Space* getGecodeModel(void);
 
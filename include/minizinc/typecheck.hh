@@ -78,13 +78,17 @@ namespace MiniZinc {
     void run(EnvI& env, Expression* e);
   };
   
-  /// Type check the model \a m
+  /// Type check the model \a m, scanning data arrays with \a nThreads threads
   void typecheck(Env& env, Model* m, std::vector<TypeError>& typeErrors,
-                 bool ignoreUndefinedParameters = false);
+                 bool ignoreUndefinedParameters = false, int nThreads = 1);
 
   /// Type check new assign item \a ai in model \a m
   void typecheck(Env& env, Model* m, AssignI* ai);
 
+  /// Type check the data assignments added to model \a m after it has been
+  /// type checked (ignoring undefined parameters)
+  void typecheck_data(Env& env, Model* m, std::vector<TypeError>& typeErrors);
+
   /// Typecheck FlatZinc variable declarations
   void typecheck_fzn(Env& env, Model* m);
 
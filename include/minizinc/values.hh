@@ -57,6 +57,23 @@ namespace MiniZinc {
 
 #undef MZN_NORETURN
 
+/// Checked arithmetic via compiler builtins where available, SafeInt otherwise
+#ifndef MZN_HAS_OVERFLOW_BUILTINS
+#if defined(__GNUC__) && __GNUC__ >= 5
+#define MZN_HAS_OVERFLOW_BUILTINS 1
+#elif defined(__has_builtin)
+#if __has_builtin(__builtin_add_overflow) && __has_builtin(__builtin_mul_overflow)
+#define MZN_HAS_OVERFLOW_BUILTINS 1
+#endif
+#endif
+#endif
+
+#if defined(__GNUC__)
+#define MZN_UNLIKELY(c) __builtin_expect(!!(c),0)
+#else
+#define MZN_UNLIKELY(c) (c)
+#endif
+
 namespace MiniZinc {
   
   class FloatVal;
@@ -77,14 +94,52 @@ namespace MiniZinc {
     typedef SafeInt<long long int, MiniZincSafeIntExceptionHandler> SI;
     SI toSafeInt(void) const { return _v; }
     IntVal(SI v) : _v(v), _infinity(false) {}
+    /// Kept out of line, off the fast path
+    static void throwInfinite(void) MZN_NORETURN_ATTR;
+    static void checkFinite(const IntVal& x, const IntVal& y) {
+      if (MZN_UNLIKELY(x._infinity | y._infinity))
+        throwInfinite();
+    }
   public:
+    /// Checked operations on finite values, throwing ArithmeticError on overflow
+    static long long int safePlus(long long int x, long long int y) {
+#ifdef MZN_HAS_OVERFLOW_BUILTINS
+      long long int r;
+      if (MZN_UNLIKELY(__builtin_add_overflow(x, y, &r)))
+        MiniZincSafeIntExceptionHandler::SafeIntOnOverflow();
+      return r;
+#else
+      return SI(x)+SI(y);
+#endif
+    }
+    static long long int safeMinus(long long int x, long long int y) {
+#ifdef MZN_HAS_OVERFLOW_BUILTINS
+      long long int r;
+      if (MZN_UNLIKELY(__builtin_sub_overflow(x, y, &r)))
+        MiniZincSafeIntExceptionHandler::SafeIntOnOverflow();
+      return r;
+#else
+      return SI(x)-SI(y);
+#endif
+    }
+    static long long int safeMult(long long int x, long long int y) {
+#ifdef MZN_HAS_OVERFLOW_BUILTINS
+      long long int r;
+      if (MZN_UNLIKELY(__builtin_mul_overflow(x, y, &r)))
+        MiniZincSafeIntExceptionHandler::SafeIntOnOverflow();
+      return r;
+#else
+      return SI(x)*SI(y);
+#endif
+    }
+
     IntVal(void) : _v(0), _infinity(false) {}
     IntVal(long long int v) : _v(v), _infinity(false) {}
     IntVal(const FloatVal& v);
     
     long long int toInt(void) const {
-      if (!isFinite())
-        throw ArithmeticError("arithmetic operation on infinite value");
+      if (MZN_UNLIKELY(!isFinite()))
+        throwInfinite();
       return _v;
     }
     
@@ -93,21 +148,18 @@ namespace MiniZinc {
     bool isMinusInfinity(void) const { return _infinity && _v==-1; }
     
     IntVal& operator +=(const IntVal& x) {
-      if (! (isFinite() && x.isFinite()))
-        throw ArithmeticError("arithmetic operation on infinite value");
-      _v = toSafeInt() + x.toSafeInt();
+      checkFinite(*this, x);
+      _v = safePlus(_v, x._v);
       return *this;
     }
     IntVal& operator -=(const IntVal& x) {
-      if (! (isFinite() && x.isFinite()))
-        throw ArithmeticError("arithmetic operation on infinite value");
-      _v = toSafeInt() - x.toSafeInt();
+      checkFinite(*this, x);
+      _v = safeMinus(_v, x._v);
       return *this;
     }
     IntVal& operator *=(const IntVal& x) {
-      if (! (isFinite() && x.isFinite()))
-        throw ArithmeticError("arithmetic operation on infinite value");
-      _v = toSafeInt() * x.toSafeInt();
+      checkFinite(*this, x);
+      _v = safeMult(_v, x._v);
       return *this;
     }
     IntVal& operator /=(const IntVal& x) {
@@ -118,33 +170,29 @@ namespace MiniZinc {
     }
     IntVal operator -() const {
       IntVal r = *this;
-      r._v = -r.toSafeInt();
+      r._v = safeMinus(0, r._v);
       return r;
     }
     IntVal& operator ++() {
-      if (!isFinite())
-        throw ArithmeticError("arithmetic operation on infinite value");
-      _v = toSafeInt() + 1;
+      checkFinite(*this, *this);
+      _v = safePlus(_v, 1);
       return *this;
     }
     IntVal operator ++(int) {
-      if (!isFinite())
-        throw ArithmeticError("arithmetic operation on infinite value");
+      checkFinite(*this, *this);
       IntVal ret = *this;
-      _v = toSafeInt() + 1;
+      _v = safePlus(_v, 1);
       return ret;
     }
     IntVal& operator --() {
-      if (!isFinite())
-        throw ArithmeticError("arithmetic operation on infinite value");
-      _v = toSafeInt() - 1;
+      checkFinite(*this, *this);
+      _v = safeMinus(_v, 1);
       return *this;
     }
     IntVal operator --(int) {
-      if (!isFinite())
-        throw ArithmeticError("arithmetic operation on infinite value");
+      checkFinite(*this, *this);
       IntVal ret = *this;
-      _v = toSafeInt() - 1;
+      _v = safeMinus(_v, 1);
       return ret;
     }
     static const IntVal minint(void);
@@ -154,14 +202,14 @@ namespace MiniZinc {
     /// Infinity-safe addition
     IntVal plus(int x) const {
       if (isFinite())
-        return toSafeInt()+x;
+        return safePlus(_v, x);
       else
         return *this;
     }
     /// Infinity-safe subtraction
     IntVal minus(int x) const {
       if (isFinite())
-        return toSafeInt()-x;
+        return safeMinus(_v, x);
       else
         return *this;
     }
@@ -202,28 +250,27 @@ namespace MiniZinc {
   }
   inline
   IntVal operator +(const IntVal& x, const IntVal& y) {
-    if (! (x.isFinite() && y.isFinite()))
-      throw ArithmeticError("arithmetic operation on infinite value");
-    return x.toSafeInt()+y.toSafeInt();
+    IntVal::checkFinite(x, y);
+    return IntVal::safePlus(x._v, y._v);
   }
   inline
   IntVal operator -(const IntVal& x, const IntVal& y) {
-    if (! (x.isFinite() && y.isFinite()))
-      throw ArithmeticError("arithmetic operation on infinite value");
-    return x.toSafeInt()-y.toSafeInt();
+    IntVal::checkFinite(x, y);
+    return IntVal::safeMinus(x._v, y._v);
   }
   inline
   IntVal operator *(const IntVal& x, const IntVal& y) {
-    if (!x.isFinite()) {
-      if (y.isFinite() && std::abs(y._v)==1)
-        return IntVal(x._v*y._v,!x.isFinite());
-    } else if (!y.isFinite()) {
-      if (x.isFinite() && std::abs(x._v)==1)
-        return IntVal(x._v*y._v,true);
-    } else {
-      return x.toSafeInt()*y.toSafeInt();
+    if (MZN_UNLIKELY(x._infinity | y._infinity)) {
+      if (!x.isFinite()) {
+        if (y.isFinite() && std::abs(y._v)==1)
+          return IntVal(x._v*y._v,!x.isFinite());
+      } else {
+        if (std::abs(x._v)==1)
+          return IntVal(x._v*y._v,true);
+      }
+      IntVal::throwInfinite();
     }
-    throw ArithmeticError("arithmetic operation on infinite value");
+    return IntVal::safeMult(x._v, y._v);
   }
   inline
   IntVal operator /(const IntVal& x, const IntVal& y) {
@@ -249,6 +296,16 @@ namespace MiniZinc {
     else
       return os << s.toInt();
   }
+
+  /// Bulk operations over arrays of finite integers, e.g. par int arrays,
+  /// throwing ArithmeticError on overflow. Sum and dot product take a
+  /// single pass, collecting the overflow flags of all steps.
+  long long int int_array_sum(const long long int* x, size_t n);
+  /// Dot product, e.g. of linear coefficients and bounds
+  long long int int_array_dot(const long long int* x, const long long int* y, size_t n);
+  /// Minimum and maximum of \a n>0 values
+  long long int int_array_min(const long long int* x, size_t n);
+  long long int int_array_max(const long long int* x, size_t n);
   
 }
 
@@ -555,6 +612,12 @@ namespace MiniZinc {
       for (unsigned int i=s.size(); i--;)
         get(i) = s[i];
     }
+    /// Construct set from the \a n ranges in \a s
+    IntSetVal(const Range* s, int n)
+      : ASTChunk(sizeof(Range)*n) {
+      for (int i=n; i--;)
+        get(i) = s[i];
+    }
 
     /// Disabled
     IntSetVal(const IntSetVal& r);
@@ -563,6 +626,10 @@ namespace MiniZinc {
   public:
     /// Return number of ranges
     int size(void) const { return _size / sizeof(Range); }
+    /// Return the range list
+    const Range* ranges(void) const {
+      return reinterpret_cast<const Range*>(_data);
+    }
     /// Return minimum, or infinity if set is empty
     IntVal min(void) const { return size()==0 ? IntVal::infinity() : get(0).min; }
     /// Return maximum, or minus infinity if set is empty
@@ -623,47 +690,45 @@ namespace MiniZinc {
     }
     
     /// Allocate set from vector \a s0 (may contain duplicates)
-    static IntSetVal* a(const std::vector<IntVal>& s0) {
-      if (s0.size()==0)
-        return a();
-      std::vector<IntVal> s=s0;
-      std::sort(s.begin(),s.end());
-      std::vector<Range> ranges;
-      IntVal min=s[0];
-      IntVal max=min;
-      for (unsigned int i=1; i<s.size(); i++) {
-        if (s[i]>max+1) {
-          ranges.push_back(Range(min,max));
-          min=s[i]; max=min;
-        } else {
-          max=s[i];
-        }
-      }
-      ranges.push_back(Range(min,max));
-      IntSetVal* r = static_cast<IntSetVal*>(
-          ASTChunk::alloc(sizeof(Range)*ranges.size()));
-      new (r) IntSetVal(ranges);
-      return r;
-    }
+    static IntSetVal* a(const std::vector<IntVal>& s0);
+    /// Allocate set from the \a n sorted values in \a x (may contain duplicates)
+    static IntSetVal* aSorted(const long long int* x, size_t n);
     static IntSetVal* a(const std::vector<Range>& ranges) {
       IntSetVal* r = static_cast<IntSetVal*>(ASTChunk::alloc(sizeof(Range)*ranges.size()));
       new (r) IntSetVal(ranges);
       return r;
     }
-    
+    /// Allocate set from the \a n ranges in \a ranges
+    static IntSetVal* a(const Range* ranges, int n) {
+      IntSetVal* r = static_cast<IntSetVal*>(ASTChunk::alloc(sizeof(Range)*n));
+      new (r) IntSetVal(ranges,n);
+      return r;
+    }
+
+    /// \name Set operations
+    /// Merge the range lists directly instead of going through the
+    /// Ranges iterators. If the result is equal to an argument, that
+    /// argument is returned and nothing is allocated.
+    //@{
+    static IntSetVal* unite(IntSetVal* a, IntSetVal* b);
+    static IntSetVal* intersect(IntSetVal* a, IntSetVal* b);
+    static IntSetVal* diff(IntSetVal* a, IntSetVal* b);
+    static IntSetVal* symdiff(IntSetVal* a, IntSetVal* b);
+    /// Check if \a a is a subset of \a b
+    static bool subset(const IntSetVal* a, const IntSetVal* b);
+    //@}
+
+    /// Return index of the first range with maximum at least \a v, or size()
+    int lowerBoundRange(const IntVal& v, int from=0) const;
+
     /// Check if set contains \a v
-    bool contains(const IntVal& v) {
-      for (int i=0; i<size(); i++) {
-        if (v < min(i))
-          return false;
-        if (v <= max(i))
-          return true;
-      }
-      return false;
+    bool contains(const IntVal& v) const {
+      int i = lowerBoundRange(v);
+      return i<size() && min(i) <= v;
     }
     
     /// Check if it is equal to \a s
-    bool equal(const IntSetVal* s) {
+    bool equal(const IntSetVal* s) const {
       if (size()!=s->size())
         return false;
       for (int i=0; i<size(); i++)
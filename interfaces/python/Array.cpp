@@ -0,0 +1,125 @@
+/*  Python Interface for MiniZinc constraint modelling
+ */
+
+
+#include "Array.h"
+
+static void
+MznArray_dealloc(MznArray* self)
+{
+  delete[] self->data;
+  delete[] self->shape;
+  delete[] self->strides;
+  delete[] self->index_min;
+  Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+static PyObject*
+MznArray_new(PyTypeObject *type, PyObject* args, PyObject* kwds)
+{
+  MznArray* self = reinterpret_cast<MznArray*>(type->tp_alloc(type,0));
+  self->data = NULL;
+  self->format[0] = self->format[1] = '\0';
+  self->itemsize = 0;
+  self->len = 0;
+  self->ndim = 0;
+  self->shape = NULL;
+  self->strides = NULL;
+  self->index_min = NULL;
+  return reinterpret_cast<PyObject*>(self);
+}
+
+int
+MznArray::alloc(const vector<Py_ssize_t>& dims, Type::BaseType bt)
+{
+  switch (bt) {
+    case Type::BT_INT: format[0] = 'q'; itemsize = sizeof(long long); break;
+    case Type::BT_FLOAT: format[0] = 'd'; itemsize = sizeof(double); break;
+    case Type::BT_BOOL: format[0] = '?'; itemsize = sizeof(bool); break;
+    default:
+      PyErr_SetString(PyExc_TypeError, "MiniZinc: Array: only arrays of int, float or bool are supported");
+      return -1;
+  }
+  ndim = dims.size();
+  shape = new Py_ssize_t[ndim];
+  strides = new Py_ssize_t[ndim];
+  index_min = new long long[ndim];
+  len = itemsize;
+  for (int i=ndim; i--;) {
+    shape[i] = dims[i];
+    strides[i] = len;
+    index_min[i] = 1;
+    len *= dims[i];
+  }
+  // Never allocate zero bytes, so that data is a valid pointer
+  data = new char[len > 0 ? len : 1];
+  return 0;
+}
+
+static Py_ssize_t
+MznArray_len(PyObject* self)
+{
+  MznArray* a = reinterpret_cast<MznArray*>(self);
+  return a->ndim == 0 ? 0 : a->shape[0];
+}
+
+static int
+MznArray_getbuffer(PyObject* self, Py_buffer* view, int flags)
+{
+  MznArray* a = reinterpret_cast<MznArray*>(self);
+  if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+    view->obj = NULL;
+    PyErr_SetString(PyExc_BufferError, "MiniZinc: Array is read-only");
+    return -1;
+  }
+  if ((flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS && a->ndim > 1) {
+    view->obj = NULL;
+    PyErr_SetString(PyExc_BufferError, "MiniZinc: Array is C-contiguous");
+    return -1;
+  }
+  view->obj = self;
+  Py_INCREF(self);
+  view->buf = a->data;
+  view->len = a->len;
+  view->readonly = 1;
+  view->itemsize = a->itemsize;
+  view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? a->format : NULL;
+  // Without PyBUF_ND, the consumer expects a plain block of bytes
+  view->ndim = (flags & PyBUF_ND) == PyBUF_ND ? a->ndim : 1;
+  view->shape = (flags & PyBUF_ND) == PyBUF_ND ? a->shape : NULL;
+  view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? a->strides : NULL;
+  view->suboffsets = NULL;
+  view->internal = NULL;
+  return 0;
+}
+
+static PyObject*
+MznArray_get_index_min(MznArray* self, void* closure)
+{
+  PyObject* ret = PyTuple_New(self->ndim);
+  for (int i=0; i<self->ndim; ++i)
+    PyTuple_SET_ITEM(ret, i, c_to_py_number(self->index_min[i]));
+  return ret;
+}
+
+static PyObject*
+MznArray_repr(PyObject* self)
+{
+  MznArray* a = reinterpret_cast<MznArray*>(self);
+  stringstream output;
+  output << "minizinc.Array(";
+  switch (a->format[0]) {
+    case 'q': output << "int"; break;
+    case 'd': output << "float"; break;
+    case '?': output << "bool"; break;
+  }
+  output << ", shape=(";
+  for (int i=0; i<a->ndim; ++i) {
+    if (i != 0)
+      output << ", ";
+    output << a->shape[i];
+  }
+  output << (a->ndim == 1 ? ",))" : "))");
+  const std::string& tmp = output.str();
+  return PyUnicode_FromString(tmp.c_str());
+}
@@ -0,0 +1,115 @@
+/*  Python Interface for MiniZinc constraint modelling
+ */
+
+
+#ifndef __MZNARRAY_H
+#define __MZNARRAY_H
+
+#include "global.h"
+
+#if PY_MAJOR_VERSION >= 3
+#  define Py_TPFLAGS_HAVE_NEWBUFFER 0
+#endif
+
+using namespace std;
+using namespace MiniZinc;
+
+
+/*
+ *  A read-only, C-contiguous array of int, float or bool values
+ *
+ *  It is returned by Solver.get_array and exports its data through the
+ *  buffer protocol, so that it can be used without copying, for example:
+ *        a = numpy.asarray(solver.get_array("x"))
+ *  or
+ *        m = memoryview(solver.get_array("x"))
+ *
+ *  Integers are stored as 'q' (long long), floats as 'd' (double) and
+ *  booleans as '?' (one byte each). index_min holds the lower bound of
+ *  the index set of each dimension. Arrays cannot be created from python.
+ */
+struct MznArray {
+  PyObject_HEAD
+  char* data;
+  char format[2];
+  Py_ssize_t itemsize;
+  Py_ssize_t len;
+  int ndim;
+  Py_ssize_t* shape;
+  Py_ssize_t* strides;
+  long long* index_min;
+
+  // Allocate the data for an array of the given dimensions and base type
+  // Returns -1 and sets the python error if the base type is not supported
+  int alloc(const vector<Py_ssize_t>& dims, Type::BaseType bt);
+};
+
+static PyObject* MznArray_new(PyTypeObject *type, PyObject* args, PyObject* kwds);
+static void MznArray_dealloc(MznArray* self);
+static PyObject* MznArray_repr(PyObject* self);
+static Py_ssize_t MznArray_len(PyObject* self);
+static int MznArray_getbuffer(PyObject* self, Py_buffer* view, int flags);
+static PyObject* MznArray_get_index_min(MznArray* self, void* closure);
+
+static PySequenceMethods MznArray_as_sequence = {
+  MznArray_len,              /* sq_length */
+};
+
+static PyBufferProcs MznArray_as_buffer = {
+#if PY_MAJOR_VERSION < 3
+  0,                         /* bf_getreadbuffer */
+  0,                         /* bf_getwritebuffer */
+  0,                         /* bf_getsegcount */
+  0,                         /* bf_getcharbuffer */
+#endif
+  MznArray_getbuffer,        /* bf_getbuffer */
+  0,                         /* bf_releasebuffer */
+};
+
+static PyGetSetDef MznArray_getseters[] = {
+  {(char*)"index_min", (getter)MznArray_get_index_min, NULL, (char*)"Lower bound of each index set", NULL},
+  {NULL}    /* Sentinel */
+};
+
+static PyTypeObject MznArray_Type = {
+  PyVarObject_HEAD_INIT(NULL,0)
+  "minizinc.Array",          /* tp_name */
+  sizeof(MznArray),          /* tp_basicsize */
+  0,                         /* tp_itemsize */
+  (destructor)MznArray_dealloc,/* tp_dealloc */
+  0,                         /* tp_print */
+  0,                         /* tp_getattr */
+  0,                         /* tp_setattr */
+  0,                         /* tp_reserved */
+  MznArray_repr,             /* tp_repr */
+  0,                         /* tp_as_number */
+  &MznArray_as_sequence,     /* tp_as_sequence */
+  0,                         /* tp_as_mapping */
+  0,                         /* tp_hash  */
+  0,                         /* tp_call */
+  0,                         /* tp_str */
+  0,                         /* tp_getattro */
+  0,                         /* tp_setattro */
+  &MznArray_as_buffer,       /* tp_as_buffer */
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER,        /* tp_flags */
+  "Minizinc Array Object",   /* tp_doc */
+  0,                         /* tp_traverse */
+  0,                         /* tp_clear */
+  0,                         /* tp_richcompare */
+  0,                         /* tp_weaklistoffset */
+  0,                         /* tp_iter */
+  0,                         /* tp_iternext */
+  0,                         /* tp_methods */
+  0,                         /* tp_members */
+  MznArray_getseters,        /* tp_getset */
+  0,                         /* tp_base */
+  0,                         /* tp_dict */
+  0,                         /* tp_descr_get */
+  0,                         /* tp_descr_set */
+  0,                         /* tp_dictoffset */
+  0,                         /* tp_init */
+  0,                         /* tp_alloc */
+  0,                         /* tp_new */
+};
+
+#endif
@@ -7,28 +7,30 @@
 
 #include "Solver.h"
 
+VarDecl*
+PyMznSolver::lookup(const char* const name)
+{
+  std::unordered_map<std::string, VarDecl*>::iterator it = _index->find(name);
+  if (it == _index->end()) {
+    MZN_PYERR_SET_STRING(PyExc_RuntimeError, "'%s' not found", name);
+    return NULL;
+  }
+  return it->second;
+}
+
 static PyObject*
 PyMznSolver_get_value_helper(PyMznSolver* self, const char* const name)
 {
-  for (unsigned int i=0; i<self->_m->size(); ++i) {
-    if (VarDeclI* vdi = (*(self->_m))[i]->dyn_cast<VarDeclI>()) {
-      if (strcmp(vdi->e()->id()->str().c_str(), name) == 0) {
-        GCLock Lock;
-        if (PyObject* PyValue = minizinc_to_python(vdi->e()))
-          return PyValue;
-        else {
-          char buffer[50];
-          sprintf(buffer, "Cannot retrieve the value of '%s'", name);
-          PyErr_SetString(PyExc_RuntimeError, buffer);
-          return NULL;
-        }
-      }
-    }
+  VarDecl* vd = self->lookup(name);
+  if (vd == NULL)
+    return NULL;
+  GCLock Lock;
+  if (PyObject* PyValue = minizinc_to_python(vd))
+    return PyValue;
+  else {
+    MZN_PYERR_SET_STRING(PyExc_RuntimeError, "Cannot retrieve the value of '%s'", name);
+    return NULL;
   }
-  char buffer[50];
-  sprintf(buffer, "'%s' not found", name);
-  PyErr_SetString(PyExc_RuntimeError, buffer);
-  return NULL;
 }
 
 static PyObject* 
@@ -47,8 +49,6 @@ PyMznSolver_get_value(PyMznSolver* self, PyObject* args) {
     name = PyUnicode_AsUTF8(obj);
     return PyMznSolver_get_value_helper(self, name);;
   } else 
-  // XXX: INEFFICIENT function to retrieve values, consider optimize it later
-  // Python Dictionary would be good
     if (PyList_Check(obj)) {
       Py_ssize_t n = PyList_GET_SIZE(obj);
       PyObject* ret = PyList_New(n);
@@ -94,6 +94,24 @@ PyMznSolver_get_value(PyMznSolver* self, PyObject* args) {
 }
 
 
+static PyObject*
+PyMznSolver_get_array(PyMznSolver* self, PyObject* args) {
+  const char* name;
+  if (!(self->_m)) {
+    PyErr_SetString(PyExc_RuntimeError, "No model (maybe you need to call Model.next() first");
+    return NULL;
+  }
+  if (!PyArg_ParseTuple(args, "s", &name)) {
+    PyErr_SetString(PyExc_TypeError,"Accept 1 argument of string");
+    return NULL;
+  }
+  VarDecl* vd = self->lookup(name);
+  if (vd == NULL)
+    return NULL;
+  return minizinc_to_buffer(vd);
+}
+
+
 PyObject*
 PyMznSolver::next()
 {
@@ -103,6 +121,10 @@ PyMznSolver::next()
   SolverInstance::Status status = solver->solve();
   if (status == SolverInstance::SAT || status == SolverInstance::OPT) {
     _m = env->output();
+    _index->clear();
+    for (unsigned int i=0; i<_m->size(); ++i)
+      if (VarDeclI* vdi = (*_m)[i]->dyn_cast<VarDeclI>())
+        (*_index)[vdi->e()->id()->str().str()] = vdi->e();
     Py_RETURN_NONE; 
   }
   if (_m == NULL)
@@ -119,6 +141,7 @@ PyMznSolver_dealloc(PyMznSolver* self)
     delete self->env;
   if (self->solver)
     delete self->solver;
+  delete self->_index;
   Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
 }
 
@@ -129,6 +152,7 @@ PyMznSolver_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
   self->solver = NULL;
   self->_m = NULL;
   self->env = NULL;
+  self->_index = new std::unordered_map<std::string, VarDecl*>;
   return reinterpret_cast<PyObject*>(self);
 }
 
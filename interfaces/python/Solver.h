@@ -9,14 +9,20 @@
 #define __SOLVER_H
 
 #include "global.h"
+#include <unordered_map>
 
 struct PyMznSolver {
   PyObject_HEAD
   MiniZinc::SolverInstanceBase* solver;
   MiniZinc::Env* env;
   MiniZinc::Model* _m;
+  // Declarations of _m by name, rebuilt for every solution
+  std::unordered_map<std::string, MiniZinc::VarDecl*>* _index;
 
   PyObject* next();
+  // Returns the declaration of name in the current solution,
+  // sets the python error and returns NULL if not found
+  MiniZinc::VarDecl* lookup(const char* const name);
 };
 
 static PyObject* PyMznSolver_new(PyTypeObject* type, PyObject* args, PyObject* kwds);
@@ -36,6 +42,11 @@ static PyObject* PyMznSolver_get_value_helper(PyMznSolver* self, PyObject* args)
 // returns a value or a tuple of value depending on which type argument was parsed.
 static PyObject* PyMznSolver_get_value(PyMznSolver* self, PyObject* args);
 
+// get_array accepts 1 string, the name of an array of int, float or bool.
+// returns a minizinc.Array holding the values in a contiguous buffer,
+//   which can be passed to numpy.asarray or memoryview without copying
+static PyObject* PyMznSolver_get_array(PyMznSolver* self, PyObject* args);
+
 
 
 static PyMemberDef PyMznSolver_members[] = {
@@ -48,6 +59,7 @@ static PyMemberDef PyMznSolver_members[] = {
 static PyMethodDef PyMznSolver_methods[] = {
   {"next", (PyCFunction)PyMznSolver_next, METH_NOARGS, "Next Solution"},
   {"get_value",(PyCFunction)PyMznSolver_get_value, METH_VARARGS, "Get value of a variable"},
+  {"get_array",(PyCFunction)PyMznSolver_get_array, METH_VARARGS, "Get value of an array as a buffer"},
   {NULL} /* Sentinel */
 };
 
@@ -180,6 +180,66 @@ minizinc_to_python(VarDecl* vd)
 }
 
 
+/*
+ * Convert minizinc array to a contiguous minizinc.Array
+ */
+PyObject*
+minizinc_to_buffer(VarDecl* vd)
+{
+  GCLock Lock;
+  if (vd==NULL) {
+    PyErr_SetString(PyExc_ValueError, "MiniZinc_to_Buffer: Value is not set");
+    return NULL;
+  }
+  Type type = vd->type();
+  if (type.dim() == 0 || type.st() == Type::ST_SET) {
+    PyErr_SetString(PyExc_TypeError, "MiniZinc_to_Buffer: Value must be an array of int, float or bool");
+    return NULL;
+  }
+  Env env(NULL);
+  ArrayLit *al = eval_par(env.envi(), vd->e())->cast<ArrayLit>();
+  vector<Py_ssize_t> dims(al->dims());
+  for (int i=0; i<al->dims(); ++i)
+    dims[i] = al->max(i) - al->min(i) + 1;
+
+  MznArray* ret = reinterpret_cast<MznArray*>(MznArray_new(&MznArray_Type, NULL, NULL));
+  if (ret->alloc(dims, type.bt()) == -1) {
+    Py_DECREF(ret);
+    return NULL;
+  }
+  for (int i=0; i<al->dims(); ++i)
+    ret->index_min[i] = al->min(i);
+
+  ASTExprVec<Expression> v = al->v();
+  switch (type.bt()) {
+    case Type::BT_INT:
+    {
+      long long* data = reinterpret_cast<long long*>(ret->data);
+      for (unsigned int i=0; i<v.size(); ++i)
+        data[i] = eval_int(env.envi(), v[i]).toInt();
+      break;
+    }
+    case Type::BT_FLOAT:
+    {
+      double* data = reinterpret_cast<double*>(ret->data);
+      for (unsigned int i=0; i<v.size(); ++i)
+        data[i] = eval_float(env.envi(), v[i]).toDouble();
+      break;
+    }
+    case Type::BT_BOOL:
+    {
+      bool* data = reinterpret_cast<bool*>(ret->data);
+      for (unsigned int i=0; i<v.size(); ++i)
+        data[i] = eval_bool(env.envi(), v[i]);
+      break;
+    }
+    default:
+      throw logic_error("MiniZinc: minizinc_to_buffer: Unexpected type code");
+  }
+  return reinterpret_cast<PyObject*>(ret);
+}
+
+
 inline Expression*
 one_dim_python_to_minizinc(PyObject* pvalue, Type::BaseType& code)
 {
@@ -272,15 +332,122 @@ one_dim_python_to_minizinc(PyObject* pvalue, Type::BaseType& code)
 }
 
 
+inline bool
+is_minizinc_buffer(PyObject* pvalue)
+{
+  return PyObject_CheckBuffer(pvalue) && !PyBytes_Check(pvalue) &&
+         !PyUnicode_Check(pvalue) && !PyByteArray_Check(pvalue);
+}
+
+template<class T>
+inline T buffer_item(const char* p)
+{
+  // memcpy, as items of packed formats need not be aligned
+  T v;
+  memcpy(&v, p, sizeof(T));
+  return v;
+}
+
+int
+buffer_to_minizinc(PyObject* pvalue, vector<Py_ssize_t>& dimensions,
+                   vector<Expression*>& elements, Type::BaseType& code)
+{
+  Py_buffer view;
+  if (PyObject_GetBuffer(pvalue, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == -1) {
+    PyErr_Clear();
+    PyErr_SetString(PyExc_TypeError, "MiniZinc: python_to_minizinc: buffer must be C-contiguous");
+    return -1;
+  }
+  // Only single items in native or explicit byte order are supported
+  const char* format = view.format == NULL ? "B" : view.format;
+  char order = '@';
+  if (strchr("@=<>!", *format) != NULL)
+    order = *format++;
+  const unsigned int one = 1;
+  bool littleEndian = *reinterpret_cast<const char*>(&one) == 1;
+  if ((order == '<' && !littleEndian) || ((order == '>' || order == '!') && littleEndian)) {
+    PyBuffer_Release(&view);
+    PyErr_SetString(PyExc_TypeError, "MiniZinc: python_to_minizinc: buffer must be in native byte order");
+    return -1;
+  }
+  char f = format[0];
+  if (f == '\0' || format[1] != '\0' || strchr("bBhHiIlLqQnNfd?", f) == NULL) {
+    MZN_PYERR_SET_STRING(PyExc_TypeError, "MiniZinc: python_to_minizinc: unsupported buffer format '%s'", view.format);
+    PyBuffer_Release(&view);
+    return -1;
+  }
+  bool isFloat = (f == 'f' || f == 'd');
+  if ((isFloat && view.itemsize != sizeof(float) && view.itemsize != sizeof(double)) ||
+      (!isFloat && view.itemsize != 1 && view.itemsize != 2 && view.itemsize != 4 && view.itemsize != 8)) {
+    PyBuffer_Release(&view);
+    PyErr_SetString(PyExc_TypeError, "MiniZinc: python_to_minizinc: unsupported buffer item size");
+    return -1;
+  }
+
+  dimensions.clear();
+  if (view.ndim == 0)
+    dimensions.push_back(1);
+  for (int i=0; i<view.ndim; ++i)
+    dimensions.push_back(view.shape[i]);
+  Py_ssize_t n = view.len / view.itemsize;
+  elements.resize(n);
+  const char* p = static_cast<const char*>(view.buf);
+
+  if (f == '?') {
+    code = Type::BT_BOOL;
+    for (Py_ssize_t i=0; i<n; ++i, p += view.itemsize)
+      elements[i] = new BoolLit(Location(), *p != 0);
+  } else if (isFloat) {
+    code = Type::BT_FLOAT;
+    for (Py_ssize_t i=0; i<n; ++i, p += view.itemsize) {
+      double d = view.itemsize == sizeof(float) ? buffer_item<float>(p) : buffer_item<double>(p);
+      elements[i] = new FloatLit(Location(), d);
+    }
+  } else {
+    code = Type::BT_INT;
+    bool isSigned = (f >= 'a' && f <= 'z');
+    for (Py_ssize_t i=0; i<n; ++i, p += view.itemsize) {
+      long long c_val;
+      switch (view.itemsize) {
+        case 1: c_val = isSigned ? buffer_item<int8_t>(p) : buffer_item<uint8_t>(p); break;
+        case 2: c_val = isSigned ? buffer_item<int16_t>(p) : buffer_item<uint16_t>(p); break;
+        case 4: c_val = isSigned ? buffer_item<int32_t>(p) : buffer_item<uint32_t>(p); break;
+        default:
+          if (isSigned) {
+            c_val = buffer_item<int64_t>(p);
+          } else {
+            uint64_t u = buffer_item<uint64_t>(p);
+            if (u > static_cast<uint64_t>(LLONG_MAX)) {
+              PyBuffer_Release(&view);
+              PyErr_SetString(PyExc_OverflowError, "MiniZinc: Python integer value is larger than 2^63-1");
+              return -1;
+            }
+            c_val = static_cast<long long>(u);
+          }
+      }
+      elements[i] = IntLit::a(IntVal(c_val));
+    }
+  }
+  PyBuffer_Release(&view);
+  return 0;
+}
+
+
 Expression*
 python_to_minizinc(PyObject* pvalue, const ASTExprVec<TypeInst>& ranges)
 {
+  bool isBuffer = false;
   if (PyObject_TypeCheck(pvalue, &MznObject_Type)) {
     return MznObject_get_e(reinterpret_cast<MznObject*>(pvalue));
-  } else if (PyList_Check(pvalue)) {
+  } else if (PyList_Check(pvalue) || (isBuffer = is_minizinc_buffer(pvalue))) {
     vector<Py_ssize_t> dimensions;
     vector<PyObject*> simpleArray;
-    if (getList(pvalue, dimensions, simpleArray, 0) == -1)
+    vector<Expression*> onedArray;
+    Type::BaseType code = Type::BT_UNKNOWN;
+    if (isBuffer) {
+      if (buffer_to_minizinc(pvalue, dimensions, onedArray, code) == -1)
+        return NULL;
+    } else if (getList(pvalue, dimensions, simpleArray, 0) == -1)
       // getList should already set the error string
       return NULL;
     if (ranges.size()!=dimensions.size()) {
@@ -288,7 +455,6 @@ python_to_minizinc(PyObject* pvalue, const ASTExprVec<TypeInst>& ranges)
       return NULL;
     }
     vector<Expression*> callArgument(dimensions.size()+1);
-    vector<Expression*> onedArray(simpleArray.size());
 
     stringstream buffer;
     buffer << "array" << dimensions.size() << "d";
@@ -303,13 +469,12 @@ python_to_minizinc(PyObject* pvalue, const ASTExprVec<TypeInst>& ranges)
         callArgument[i] = domain;
       }
     }
-    Type::BaseType code = Type::BT_UNKNOWN;
     for (int i=0; i!=simpleArray.size(); ++i) {
       PyObject* temp= simpleArray[i];
       Expression* rhs = one_dim_python_to_minizinc(temp, code);
       if (rhs == NULL)
         return NULL;
-      onedArray[i] = rhs;
+      onedArray.push_back(rhs);
     }
     callArgument[dimensions.size()] = new ArrayLit(Location(), onedArray);
     Expression* rhs = new Call(Location(), callName, callArgument);
@@ -326,13 +491,18 @@ Expression*
 python_to_minizinc(PyObject* pvalue, Type& returnType, vector<pair<int, int> >& dimList)
 {
   Type::BaseType code = Type::BT_UNKNOWN;
+  bool isBuffer = false;
   if (PyObject_TypeCheck(pvalue, &MznObject_Type)) {
     returnType = Type::parsetint();
     return MznObject_get_e(reinterpret_cast<MznObject*>(pvalue));
-  } else if (PyList_Check(pvalue)) {
+  } else if (PyList_Check(pvalue) || (isBuffer = is_minizinc_buffer(pvalue))) {
     vector<Py_ssize_t> dimensions;
     vector<PyObject*> simpleArray;
-    if (getList(pvalue, dimensions, simpleArray, 0) == -1) {
+    vector<Expression*> v;
+    if (isBuffer) {
+      if (buffer_to_minizinc(pvalue, dimensions, v, code) == -1)
+        return NULL;
+    } else if (getList(pvalue, dimensions, simpleArray, 0) == -1) {
       // getList should set error string already
       return NULL;
     }
@@ -351,7 +521,6 @@ python_to_minizinc(PyObject* pvalue, Type& returnType, vector<pair<int, int> >&
         }
       }
     }
-    vector<Expression*> v;
     for (int i=0; i!=simpleArray.size(); ++i) {
       PyObject* temp= simpleArray[i];
       Expression* rhs = one_dim_python_to_minizinc(temp, code);
@@ -32,6 +32,7 @@
 #include <unistd.h>
 #include <stdexcept>
 #include <limits.h>
+#include <stdint.h>
 
 #include <minizinc/model.hh>
 #include <minizinc/parser.hh>
@@ -98,6 +99,10 @@ inline PyObject* one_dim_minizinc_to_python(Expression* e, const Type& type);
 //Convert minizinc expression to python value, return a Python list if vd is an array
 PyObject* minizinc_to_python(VarDecl* vd);
 
+// Convert a minizinc array of int, float or bool to a contiguous minizinc.Array,
+// which exports its values through the buffer protocol
+PyObject* minizinc_to_buffer(VarDecl* vd);
+
 
 
 
@@ -143,6 +148,23 @@ inline Expression* one_dim_python_to_minizinc(PyObject* pvalue, Type::BaseType&
  */
 Expression* python_to_minizinc(PyObject* pvalue, const ASTExprVec<TypeInst>& ranges);
 
+/*
+ * Description: Reads an object that supports the buffer protocol, such as a
+ *              NumPy array or an array.array, of integers, floats or booleans
+ *              directly from its memory, without creating python values
+ * Parameters: dimensions - receives the size of each dimension
+ *             elements - receives the values as literals, in row-major order
+ *             code - receives the base type of the values
+ * Return: 0 if success, -1 if error occurred
+ * Note 1: The buffer must be C-contiguous (see numpy.ascontiguousarray)
+ * Note 2: Need an outer GCLock for this to work
+ */
+int buffer_to_minizinc(PyObject* pvalue, vector<Py_ssize_t>& dimensions,
+                       vector<Expression*>& elements, Type::BaseType& code);
+
+// Whether pvalue should be read as a buffer (strings and bytes are not)
+inline bool is_minizinc_buffer(PyObject* pvalue);
+
 
 
 
@@ -185,6 +207,7 @@ inline bool PyObject_ExactTypeCheck(PyObject* ob, PyTypeObject* type) {
 
 #include "Object.h"
 #include "Set.h"
+#include "Array.h"
 
 
 #endif
\ No newline at end of file
@@ -380,6 +380,11 @@ initminizinc_internal(void)
   Py_INCREF(&MznSet_Type);
   PyModule_AddObject(module, "Set", reinterpret_cast<PyObject*>(&MznSet_Type));
 
+  if (PyType_Ready(&MznArray_Type) < 0)
+    INITERROR;
+  Py_INCREF(&MznArray_Type);
+  PyModule_AddObject(module, "Array", reinterpret_cast<PyObject*>(&MznArray_Type));
+
   if (PyType_Ready(&MznVarSet_Type) < 0)
     INITERROR;
   Py_INCREF(&MznVarSet_Type);
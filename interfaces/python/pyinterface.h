@@ -20,6 +20,7 @@
 
 #include "global.cpp"
 #include "Set.cpp"
+#include "Array.cpp"
 #include "Model.cpp"
 #include "Solver.cpp"
 
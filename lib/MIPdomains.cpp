@@ -33,6 +33,10 @@
 //#include <ostream>
 
 #include <map>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <memory>
 
 
 /// TODOs
@@ -87,7 +91,8 @@ namespace MiniZinc {
 
   class MIPD {  
   public:
-    MIPD(Env* env, bool fV=false) : __env(env) { getEnv(); fVerbose=fV; }
+    MIPD(Env* env, bool fV=false, int nT=1)
+      : __env(env), nThreads(nT<1 ? 1 : nT) { getEnv(); fVerbose=fV; }
     static bool fVerbose;
     bool MIPdomains() {
       MIPD__stats[ N_POSTs__NSubintvMin ] = 1e100;
@@ -112,6 +117,8 @@ namespace MiniZinc {
     
     Env* __env=0;
     Env* getEnv() { MZN_MIPD__assert_hard(__env); return __env; }
+    /// Threads for the analysis phase of decomposeDomains()
+    int nThreads=1;
     
     typedef VarDecl* PVarDecl;
     
@@ -712,12 +719,17 @@ namespace MiniZinc {
         // it is a var with eq_encode, ||
         // an (integer if any) variable with the least rel. factor
       bool fRef1HasEqEncode=false;
+      /// Hashes a clique's var by its index in vVarDescr, so that the order
+      /// of the maps below does not depend on node addresses
+      struct VarDeclHash {
+        size_t operator()(VarDecl* vd) const { return static_cast<size_t>(vd->payload()); }
+      };
       /// This map stores the relations y = ax+b of all the clique's vars to y
-      typedef UNORDERED_NAMESPACE::unordered_map<VarDecl*, std::pair<double, double> >
+      typedef UNORDERED_NAMESPACE::unordered_map<VarDecl*, std::pair<double, double>, VarDeclHash >
         TMapVars;
       TMapVars mRef0, mRef1;   // to the main var 0, 1
       
-      class TMatrixVars : public UNORDERED_NAMESPACE::unordered_map<VarDecl*, TMapVars> {
+      class TMatrixVars : public UNORDERED_NAMESPACE::unordered_map<VarDecl*, TMapVars, VarDeclHash> {
       public:
         /// Check existing connection
         template <class IVarDecl>
@@ -750,6 +762,8 @@ namespace MiniZinc {
       class LinEqGraph : public TMatrixVars {
       public:
         static double dCoefMin, dCoefMax;
+        /// Coefficient range of this graph, merged into the above on commit
+        double dCoefMinLocal=+1e100, dCoefMaxLocal=-1e100;
         /// Stores the arc (x1, x2) as x1 = a*x2 + b
         /// so that a constraint on x2, say x2<=c <-> f,
         /// is equivalent to one for x1:  x1 <=/>= a*c+b <-> f
@@ -770,10 +784,10 @@ namespace MiniZinc {
           checkExistingArc(begV, negBA, CA);
           (*this)[*begV][*(begV+1)] = std::make_pair(negBA, CA);
           const double dCoefAbs = std::fabs( negBA );
-          if ( dCoefAbs<dCoefMin )
-            dCoefMin = dCoefAbs;
-          if ( dCoefAbs>dCoefMax )
-            dCoefMax = dCoefAbs;
+          if ( dCoefAbs<dCoefMinLocal )
+            dCoefMinLocal = dCoefAbs;
+          if ( dCoefAbs>dCoefMaxLocal )
+            dCoefMaxLocal = dCoefAbs;
         }
         void addEdge(const LinEq2Vars& led) {
           addArc( led.coefs.begin(), led.vd.begin(), led.rhs );
@@ -868,11 +882,22 @@ namespace MiniZinc {
       const int iVarStart;
       TCliqueSorter cls;
       SetOfIntvReal sDomain;
+      /// Where analyse() counts; a thread-local vector in parallel mode
+      std::vector<double>* pStats = &MIPD__stats;
       
       DomainDecomp(MIPD* pm, int iv) : mipd(*pm), iVarStart(iv), cls(pm, iv)  {
         sDomain.insert(IntvReal());   // the decomposed domain. Init to +-inf
       }
       void doProcess() {
+        analyse();
+        commit();
+      }
+      
+      /// Relate the clique && build the domain decomposition.
+      /// Only reads the model, so can run in a worker thread
+      /// once the clique's sets are in mipd.mSetCache
+      void analyse() {
+        std::vector<double>& stats = *pStats;
         // Choose the main variable && relate all others to it
         const int nClique =  mipd.vVarDescr[iVarStart].nClique;
         if ( nClique >= 0 ) {
@@ -904,6 +929,31 @@ namespace MiniZinc {
         MZN_MIPD__assert_hard( sDomain.checkFiniteBounds() );
         MZN_MIPD__assert_hard( sDomain.checkDisjunctStrict() );
         
+        // Statistics
+        if ( sDomain.size() < stats[ N_POSTs__NSubintvMin ] )
+          stats[ N_POSTs__NSubintvMin ] = sDomain.size();
+        stats[ N_POSTs__NSubintvSum ] += sDomain.size();
+        if ( sDomain.size() > stats[ N_POSTs__NSubintvMax ] )
+          stats[ N_POSTs__NSubintvMax ] = sDomain.size();
+        for ( auto& intv : sDomain ) {
+          const auto nSubSize = intv.right - intv.left;          
+          if ( nSubSize < stats[ N_POSTs__SubSizeMin ] )
+            stats[ N_POSTs__SubSizeMin ] = nSubSize;
+          stats[ N_POSTs__SubSizeSum ] += nSubSize;
+          if ( nSubSize > stats[ N_POSTs__SubSizeMax ] )
+            stats[ N_POSTs__SubSizeMax ] = nSubSize;
+        }
+        if ( cls.fRef1HasEqEncode )
+          ++stats[ N_POSTs__cliquesWithEqEncode ];
+      }
+      
+      /// Add the new variables && constraints to the flat model
+      void commit() {
+        if ( cls.leg.dCoefMinLocal < TCliqueSorter::LinEqGraph::dCoefMin )
+          TCliqueSorter::LinEqGraph::dCoefMin = cls.leg.dCoefMinLocal;
+        if ( cls.leg.dCoefMaxLocal > TCliqueSorter::LinEqGraph::dCoefMax )
+          TCliqueSorter::LinEqGraph::dCoefMax = cls.leg.dCoefMaxLocal;
+        
         makeRangeDomains();
         
         // Then, use equality_encoding if available
@@ -915,29 +965,13 @@ namespace MiniZinc {
             createDomainFlags();
         }
         implement__POSTs();
-        
-        // Statistics
-        if ( sDomain.size() < MIPD__stats[ N_POSTs__NSubintvMin ] )
-          MIPD__stats[ N_POSTs__NSubintvMin ] = sDomain.size();
-        MIPD__stats[ N_POSTs__NSubintvSum ] += sDomain.size();
-        if ( sDomain.size() > MIPD__stats[ N_POSTs__NSubintvMax ] )
-          MIPD__stats[ N_POSTs__NSubintvMax ] = sDomain.size();
-        for ( auto& intv : sDomain ) {
-          const auto nSubSize = intv.right - intv.left;          
-          if ( nSubSize < MIPD__stats[ N_POSTs__SubSizeMin ] )
-            MIPD__stats[ N_POSTs__SubSizeMin ] = nSubSize;
-          MIPD__stats[ N_POSTs__SubSizeSum ] += nSubSize;
-          if ( nSubSize > MIPD__stats[ N_POSTs__SubSizeMax ] )
-            MIPD__stats[ N_POSTs__SubSizeMax ] = nSubSize;
-        }
-        if ( cls.fRef1HasEqEncode )
-          ++MIPD__stats[ N_POSTs__cliquesWithEqEncode ];
       }
       
       /// Project the domain-related constraints of a variable into the clique
       /// Deltas should be scaled but to a minimum of the target's discr
       /// COmparison sense changes on negated vars
       void projectVariableConstr( VarDecl* vd, std::pair<double, double> eq1 ) {
+        std::vector<double>& stats = *pStats;
         DBGOUT_MIPD__( "  MIPD: projecting variable  " );
         DBGOUT_MIPD_SELF( debugprint(vd) );
         // Always check if domain becomes empty?         TODO
@@ -998,11 +1032,11 @@ namespace MiniZinc {
               convertIntSet( pCall->args()[1], SS, cls.varRef1, A, B );
               if ( RIT_Static == dct.nReifType ) {
                 sDomain.intersect(SS);
-                ++MIPD__stats[ N_POSTs__setIn ];
+                ++stats[ N_POSTs__setIn ];
               }
               else {
                 sDomain.cutDeltas(SS, std::max( 1.0, std::fabs( A ) ) );      // deltas to scale
-                ++MIPD__stats[ N_POSTs__setInReif ];
+                ++stats[ N_POSTs__setInReif ];
               }
             }
               break;
@@ -1038,7 +1072,7 @@ namespace MiniZinc {
                   default:
                     MZN_MIPD__assert_hard_msg( 0, " No other reified cmp type " );
                 }
-                ++MIPD__stats[ ( vd->ti()->type().isint() ) ?
+                ++stats[ ( vd->ti()->type().isint() ) ?
                   N_POSTs__intCmpReif : N_POSTs__floatCmpReif ];
               } else if ( RIT_Static == dct.nReifType ) {
                   // _ne, later maybe static ineq                                 TODO
@@ -1051,11 +1085,11 @@ namespace MiniZinc {
                   const double delta = computeDelta( cls.varRef1, vd, bnds, A, pCall, 2 );
                   sDomain.cutOut( { rhsRnd-delta, rhsRnd+delta } );
                 }
-                ++MIPD__stats[ ( vd->ti()->type().isint() ) ?
+                ++stats[ ( vd->ti()->type().isint() ) ?
                   N_POSTs__intNE : N_POSTs__floatNE ];
               } else {  // aux_ relate to 0.0
                         // But we don't modify domain splitting for them currently
-                ++MIPD__stats[ ( vd->ti()->type().isint() ) ?
+                ++stats[ ( vd->ti()->type().isint() ) ?
                   N_POSTs__intAux : N_POSTs__floatAux ];
                 MZN_MIPD__assert_hard ( RIT_Halfreif==dct.nReifType );
 //                 const double rhs = B;               // + A*0
@@ -1064,7 +1098,7 @@ namespace MiniZinc {
               break;
             case CT_Encode:
               // See if any further constraints here?                             TODO
-              ++MIPD__stats[ N_POSTs__eq_encode ];
+              ++stats[ N_POSTs__eq_encode ];
               break;
             default:
               MZN_MIPD__assert_hard_msg( 0, "Unknown constraint type" );
@@ -1549,7 +1583,7 @@ namespace MiniZinc {
                           double A, double B ) {
         MZN_MIPD__assert_hard( A != 0.0 );
         if (e->type().isintset()) {
-          IntSetVal* S = eval_intset( mipd.getEnv()->envi(), e );
+          IntSetVal* S = mipd.evalIntSet( e );
           IntSetRanges domr(S);
           for (; domr(); ++domr) {                          // * A + B
             IntVal mmin = domr.min();
@@ -1565,7 +1599,7 @@ namespace MiniZinc {
           }
         } else {
           assert(e->type().isfloatset());
-          FloatSetVal* S = eval_floatset( mipd.getEnv()->envi(), e );
+          FloatSetVal* S = mipd.evalFloatSet( e );
           FloatSetRanges domr(S);
           for (; domr(); ++domr) {                          // * A + B
             FloatVal mmin = domr.min();
@@ -1612,6 +1646,9 @@ namespace MiniZinc {
 //         TClique& clq = aCliques[iClq];
 //       }
       bool fRetTrue = true;
+      if ( nThreads > 1 )
+        fRetTrue = decomposeDomainsParallel();
+      else
       for ( int iVar=0; iVar<vVarDescr.size(); ++iVar ) {
 //         VarDescr& var = vVarDescr[iVar];
         if ( ! vVarDescr[iVar].fDomainConstrProcessed ) {
@@ -1634,6 +1671,9 @@ namespace MiniZinc {
         }
       }
       // Clean up __POSTs:
+      fCacheSets = false;
+      mIntSetCache.clear();
+      mFloatSetCache.clear();
       for ( auto& vVar: vVarDescr ) {
         for ( auto pCallI : vVar.aCalls )
           pCallI->remove();
@@ -1643,6 +1683,134 @@ namespace MiniZinc {
       return fRetTrue;
     }
       
+    /// Decomposition with the analysis of the cliques spread over nThreads.
+    /// The workers only read the model: all sets they need are evaluated
+    /// beforehand && the GC is locked throughout. New variables && constraints
+    /// are added afterwards in this thread, in the order of the sequential run
+    bool decomposeDomainsParallel() {
+      GCLock lock;
+      fCacheSets = true;
+      // One task per clique, started from its first variable, as in the sequential loop
+      std::vector<std::unique_ptr<DomainDecomp> > aTasks;
+      std::vector<bool> fCliqueTaken( aCliques.size(), false );
+      for ( int iVar=0; iVar<vVarDescr.size(); ++iVar ) {
+        const int nClique = vVarDescr[iVar].nClique;
+        if ( vVarDescr[iVar].fDomainConstrProcessed )
+          continue;
+        if ( nClique >= 0 ) {
+          if ( fCliqueTaken[nClique] )
+            continue;
+          fCliqueTaken[nClique] = true;
+        }
+        aTasks.emplace_back( new DomainDecomp(this, iVar) );
+      }
+      cacheDomainSets();
+      
+      const int nWorkers = std::max( 1, std::min( nThreads, (int)aTasks.size() ) );
+      std::vector<std::vector<double> > aStats( nWorkers, std::vector<double>( N_POSTs__size ) );
+      std::vector<std::exception_ptr> aErrors( aTasks.size() );
+      std::atomic<size_t> iNext( 0 );
+      auto worker = [&]( int iW ) {
+        std::vector<double>& stats = aStats[iW];
+        stats[ N_POSTs__NSubintvMin ] = 1e100;
+        stats[ N_POSTs__SubSizeMin ] = 1e100;
+        for ( size_t iT; (iT = iNext++) < aTasks.size(); ) {
+          try {
+            aTasks[iT]->pStats = &stats;
+            aTasks[iT]->analyse();
+          } catch ( ... ) {
+            aErrors[iT] = std::current_exception();
+          }
+        }
+      };
+      std::vector<std::thread> aThreads;
+      fCacheReadOnly = true;
+      for ( int iW=1; iW<nWorkers; ++iW )
+        aThreads.emplace_back( worker, iW );
+      worker( 0 );
+      for ( auto& th : aThreads )
+        th.join();
+      fCacheReadOnly = false;
+      
+      for ( auto& stats : aStats )
+        for ( int i=0; i<N_POSTs__size; ++i ) {
+          if ( N_POSTs__NSubintvMin==i || N_POSTs__SubSizeMin==i )
+            MIPD__stats[i] = std::min( MIPD__stats[i], stats[i] );
+          else if ( N_POSTs__NSubintvMax==i || N_POSTs__SubSizeMax==i )
+            MIPD__stats[i] = std::max( MIPD__stats[i], stats[i] );
+          else
+            MIPD__stats[i] += stats[i];
+        }
+      
+      for ( size_t iT=0; iT<aTasks.size(); ++iT ) {
+        try {
+          if ( aErrors[iT] )
+            std::rethrow_exception( aErrors[iT] );
+          aTasks[iT]->commit();
+          vVarDescr[ aTasks[iT]->iVarStart ].fDomainConstrProcessed = true;
+        } catch (const MIPD_Infeasibility_Exception& exc) {
+          std::cerr << "  INFEASIBILITY: " << exc.msg << std::endl;
+          return false;
+        }
+      }
+      return true;
+    }
+    
+    /// Evaluate the domains && set_in sets used by DomainDecomp::analyse()
+    void cacheDomainSets() {
+      for ( auto& vard : vVarDescr ) {
+        if ( Expression* dom = vard.vd->ti()->domain() )
+          if ( vard.vd->type().isint() || vard.vd->type().isfloat() ) {
+            if ( dom->type().isintset() )
+              evalIntSet( dom );
+            else
+              evalFloatSet( dom );
+          }
+        for ( auto pCI : vard.aCalls ) {
+          Call* pCall = pCI->e()->dyn_cast<Call>();
+          MZN_MIPD__assert_hard( pCall );
+          auto ipct = mCallTypes.find( pCall->decl() );
+          MZN_MIPD__assert_hard( mCallTypes.end() != ipct );
+          if ( CT_SetIn == ipct->second->nConstrType ) {
+            if ( pCall->args()[1]->type().isintset() )
+              evalIntSet( pCall->args()[1] );
+            else
+              evalFloatSet( pCall->args()[1] );
+          }
+        }
+      }
+    }
+    
+    /// Evaluated sets. Filled before the parallel phase, only read by the workers.
+    /// Only valid while the GC is locked
+    bool fCacheSets=false;
+    /// Set while the workers run: the cache is shared, so a miss must not insert
+    bool fCacheReadOnly=false;
+    UNORDERED_NAMESPACE::unordered_map<Expression*, IntSetVal*> mIntSetCache;
+    UNORDERED_NAMESPACE::unordered_map<Expression*, FloatSetVal*> mFloatSetCache;
+    
+    IntSetVal* evalIntSet(Expression* e) {
+      auto it = mIntSetCache.find( e );
+      if ( mIntSetCache.end() != it )
+        return it->second;
+      MZN_MIPD__assert_hard_msg( !fCacheReadOnly, "Set not evaluated before the parallel decomposition" );
+      IntSetVal* S = eval_intset( getEnv()->envi(), e );
+      if ( fCacheSets )
+        mIntSetCache[ e ] = S;
+      return S;
+    }
+    
+    FloatSetVal* evalFloatSet(Expression* e) {
+      auto it = mFloatSetCache.find( e );
+      if ( mFloatSetCache.end() != it )
+        return it->second;
+      MZN_MIPD__assert_hard_msg( !fCacheReadOnly, "Set not evaluated before the parallel decomposition" );
+      FloatSetVal* S = eval_floatset( getEnv()->envi(), e );
+      if ( fCacheSets )
+        mFloatSetCache[ e ] = S;
+      return S;
+    }
+      
     VarDecl* expr2VarDecl(Expression* arg) {
       
       // The requirement to have actual variable objects
@@ -1912,8 +2080,8 @@ namespace MiniZinc {
   
   bool MIPD::fVerbose = false;
 
-  void MIPdomains(Env& env, bool fVerbose) {
-    MIPD mipd( &env, fVerbose );
+  void MIPdomains(Env& env, bool fVerbose, int nThreads) {
+    MIPD mipd( &env, fVerbose, nThreads );
     if ( ! mipd.MIPdomains() ) {
       GCLock lock;
       env.envi().fail();
@@ -9,6 +9,7 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <minizinc/config.hh>
 #include <minizinc/ast.hh>
 #include <minizinc/hash.hh>
 #include <minizinc/astexception.hh>
@@ -18,6 +19,9 @@
 
 #include <minizinc/prettyprinter.hh>
 
+#include <unordered_set>
+#include <mutex>
+
 namespace MiniZinc {
 
   Location Location::nonalloc;
@@ -31,7 +35,8 @@ namespace MiniZinc {
     first_column(0),
     last_line(0),
     last_column(0),
-    is_introduced(0) {}
+    is_introduced(0),
+    _lid(0) {}
 
   std::string
   Location::toString(void) const {
@@ -52,6 +57,230 @@ namespace MiniZinc {
     return l;
   }
 
+  Location* LocationTable::_chunks[LocationTable::maxChunks];
+
+  namespace {
+    /// Marks a missing sibling in the location table
+    const unsigned int noSibling = ~0u;
+    /// Part of the location table only needed for adding entries
+    struct LocationTableState {
+      std::mutex mtx;
+      /// Number of entries
+      unsigned int size;
+      /// Id of the last entry added
+      unsigned int last;
+      /// Index of the next chunk to start
+      unsigned int nextChunk;
+      /// Number of GC heaps
+      unsigned int nHeaps;
+      /// For each entry, the entry that only differs in the introduced flag
+      std::vector<std::vector<unsigned int> > sibling;
+      /// The different file names of all entries
+      std::vector<ASTString> files;
+      std::unordered_set<ASTStringO*> fileSet;
+      LocationTableState(void) : size(0), last(0), nextChunk(0), nHeaps(0) {}
+    };
+    LocationTableState& locationTable(void) {
+      static LocationTableState t;
+      return t;
+    }
+    /// Id of the entry the calling thread interned last
+    unsigned int& lastInterned(void) {
+#if defined(HAS_DECLSPEC_THREAD)
+      __declspec (thread) static unsigned int last = 0;
+#elif defined(HAS_ATTR_THREAD)
+      static __thread unsigned int last = 0;
+#else
+#error Need thread-local storage
+#endif
+      return last;
+    }
+    /// Whether \a l0 and \a l1 are equal except for the introduced flag
+    bool sameSource(const Location& l0, const Location& l1) {
+      return l0.filename.aststr()==l1.filename.aststr() &&
+        l0.first_line==l1.first_line && l0.first_column==l1.first_column &&
+        l0.last_line==l1.last_line && l0.last_column==l1.last_column;
+    }
+  }
+
+  unsigned int
+  LocationTable::add(const Location& l) {
+    LocationTableState& t = locationTable();
+    unsigned int id = t.last+1;
+    if (t.size==0 || (id & chunkMask)==0) {
+      /// The last chunk is full, start a new one. The slots of released
+      /// chunks are not reused, so that ids found in old locations never
+      /// refer to an entry that is being written
+      unsigned int c = t.nextChunk;
+      if (c >= maxChunks)
+        throw InternalError("too many different locations");
+      t.nextChunk++;
+      _chunks[c] = new Location[chunkMask+1];
+      if (t.sibling.size() <= c)
+        t.sibling.resize(c+1);
+      t.sibling[c].assign(chunkMask+1, noSibling);
+      id = c << chunkBits;
+    }
+    Location& e = _chunks[id >> chunkBits][id & chunkMask];
+    e = l;
+    e._lid = id;
+    if (l.filename.aststr() && t.fileSet.insert(l.filename.aststr()).second)
+      t.files.push_back(l.filename);
+    t.size++;
+    t.last = id;
+    return id;
+  }
+
+  bool
+  LocationTable::isEntry(unsigned int id, const Location& l) {
+    Location* c = _chunks[id >> chunkBits];
+    if (c==NULL)
+      return false;
+    const Location& e = c[id & chunkMask];
+    return e._lid==id && e.is_introduced==l.is_introduced && sameSource(e, l);
+  }
+
+  unsigned int
+  LocationTable::intern(const Location& l) {
+    /// Most locations are copies of an entry, many others repeat the last
+    /// one of this thread. Both are found without the lock: entries do not
+    /// change once their id is known, and their chunks are only released
+    /// while a single thread has a heap
+    unsigned int& lastId = lastInterned();
+    if (isEntry(l._lid, l)) {
+      lastId = l._lid;
+      return lastId;
+    }
+    if (isEntry(lastId, l))
+      return lastId;
+    LocationTableState& t = locationTable();
+    std::lock_guard<std::mutex> lock(t.mtx);
+    lastId = internLocked(l);
+    return lastId;
+  }
+
+  unsigned int
+  LocationTable::internLocked(const Location& l) {
+    LocationTableState& t = locationTable();
+    if (t.size==0) {
+      /// Entries 0 and 1 are the empty location and its introduced version
+      add(Location());
+      add(Location().introduce());
+      t.sibling[0][0] = 1;
+      t.sibling[0][1] = 0;
+    }
+    /// Most locations are copies of an entry, or its introduced version.
+    /// The id of a copy may refer to a released chunk
+    unsigned int c = l._lid >> chunkBits;
+    if (c < maxChunks && _chunks[c]!=NULL && get(l._lid)._lid==l._lid) {
+      const Location& e = get(l._lid);
+      if (sameSource(e, l)) {
+        if (e.is_introduced==l.is_introduced)
+          return l._lid;
+        unsigned int s = t.sibling[c][l._lid & chunkMask];
+        if (s!=noSibling && _chunks[s >> chunkBits]!=NULL && get(s)._lid==s &&
+            sameSource(get(s), l) && get(s).is_introduced==l.is_introduced)
+          return s;
+        unsigned int ns = add(l);
+        t.sibling[c][l._lid & chunkMask] = ns;
+        t.sibling[ns >> chunkBits][ns & chunkMask] = l._lid;
+        return ns;
+      }
+    }
+    /// Locations built by the parser usually repeat the last one
+    const Location& last = get(t.last);
+    if (sameSource(last, l) && last.is_introduced==l.is_introduced)
+      return t.last;
+    return add(l);
+  }
+
+  unsigned int
+  LocationTable::size(void) {
+    LocationTableState& t = locationTable();
+    std::lock_guard<std::mutex> lock(t.mtx);
+    return t.size;
+  }
+
+  void
+  LocationTable::mark(void) {
+    LocationTableState& t = locationTable();
+    std::lock_guard<std::mutex> lock(t.mtx);
+    for (unsigned int i=0; i<t.files.size(); i++)
+      t.files[i].mark();
+  }
+
+  std::vector<ASTString>
+  LocationTable::files(void) {
+    LocationTableState& t = locationTable();
+    std::lock_guard<std::mutex> lock(t.mtx);
+    return t.files;
+  }
+
+  void
+  LocationTable::used(const Expression* e, std::vector<bool>& live) {
+    unsigned int c = e->_lid >> chunkBits;
+    if (c >= live.size())
+      live.resize(c+1);
+    live[c] = true;
+  }
+
+  void
+  LocationTable::used(const Item* i, std::vector<bool>& live) {
+    unsigned int c = i->_lid >> chunkBits;
+    if (c >= live.size())
+      live.resize(c+1);
+    live[c] = true;
+  }
+
+  void
+  LocationTable::release(const std::vector<bool>& live) {
+    LocationTableState& t = locationTable();
+    std::lock_guard<std::mutex> lock(t.mtx);
+    if (t.nHeaps > 1)
+      return;
+    /// Chunk 0 holds the empty locations, the last chunk is being filled
+    bool released = false;
+    for (unsigned int c=1; c<t.sibling.size(); c++) {
+      if (_chunks[c]!=NULL && !(c < live.size() && live[c]) && c != (t.last >> chunkBits)) {
+        delete[] _chunks[c];
+        _chunks[c] = NULL;
+        std::vector<unsigned int>().swap(t.sibling[c]);
+        t.size -= chunkMask+1;
+        released = true;
+      }
+    }
+    if (!released)
+      return;
+    /// Only keep the file names of the remaining entries alive
+    t.files.clear();
+    t.fileSet.clear();
+    for (unsigned int c=0; c<t.sibling.size(); c++) {
+      if (_chunks[c]==NULL)
+        continue;
+      unsigned int n = c==(t.last >> chunkBits) ? (t.last & chunkMask)+1 : chunkMask+1;
+      for (unsigned int j=0; j<n; j++) {
+        const Location& e = _chunks[c][j];
+        if (e.filename.aststr() && t.fileSet.insert(e.filename.aststr()).second)
+          t.files.push_back(e.filename);
+      }
+    }
+  }
+
+  void
+  LocationTable::addHeap(void) {
+    LocationTableState& t = locationTable();
+    std::lock_guard<std::mutex> lock(t.mtx);
+    t.nHeaps++;
+  }
+
+  void
+  LocationTable::removeHeap(void) {
+    LocationTableState& t = locationTable();
+    std::lock_guard<std::mutex> lock(t.mtx);
+    assert(t.nHeaps > 0);
+    t.nHeaps--;
+  }
+
   void
   Expression::addAnnotation(Expression* ann) {
     if (!isUnboxedInt())
@@ -79,7 +308,6 @@ namespace MiniZinc {
       const Expression* cur = stack.back(); stack.pop_back();
       if (!cur->isUnboxedInt() && cur->_gc_mark==0) {
         cur->_gc_mark = 1;
-        cur->loc().mark();
         pushann(cur->ann());
         switch (cur->eid()) {
         case Expression::E_INTLIT:
@@ -80,6 +80,18 @@ namespace MiniZinc {
     }
   }
 
+  /// Values of \a al if all its elements are finite integer literals
+  static bool int_lit_values(ArrayLit* al, std::vector<long long int>& vals) {
+    vals.resize(al->v().size());
+    for (unsigned int i=0; i<al->v().size(); i++) {
+      IntLit* il = al->v()[i]->dyn_cast<IntLit>();
+      if (il==NULL || !il->v().isFinite())
+        return false;
+      vals[i] = il->v().toInt();
+    }
+    return true;
+  }
+
   IntVal b_int_min(EnvI& env, Call* call) {
     ASTExprVec<Expression> args = call->args();
     switch (args.size()) {
@@ -91,6 +103,9 @@ namespace MiniZinc {
         ArrayLit* al = eval_array_lit(env,args[0]);
         if (al->v().size()==0)
           throw ResultUndefinedError(env, al->loc(), "minimum of empty array is undefined");
+        std::vector<long long int> vals;
+        if (int_lit_values(al, vals))
+          return int_array_min(vals.data(), vals.size());
         IntVal m = eval_int(env,al->v()[0]);
         for (unsigned int i=1; i<al->v().size(); i++)
           m = std::min(m, eval_int(env,al->v()[i]));
@@ -116,6 +131,9 @@ namespace MiniZinc {
         ArrayLit* al = eval_array_lit(env,args[0]);
         if (al->v().size()==0)
           throw ResultUndefinedError(env, al->loc(), "maximum of empty array is undefined");
+        std::vector<long long int> vals;
+        if (int_lit_values(al, vals))
+          return int_array_max(vals.data(), vals.size());
         IntVal m = eval_int(env,al->v()[0]);
         for (unsigned int i=1; i<al->v().size(); i++)
           m = std::max(m, eval_int(env,al->v()[i]));
@@ -414,6 +432,9 @@ namespace MiniZinc {
     ArrayLit* al = eval_array_lit(env,args[0]);
     if (al->v().size()==0)
       return 0;
+    std::vector<long long int> vals;
+    if (int_lit_values(al, vals))
+      return int_array_sum(vals.data(), vals.size());
     IntVal m = 0;
     for (unsigned int i=0; i<al->v().size(); i++)
       m += eval_int(env,al->v()[i]);
@@ -780,10 +801,7 @@ namespace MiniZinc {
       throw EvalError(env, Location(), "upper bound of empty array undefined");
     IntSetVal* ub = b_ub_set(env,al->v()[0]);
     for (unsigned int i=1; i<al->v().size(); i++) {
-      IntSetRanges isr(ub);
-      IntSetRanges r(b_ub_set(env,al->v()[i]));
-      Ranges::Union<IntVal,IntSetRanges,IntSetRanges> u(isr,r);
-      ub = IntSetVal::ai(u);
+      ub = IntSetVal::unite(ub,b_ub_set(env,al->v()[i]));
     }
     return ub;
   }
@@ -920,10 +938,7 @@ namespace MiniZinc {
       return IntSetVal::a();
     IntSetVal* isv = b_dom_varint(env,al->v()[0]);
     for (unsigned int i=1; i<al->v().size(); i++) {
-      IntSetRanges isr(isv);
-      IntSetRanges r(b_dom_varint(env,al->v()[i]));
-      Ranges::Union<IntVal,IntSetRanges,IntSetRanges> u(isr,r);
-      isv = IntSetVal::ai(u);
+      isv = IntSetVal::unite(isv,b_dom_varint(env,al->v()[i]));
     }
     return isv;
   }
@@ -1649,10 +1664,7 @@ namespace MiniZinc {
       return IntSetVal::a();
     IntSetVal* isv = eval_intset(env,al->v()[0]);
     for (unsigned int i=0; i<al->v().size(); i++) {
-      IntSetRanges i0(isv);
-      IntSetRanges i1(eval_intset(env,al->v()[i]));
-      Ranges::Union<IntVal,IntSetRanges, IntSetRanges> u(i0,i1);
-      isv = IntSetVal::ai(u);
+      isv = IntSetVal::unite(isv,eval_intset(env,al->v()[i]));
     }
     return isv;
   }
@@ -171,9 +171,7 @@ namespace MiniZinc {
           } else {
             for (unsigned int i=0; i<v->v().size(); i++) {
               IntSetVal* iv = eval_intset(env, v->v()[i]);
-              IntSetRanges isv_r(isv);
-              IntSetRanges v_r(iv);
-              if (!Ranges::subset(v_r, isv_r)) {
+              if (!IntSetVal::subset(iv, isv)) {
                 std::ostringstream oss;
                 oss << "array contains value " << *iv << " which is not a subset of " << *isv;
                 throw ResultUndefinedError(env, fi->e()->loc(), "function result violates function type-inst, "+oss.str());
@@ -218,9 +216,7 @@ namespace MiniZinc {
     static void checkRetVal(EnvI& env, Val v, FunctionI* fi) {
       if (fi->ti()->domain() && !fi->ti()->domain()->isa<TIId>()) {
         IntSetVal* isv = eval_intset(env, fi->ti()->domain());
-        IntSetRanges isv_r(isv);
-        IntSetRanges v_r(v);
-        if (!Ranges::subset(v_r, isv_r)) {
+        if (!IntSetVal::subset(v, isv)) {
           throw ResultUndefinedError(env, Location().introduce(), "function result violates function type-inst");
         }
       }
@@ -316,9 +312,7 @@ namespace MiniZinc {
     if (!e->type().isopt()) {
       if (e->type().isintset()) {
           IntSetVal* ev = eval_intset(env, e);
-          IntSetRanges ev_r(ev);
-          IntSetRanges dom_r(dom);
-          oob = !Ranges::subset(ev_r, dom_r);
+          oob = !IntSetVal::subset(ev, dom);
       } else {
         oob = !dom->contains(eval_int(env,e));
       }
@@ -614,33 +608,11 @@ namespace MiniZinc {
         if (lhs->type().isintset() && rhs->type().isintset()) {
           IntSetVal* v0 = eval_intset(env,lhs);
           IntSetVal* v1 = eval_intset(env,rhs);
-          IntSetRanges ir0(v0);
-          IntSetRanges ir1(v1);
           switch (bo->op()) {
-          case BOT_UNION:
-            {
-              Ranges::Union<IntVal,IntSetRanges,IntSetRanges> u(ir0,ir1);
-              return IntSetVal::ai(u);
-            }
-          case BOT_DIFF:
-            {
-              Ranges::Diff<IntVal,IntSetRanges,IntSetRanges> u(ir0,ir1);
-              return IntSetVal::ai(u);
-            }
-          case BOT_SYMDIFF:
-            {
-              Ranges::Union<IntVal,IntSetRanges,IntSetRanges> u(ir0,ir1);
-              Ranges::Inter<IntVal,IntSetRanges,IntSetRanges> i(ir0,ir1);
-              Ranges::Diff<IntVal,
-                           Ranges::Union<IntVal,IntSetRanges,IntSetRanges>,
-                           Ranges::Inter<IntVal,IntSetRanges,IntSetRanges>> sd(u,i);
-              return IntSetVal::ai(sd);
-            }
-          case BOT_INTERSECT:
-            {
-              Ranges::Inter<IntVal,IntSetRanges,IntSetRanges> u(ir0,ir1);
-              return IntSetVal::ai(u);
-            }
+          case BOT_UNION: return IntSetVal::unite(v0,v1);
+          case BOT_DIFF: return IntSetVal::diff(v0,v1);
+          case BOT_SYMDIFF: return IntSetVal::symdiff(v0,v1);
+          case BOT_INTERSECT: return IntSetVal::intersect(v0,v1);
           default: throw EvalError(env, e->loc(),"not a set of int expression", bo->opToString());
           }
         } else if (lhs->type().isint() && rhs->type().isint()) {
@@ -969,10 +941,10 @@ namespace MiniZinc {
               case BOT_LQ: return Ranges::lessEq(ir0,ir1);
               case BOT_GR: return Ranges::less(ir1,ir0);
               case BOT_GQ: return Ranges::lessEq(ir1,ir0);
-              case BOT_EQ: return Ranges::equal(ir0,ir1);
-              case BOT_NQ: return !Ranges::equal(ir0,ir1);
-              case BOT_SUBSET: return Ranges::subset(ir0,ir1);
-              case BOT_SUPERSET: return Ranges::subset(ir1,ir0);
+              case BOT_EQ: return v0->equal(v1);
+              case BOT_NQ: return !v0->equal(v1);
+              case BOT_SUBSET: return IntSetVal::subset(v0,v1);
+              case BOT_SUPERSET: return IntSetVal::subset(v1,v0);
               default:
                 throw EvalError(env, e->loc(),"not a bool expression", bo->opToString());
               }
@@ -1139,32 +1111,11 @@ namespace MiniZinc {
         if (lhs->type().isintset() && rhs->type().isintset()) {
           IntSetVal* v0 = eval_boolset(env,lhs);
           IntSetVal* v1 = eval_boolset(env,rhs);
-          IntSetRanges ir0(v0);
-          IntSetRanges ir1(v1);
           switch (bo->op()) {
-            case BOT_UNION:
-            {
-              Ranges::Union<IntVal,IntSetRanges,IntSetRanges> u(ir0,ir1);
-              return IntSetVal::ai(u);
-            }
-            case BOT_DIFF:
-            {
-              Ranges::Diff<IntVal,IntSetRanges,IntSetRanges> u(ir0,ir1);
-              return IntSetVal::ai(u);
-            }
-            case BOT_SYMDIFF:
-            {
-              Ranges::Union<IntVal,IntSetRanges,IntSetRanges> u(ir0,ir1);
-              Ranges::Inter<IntVal,IntSetRanges,IntSetRanges> i(ir0,ir1);
-              Ranges::Diff<IntVal,Ranges::Union<IntVal,IntSetRanges,IntSetRanges>,
-              Ranges::Inter<IntVal,IntSetRanges,IntSetRanges>> sd(u,i);
-              return IntSetVal::ai(sd);
-            }
-            case BOT_INTERSECT:
-            {
-              Ranges::Inter<IntVal,IntSetRanges,IntSetRanges> u(ir0,ir1);
-              return IntSetVal::ai(u);
-            }
+            case BOT_UNION: return IntSetVal::unite(v0,v1);
+            case BOT_DIFF: return IntSetVal::diff(v0,v1);
+            case BOT_SYMDIFF: return IntSetVal::symdiff(v0,v1);
+            case BOT_INTERSECT: return IntSetVal::intersect(v0,v1);
             default: throw EvalError(env, e->loc(),"not a set of bool expression", bo->opToString());
           }
         } else if (lhs->type().isbool() && rhs->type().isbool()) {
@@ -1988,41 +1939,37 @@ namespace MiniZinc {
         assert(stacktop+al->v().size()==_bounds.size());
         IntVal lb = d;
         IntVal ub = d;
+        /// The finite terms are summed by int_array_dot(),
+        /// an infinite bound makes the whole bound infinite
+        std::vector<long long int> coefs, lbs, ubs;
+        coefs.reserve(al->v().size());
+        lbs.reserve(al->v().size());
+        ubs.reserve(al->v().size());
+        IntVal lbInf = 0;
+        IntVal ubInf = 0;
         for (unsigned int i=0; i<al->v().size(); i++) {
           Bounds b = _bounds.back(); _bounds.pop_back();
           IntVal cv = le ? eval_int(env,coeff->v()[i]) : 1;
-          if (cv > 0) {
-            if (b.first.isFinite()) {
-              if (lb.isFinite()) {
-                lb += cv*b.first;
-              }
-            } else {
-              lb = b.first;
-            }
-            if (b.second.isFinite()) {
-              if (ub.isFinite()) {
-                ub += cv*b.second;
-              }
-            } else {
-              ub = b.second;
-            }
-          } else {
-            if (b.second.isFinite()) {
-              if (lb.isFinite()) {
-                lb += cv*b.second;
-              }
-            } else {
-              lb = -b.second;
-            }
-            if (b.first.isFinite()) {
-              if (ub.isFinite()) {
-                ub += cv*b.first;
-              }
-            } else {
-              ub = -b.first;
-            }
+          const IntVal& bl = cv > 0 ? b.first : b.second;
+          const IntVal& bu = cv > 0 ? b.second : b.first;
+          if (!bl.isFinite())
+            lbInf = cv > 0 ? bl : -bl;
+          if (!bu.isFinite())
+            ubInf = cv > 0 ? bu : -bu;
+          if (lbInf.isFinite() || ubInf.isFinite()) {
+            coefs.push_back(cv.toInt());
+            lbs.push_back(bl.isFinite() ? bl.toInt() : 0);
+            ubs.push_back(bu.isFinite() ? bu.toInt() : 0);
           }
         }
+        if (lbInf.isFinite())
+          lb += int_array_dot(coefs.data(), lbs.data(), coefs.size());
+        else
+          lb = lbInf;
+        if (ubInf.isFinite())
+          ub += int_array_dot(coefs.data(), ubs.data(), coefs.size());
+        else
+          ub = ubInf;
         _bounds.push_back(Bounds(lb,ub));
       } else if (c.id() == "card") {
         if (IntSetVal* isv = compute_intset_bounds(env,c.args()[0])) {
@@ -2463,20 +2410,29 @@ namespace MiniZinc {
       assert(sl.type().isvar());
       assert(sl.isv()==NULL);
 
-      IntSetVal* isv = IntSetVal::a();
+      std::vector<IntSetVal::Range> rs;
       for (unsigned int i=0; i<sl.v().size(); i++) {
-        IntSetRanges i0(isv);
         IntBounds ib = compute_int_bounds(env,sl.v()[i]);
         if (!ib.valid || !ib.l.isFinite() || !ib.u.isFinite()) {
           valid = false;
           _bounds.push_back(NULL);
           return;
         }
-        Ranges::Const<IntVal> cr(ib.l,ib.u);
-        Ranges::Union<IntVal,IntSetRanges, Ranges::Const<IntVal> > u(i0,cr);
-        isv = IntSetVal::ai(u);
+        if (ib.l <= ib.u)
+          rs.push_back(IntSetVal::Range(ib.l,ib.u));
+      }
+      /// Sort the element bounds and merge them in one pass
+      std::sort(rs.begin(), rs.end(),
+                [](const IntSetVal::Range& x, const IntSetVal::Range& y) { return x.min < y.min; });
+      int n = 0;
+      for (unsigned int i=0; i<rs.size(); i++) {
+        if (n > 0 && rs[n-1].max+1 >= rs[i].min) {
+          rs[n-1].max = std::max(rs[n-1].max, rs[i].max);
+        } else {
+          rs[n++] = rs[i];
+        }
       }
-      _bounds.push_back(isv);
+      _bounds.push_back(IntSetVal::a(rs.data(), n));
     }
     /// Visit identifier
     void vId(const Id& id) {
@@ -2551,10 +2507,7 @@ namespace MiniZinc {
         case BOT_INTERSECT:
         case BOT_UNION:
           {
-            IntSetRanges b0r(b0);
-            IntSetRanges b1r(b1);
-            Ranges::Union<IntVal,IntSetRanges,IntSetRanges> u(b0r,b1r);
-            _bounds.push_back(IntSetVal::ai(u));
+            _bounds.push_back(IntSetVal::unite(b0,b1));
           }
           break;
         case BOT_DIFF:
@@ -2604,10 +2557,7 @@ namespace MiniZinc {
       if (valid && (c.id() == "set_intersect" || c.id() == "set_union")) {
         IntSetVal* b0 = _bounds.back(); _bounds.pop_back();
         IntSetVal* b1 = _bounds.back(); _bounds.pop_back();
-        IntSetRanges b0r(b0);
-        IntSetRanges b1r(b1);
-        Ranges::Union<IntVal,IntSetRanges,IntSetRanges> u(b0r,b1r);
-        _bounds.push_back(IntSetVal::ai(u));
+        _bounds.push_back(IntSetVal::unite(b0,b1));
       } else if (valid && c.id() == "set_diff") {
         IntSetVal* b0 = _bounds.back(); _bounds.pop_back();
         _bounds.pop_back(); // don't need bounds of right hand side
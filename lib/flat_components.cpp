@@ -0,0 +1,486 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <minizinc/flat_components.hh>
+#include <minizinc/optimize.hh>
+#include <minizinc/eval_par.hh>
+#include <minizinc/astexception.hh>
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace MiniZinc {
+
+  namespace {
+
+    /// Union-find over item indices
+    class Partition {
+      std::vector<int> _parent;
+    public:
+      Partition(int n) : _parent(n) {
+        for (int i=0; i<n; i++)
+          _parent[i] = i;
+      }
+      int find(int i) {
+        while (_parent[i] != i) {
+          _parent[i] = _parent[_parent[i]];
+          i = _parent[i];
+        }
+        return i;
+      }
+      void join(int i, int j) {
+        i = find(i);
+        j = find(j);
+        if (i != j)
+          _parent[std::max(i,j)] = std::min(i,j);
+      }
+    };
+
+    /// The array literal of \a e, following identifiers
+    ArrayLit* arrayOf(Expression* e) {
+      if (Id* id = e->dyn_cast<Id>()) {
+        if (id->decl()==NULL || id->decl()->e()==NULL)
+          return NULL;
+        e = id->decl()->e();
+      }
+      return e->dyn_cast<ArrayLit>();
+    }
+
+    std::string nameOf(VarDecl* vd) {
+      std::ostringstream oss;
+      oss << *vd->id();
+      return oss.str();
+    }
+
+    /// Values of a solution in FlatZinc output format, by variable name
+    void parseAssignments(const std::string& sol, std::unordered_map<std::string,std::string>& values) {
+      size_t start = 0;
+      while (start < sol.size()) {
+        size_t end = sol.find(';', start);
+        if (end == std::string::npos)
+          end = sol.size();
+        size_t eq = sol.find('=', start);
+        if (eq < end) {
+          size_t b = sol.find_first_not_of(" \t\r\n", start);
+          size_t e = sol.find_last_not_of(" \t\r\n", eq-1);
+          size_t vb = sol.find_first_not_of(" \t\r\n", eq+1);
+          size_t ve = sol.find_last_not_of(" \t\r\n", end-1);
+          if (b <= e && vb <= ve)
+            values[sol.substr(b, e-b+1)] = sol.substr(vb, ve-vb+1);
+        }
+        start = end+1;
+      }
+    }
+  }
+
+  FlatComponents::FlatComponents(Env& env) : _env(env) {
+    GCLock lock;
+    Model* m = _env.flat();
+    int n = m->size();
+    std::unordered_map<Item*,int> itemIdx;
+    for (int i=0; i<n; i++) {
+      itemIdx[(*m)[i]] = i;
+      if (VarDeclI* vdi = (*m)[i]->dyn_cast<VarDeclI>())
+        _declIdx[vdi->e()] = i;
+    }
+
+    VarOccurrences vo;
+    CollectOccurrencesI co(vo);
+    iterItems(co, m);
+
+    findObjectiveSum(vo);
+
+    // Items taking part in the graph: variables, arrays of variables used
+    // by constraints, and constraints. Par declarations and functions go
+    // to all parts, arrays only needed for the output to none.
+    _itemComponent.assign(n, NO_PART);
+    for (int i=0; i<n; i++) {
+      Item* item = (*m)[i];
+      if (item->removed() || item==_objDef)
+        continue;
+      if (VarDeclI* vdi = item->dyn_cast<VarDeclI>()) {
+        VarDecl* vd = vdi->e();
+        if (vd->type().ispar()) {
+          _itemComponent[i] = ALL_PARTS;
+        } else if (vd==_obj) {
+          continue;
+        } else if (vd->type().dim()==0) {
+          _itemComponent[i] = i;
+        } else {
+          IdMap<VarOccurrences::Items>::iterator it = vo._m.find(vd->id());
+          if (it != vo._m.end()) {
+            for (VarOccurrences::Items::iterator oi = it->second.begin(); oi != it->second.end(); ++oi) {
+              if ((*oi)->isa<ConstraintI>()) {
+                _itemComponent[i] = i;
+                break;
+              }
+            }
+          }
+        }
+      } else if (item->isa<ConstraintI>()) {
+        _itemComponent[i] = i;
+      } else if (item->isa<FunctionI>()) {
+        _itemComponent[i] = ALL_PARTS;
+      }
+    }
+
+    Partition uf(n);
+    for (IdMap<VarOccurrences::Items>::iterator it = vo._m.begin(); it != vo._m.end(); ++it) {
+      VarDecl* vd = it->first->decl();
+      if (vd==NULL || vd->type().ispar())
+        continue;
+      std::unordered_map<VarDecl*,int>::iterator vdi = _declIdx.find(vd->id()->decl());
+      if (vdi == _declIdx.end() || _itemComponent[vdi->second] < 0)
+        continue;
+      for (VarOccurrences::Items::iterator oi = it->second.begin(); oi != it->second.end(); ++oi) {
+        std::unordered_map<Item*,int>::iterator ii = itemIdx.find(*oi);
+        if (ii != itemIdx.end() && _itemComponent[ii->second] >= 0)
+          uf.join(vdi->second, ii->second);
+      }
+    }
+
+    std::vector<int> compOf(n, -1);
+    for (int i=0; i<n; i++) {
+      if (_itemComponent[i] < 0)
+        continue;
+      int r = uf.find(i);
+      if (compOf[r] == -1) {
+        compOf[r] = _nComponents++;
+        _componentSize.push_back(0);
+      }
+      _itemComponent[i] = compOf[r];
+      _componentSize[compOf[r]]++;
+    }
+
+    // Scalar variables in output arrays become output variables of their part
+    for (VarDeclIterator it = m->begin_vardecls(); it != m->end_vardecls(); ++it) {
+      if (it->removed() || !it->e()->type().isvar() || it->e()->type().dim()==0)
+        continue;
+      if (getAnnotation(it->e()->ann(), constants().ann.output_array.aststr())==NULL)
+        continue;
+      if (ArrayLit* al = arrayOf(it->e()->id())) {
+        for (unsigned int j=0; j<al->v().size(); j++) {
+          if (Id* id = al->v()[j]->dyn_cast<Id>()) {
+            if (id->decl() && !id->decl()->ann().contains(constants().ann.output_var))
+              _outputElements.push_back(id->decl()->id()->decl());
+          }
+        }
+      }
+    }
+    std::sort(_outputElements.begin(), _outputElements.end());
+    _outputElements.erase(std::unique(_outputElements.begin(), _outputElements.end()), _outputElements.end());
+
+    group(1);
+  }
+
+  void FlatComponents::findObjectiveSum(VarOccurrences& vo) {
+    SolveI* si = _env.flat()->solveItem();
+    if (si==NULL || si->st()==SolveI::ST_SAT || si->e()==NULL)
+      return;
+    Id* objId = si->e()->dyn_cast<Id>();
+    if (objId==NULL || objId->decl()==NULL)
+      return;
+    VarDecl* obj = objId->decl()->id()->decl();
+    if (obj->e() != NULL)
+      return;
+    // The objective must occur in exactly one item, a linear equation
+    IdMap<VarOccurrences::Items>::iterator occ = vo._m.find(obj->id());
+    if (occ == vo._m.end())
+      return;
+    ConstraintI* def = NULL;
+    for (VarOccurrences::Items::iterator oi = occ->second.begin(); oi != occ->second.end(); ++oi) {
+      if ((*oi)->isa<SolveI>() || ((*oi)->isa<VarDeclI>() && (*oi)->cast<VarDeclI>()->e()==obj))
+        continue;
+      if (def != NULL || !(*oi)->isa<ConstraintI>() || !(*oi)->cast<ConstraintI>()->e()->isa<Call>())
+        return;
+      def = (*oi)->cast<ConstraintI>();
+    }
+    if (def==NULL)
+      return;
+    Call* c = def->e()->cast<Call>();
+    if (c->id() != constants().ids.int_.lin_eq && c->id() != constants().ids.float_.lin_eq)
+      return;
+    ArrayLit* coefs = arrayOf(c->args()[0]);
+    ArrayLit* vars = arrayOf(c->args()[1]);
+    if (coefs==NULL || vars==NULL || coefs->v().size() != vars->v().size())
+      return;
+    Expression* objCoef = NULL;
+    std::vector<std::pair<Expression*,VarDecl*> > terms;
+    for (unsigned int k=0; k<vars->v().size(); k++) {
+      Id* id = vars->v()[k]->dyn_cast<Id>();
+      if (id==NULL || id->decl()==NULL || !id->decl()->type().isvar())
+        return;
+      VarDecl* vd = id->decl()->id()->decl();
+      if (vd==obj) {
+        if (objCoef != NULL)
+          return;
+        objCoef = coefs->v()[k];
+      } else {
+        terms.push_back(std::make_pair(coefs->v()[k], vd));
+      }
+    }
+    if (objCoef==NULL || terms.empty())
+      return;
+    // The parts do not see the defining equation, so it may only be dropped
+    // if it does not constrain the sum: the objective's domain must cover
+    // all values of the sum, and (for integers) every sum must be divisible
+    // by the coefficient
+    EnvI& env = _env.envi();
+    Expression* dom = obj->ti()->domain();
+    if (c->id()==constants().ids.int_.lin_eq) {
+      IntVal a = eval_int(env, objCoef);
+      if (a != 1 && a != -1)
+        return;
+      if (dom != NULL) {
+        IntVal lb = 0;
+        IntVal ub = 0;
+        for (unsigned int k=0; k<terms.size(); k++) {
+          IntBounds b = compute_int_bounds(env, terms[k].second->id());
+          if (!b.valid || !b.l.isFinite() || !b.u.isFinite())
+            return;
+          IntVal ck = eval_int(env, terms[k].first);
+          lb += ck < 0 ? ck*b.u : ck*b.l;
+          ub += ck < 0 ? ck*b.l : ck*b.u;
+        }
+        IntVal rhs = eval_int(env, c->args()[2]);
+        IntVal l = a==1 ? rhs-ub : lb-rhs;
+        IntVal u = a==1 ? rhs-lb : ub-rhs;
+        IntSetVal* isv = eval_intset(env, dom);
+        bool covered = false;
+        for (int i=0; i<isv->size() && !covered; i++)
+          covered = isv->min(i) <= l && u <= isv->max(i);
+        if (!covered)
+          return;
+      }
+    } else {
+      FloatVal a = eval_float(env, objCoef);
+      if (a==0.0)
+        return;
+      if (dom != NULL) {
+        FloatVal lb = 0.0;
+        FloatVal ub = 0.0;
+        for (unsigned int k=0; k<terms.size(); k++) {
+          FloatBounds b = compute_float_bounds(env, terms[k].second->id());
+          if (!b.valid || !b.l.isFinite() || !b.u.isFinite())
+            return;
+          FloatVal ck = eval_float(env, terms[k].first);
+          lb += ck < 0.0 ? ck*b.u : ck*b.l;
+          ub += ck < 0.0 ? ck*b.l : ck*b.u;
+        }
+        FloatVal rhs = eval_float(env, c->args()[2]);
+        FloatVal l = a > 0.0 ? (rhs-ub)/a : (rhs-lb)/a;
+        FloatVal u = a > 0.0 ? (rhs-lb)/a : (rhs-ub)/a;
+        FloatSetVal* fsv = eval_floatset(env, dom);
+        bool covered = false;
+        for (int i=0; i<fsv->size() && !covered; i++)
+          covered = fsv->min(i) <= l && u <= fsv->max(i);
+        if (!covered)
+          return;
+      }
+    }
+    _obj = obj;
+    _objDef = def;
+    _objCoef = objCoef;
+    _objRhs = c->args()[2];
+    _objTerms = terms;
+  }
+
+  void FlatComponents::group(int n) {
+    _nParts = std::max(1, std::min(n, _nComponents));
+    // Largest components first, each into the smallest part so far
+    std::vector<int> order(_nComponents);
+    for (int i=0; i<_nComponents; i++)
+      order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+      return _componentSize[a] > _componentSize[b];
+    });
+    std::vector<int> partOf(_nComponents);
+    std::vector<long long int> partSize(_nParts, 0);
+    for (int i=0; i<_nComponents; i++) {
+      int p = static_cast<int>(std::min_element(partSize.begin(), partSize.end()) - partSize.begin());
+      partOf[order[i]] = p;
+      partSize[p] += _componentSize[order[i]];
+    }
+    _itemPart.resize(_itemComponent.size());
+    for (unsigned int i=0; i<_itemComponent.size(); i++)
+      _itemPart[i] = _itemComponent[i] < 0 ? _itemComponent[i] : partOf[_itemComponent[i]];
+  }
+
+  std::string FlatComponents::partObjective(int p) const {
+    std::ostringstream oss;
+    oss << "X_COMPONENT_OBJ_" << p;
+    return oss.str();
+  }
+
+  void FlatComponents::writePart(int p, std::ostream& os) {
+    GCLock lock;
+    Model* m = _env.flat();
+    for (unsigned int i=0; i<m->size(); i++) {
+      Item* item = (*m)[i];
+      if (item->removed() || item->isa<SolveI>() || (_itemPart[i] != ALL_PARTS && _itemPart[i] != p))
+        continue;
+      if (VarDeclI* vdi = item->dyn_cast<VarDeclI>()) {
+        VarDecl* vd = vdi->e();
+        if (vd->type().isvar() && vd->type().dim()==0 &&
+            std::binary_search(_outputElements.begin(), _outputElements.end(), vd)) {
+          vd->addAnnotation(constants().ann.output_var);
+          os << *item;
+          vd->ann().remove(constants().ann.output_var);
+          continue;
+        }
+        if (Expression* oa = getAnnotation(vd->ann(), constants().ann.output_array.aststr())) {
+          vd->ann().remove(oa);
+          os << *item;
+          vd->addAnnotation(oa);
+          continue;
+        }
+      }
+      os << *item;
+    }
+    writeObjective(p, os);
+  }
+
+  void FlatComponents::writeObjective(int p, std::ostream& os) {
+    SolveI* si = _env.flat()->solveItem();
+    if (si==NULL || si->st()==SolveI::ST_SAT) {
+      os << "solve satisfy;\n";
+      return;
+    }
+    if (_objDef==NULL) {
+      // The objective belongs to the part of its variable
+      bool owned = true;
+      if (Id* id = si->e()->dyn_cast<Id>()) {
+        std::unordered_map<VarDecl*,int>::iterator it = _declIdx.find(id->decl()->id()->decl());
+        if (it != _declIdx.end())
+          owned = _itemPart[it->second]==p || _itemPart[it->second]==ALL_PARTS;
+      }
+      if (owned)
+        os << "solve " << (si->st()==SolveI::ST_MIN ? "minimize " : "maximize ") << *si->e() << ";\n";
+      else
+        os << "solve satisfy;\n";
+      return;
+    }
+    // The share of this part in the objective sum
+    EnvI& env = _env.envi();
+    bool isInt = _obj->type().isint();
+    std::vector<std::pair<Expression*,VarDecl*> > terms;
+    for (unsigned int k=0; k<_objTerms.size(); k++) {
+      std::unordered_map<VarDecl*,int>::iterator it = _declIdx.find(_objTerms[k].second);
+      if (it != _declIdx.end() && _itemPart[it->second]==p)
+        terms.push_back(_objTerms[k]);
+    }
+    if (terms.empty()) {
+      os << "solve satisfy;\n";
+      return;
+    }
+    bool coefNegative = isInt ? eval_int(env, _objCoef) < 0 : eval_float(env, _objCoef) < 0.0;
+    bool minimize = (si->st()==SolveI::ST_MIN) == coefNegative;
+    std::string name = partObjective(p);
+    os << "var ";
+    if (isInt) {
+      IntVal lb = 0;
+      IntVal ub = 0;
+      bool bounded = true;
+      for (unsigned int k=0; k<terms.size() && bounded; k++) {
+        IntBounds b = compute_int_bounds(env, terms[k].second->id());
+        IntVal c = eval_int(env, terms[k].first);
+        bounded = b.valid && b.l.isFinite() && b.u.isFinite();
+        if (bounded) {
+          lb += c < 0 ? c*b.u : c*b.l;
+          ub += c < 0 ? c*b.l : c*b.u;
+        }
+      }
+      if (bounded)
+        os << lb << ".." << ub;
+      else
+        os << "int";
+    } else {
+      os << "float";
+    }
+    os << ": " << name << " :: output_var;\n";
+    os << "constraint " << (isInt ? "int_lin_eq([" : "float_lin_eq([");
+    for (unsigned int k=0; k<terms.size(); k++)
+      os << *terms[k].first << ",";
+    os << (isInt ? "-1" : "-1.0") << "],[";
+    for (unsigned int k=0; k<terms.size(); k++)
+      os << *terms[k].second->id() << ",";
+    os << name << "]," << (isInt ? "0" : "0.0") << ");\n";
+    os << "solve " << (minimize ? "minimize " : "maximize ") << name << ";\n";
+  }
+
+  std::string FlatComponents::mergeSolutions(const std::vector<std::string>& sols) {
+    GCLock lock;
+    std::unordered_map<std::string,std::string> values;
+    for (unsigned int i=0; i<sols.size(); i++)
+      parseAssignments(sols[i], values);
+
+    std::ostringstream oss;
+    Model* m = _env.flat();
+    for (VarDeclIterator it = m->begin_vardecls(); it != m->end_vardecls(); ++it) {
+      if (it->removed())
+        continue;
+      VarDecl* vd = it->e();
+      if (vd->type().dim()==0 && vd->ann().contains(constants().ann.output_var)) {
+        std::string name = nameOf(vd);
+        if (vd==_obj) {
+          // obj = (rhs - sum of the shares) / coefficient
+          EnvI& env = _env.envi();
+          if (vd->type().isint()) {
+            IntVal sum = eval_int(env, _objRhs);
+            for (int p=0; p<_nParts; p++) {
+              std::unordered_map<std::string,std::string>::iterator v = values.find(partObjective(p));
+              if (v != values.end())
+                sum -= IntVal(std::stoll(v->second));
+            }
+            oss << name << " = " << sum / eval_int(env, _objCoef) << ";\n";
+          } else {
+            double sum = eval_float(env, _objRhs).toDouble();
+            for (int p=0; p<_nParts; p++) {
+              std::unordered_map<std::string,std::string>::iterator v = values.find(partObjective(p));
+              if (v != values.end())
+                sum -= std::stod(v->second);
+            }
+            oss << name << " = " << std::setprecision(std::numeric_limits<double>::digits10+2)
+                << sum / eval_float(env, _objCoef).toDouble() << ";\n";
+          }
+          continue;
+        }
+        std::unordered_map<std::string,std::string>::iterator v = values.find(name);
+        if (v == values.end())
+          throw InternalError("no value for "+name+" in the solutions of the components");
+        oss << name << " = " << v->second << ";\n";
+      } else if (Expression* oa = getAnnotation(vd->ann(), constants().ann.output_array.aststr())) {
+        ArrayLit* al = arrayOf(vd->id());
+        ArrayLit* dims = arrayOf(oa->cast<Call>()->args()[0]);
+        if (al==NULL || dims==NULL)
+          continue;
+        oss << nameOf(vd) << " = array" << dims->v().size() << "d(";
+        for (unsigned int j=0; j<dims->v().size(); j++)
+          oss << *dims->v()[j] << ",";
+        oss << "[";
+        for (unsigned int j=0; j<al->v().size(); j++) {
+          if (j > 0)
+            oss << ",";
+          Id* id = al->v()[j]->dyn_cast<Id>();
+          if (id && id->decl() && id->decl()->type().isvar()) {
+            std::string name = nameOf(id->decl()->id()->decl());
+            std::unordered_map<std::string,std::string>::iterator v = values.find(name);
+            if (v == values.end())
+              throw InternalError("no value for "+name+" in the solutions of the components");
+            oss << v->second;
+          } else {
+            oss << *al->v()[j];
+          }
+        }
+        oss << "]);\n";
+      }
+    }
+    return oss.str();
+  }
+
+}
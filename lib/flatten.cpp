@@ -22,6 +22,9 @@
 
 #include <minizinc/flatten_internal.hh>
 
+#include <algorithm>
+#include <cstring>
+
 namespace MiniZinc {
 
   /// Output operator for contexts
@@ -169,7 +172,7 @@ namespace MiniZinc {
 
 #define MZN_FILL_REIFY_MAP(T,ID) reifyMap.insert(std::pair<ASTString,ASTString>(constants().ids.T.ID,constants().ids.T ## reif.ID));
 
-  EnvI::EnvI(Model* orig0) : orig(orig0), output(new Model), ignorePartial(false), maxCallStack(0), collect_vardecls(false), in_redundant_constraint(0), in_maybe_partial(0), _flat(new Model), _failed(false), ids(0) {
+  EnvI::EnvI(Model* orig0) : orig(orig0), output(new Model), ignorePartial(false), maxCallStack(0), collect_vardecls(false), in_redundant_constraint(0), in_maybe_partial(0), hashCons(false), n_cse_hits(0), n_hashcons_reordered(0), decompositionTemplates(false), n_template_hits(0), n_template_misses(0), mergeLinear(false), n_linear_dominated(0), n_linear_duplicates(0), n_linear_bounds(0), _flat(new Model), _failed(false), ids(0) {
     MZN_FILL_REIFY_MAP(int_,lin_eq);
     MZN_FILL_REIFY_MAP(int_,lin_le);
     MZN_FILL_REIFY_MAP(int_,lin_ne);
@@ -239,6 +242,209 @@ namespace MiniZinc {
   EnvI::Map::iterator EnvI::map_end(void) {
     return map.end();
   }
+
+  namespace {
+    /// Rank of the kind of a flat argument in the hash-consing order
+    int hashcons_rank(Expression* e) {
+      if (Id* id = e->dyn_cast<Id>())
+        return id->idn() == -1 ? 0 : 1;
+      switch (e->eid()) {
+        case Expression::E_INTLIT: return 2;
+        case Expression::E_FLOATLIT: return 3;
+        case Expression::E_BOOLLIT: return 4;
+        default: return 5;
+      }
+    }
+    /// Total order on flat arguments used for hash-consing. Arguments are
+    /// ordered by kind first: named variables (by name), introduced ones (by
+    /// number), then integer, float and Boolean literals (by value). Returns 0
+    /// for expressions that are equal or of a kind that is not ordered.
+    int hashcons_cmp(Expression* e0, Expression* e1) {
+      if (e0==e1)
+        return 0;
+      int rank0 = hashcons_rank(e0);
+      int rank1 = hashcons_rank(e1);
+      if (rank0 != rank1)
+        return rank0 < rank1 ? -1 : 1;
+      if (Id* id0 = e0->dyn_cast<Id>()) {
+        Id* id1 = e1->cast<Id>();
+        if (id0->idn() != -1)
+          return id0->idn() < id1->idn() ? -1 : (id0->idn() > id1->idn() ? 1 : 0);
+        return strcmp(id0->v().c_str(), id1->v().c_str());
+      }
+      if (e0->isa<IntLit>()) {
+        IntVal v0 = e0->cast<IntLit>()->v();
+        IntVal v1 = e1->cast<IntLit>()->v();
+        return v0 < v1 ? -1 : (v1 < v0 ? 1 : 0);
+      }
+      if (e0->isa<FloatLit>()) {
+        FloatVal v0 = e0->cast<FloatLit>()->v();
+        FloatVal v1 = e1->cast<FloatLit>()->v();
+        return v0 < v1 ? -1 : (v1 < v0 ? 1 : 0);
+      }
+      if (e0->isa<BoolLit>())
+        return static_cast<int>(e0->cast<BoolLit>()->v()) - static_cast<int>(e1->cast<BoolLit>()->v());
+      return 0;
+    }
+    struct HashConsLess {
+      bool operator ()(Expression* e0, Expression* e1) const {
+        return hashcons_cmp(e0, e1) < 0;
+      }
+    };
+    
+    enum HashConsKind { HC_NONE, HC_SYMMETRIC, HC_ELEMENTS, HC_LINEAR, HC_LINEAR_SYM };
+    
+    HashConsKind hashcons_kind(const ASTString& id) {
+      typedef UNORDERED_NAMESPACE::unordered_map<std::string,HashConsKind> KindMap;
+      static KindMap kinds;
+      if (kinds.empty()) {
+        /// The first two arguments can be swapped
+        const char* symmetric[] = {
+          "int_eq", "int_ne", "int_plus", "int_times", "int_max", "int_min",
+          "int_eq_reif", "int_ne_reif",
+          "float_eq", "float_ne", "float_plus", "float_times", "float_max", "float_min",
+          "float_eq_reif", "float_ne_reif",
+          "bool_eq", "bool_eq_reif", "bool_xor", "bool_and", "bool_or",
+          "set_eq", "set_ne", "set_union", "set_intersect", "set_symdiff",
+          "set_eq_reif", "set_ne_reif", "max", "min"
+        };
+        for (unsigned int i=0; i<sizeof(symmetric)/sizeof(symmetric[0]); i++)
+          kinds[symmetric[i]] = HC_SYMMETRIC;
+        /// The elements of the array arguments can be sorted
+        const char* elements[] = {
+          "array_bool_and", "array_bool_or", "bool_clause", "bool_clause_reif"
+        };
+        for (unsigned int i=0; i<sizeof(elements)/sizeof(elements[0]); i++)
+          kinds[elements[i]] = HC_ELEMENTS;
+        /// (coefficients, variables, constant, ...)
+        const char* linear[] = {
+          "int_lin_le", "int_lin_le_reif",
+          "float_lin_le", "float_lin_lt", "float_lin_le_reif", "float_lin_lt_reif"
+        };
+        for (unsigned int i=0; i<sizeof(linear)/sizeof(linear[0]); i++)
+          kinds[linear[i]] = HC_LINEAR;
+        /// Linear, and invariant under negation of both sides
+        const char* linearSym[] = {
+          "int_lin_eq", "int_lin_ne", "int_lin_eq_reif", "int_lin_ne_reif",
+          "float_lin_eq", "float_lin_ne", "float_lin_eq_reif", "float_lin_ne_reif"
+        };
+        for (unsigned int i=0; i<sizeof(linearSym)/sizeof(linearSym[0]); i++)
+          kinds[linearSym[i]] = HC_LINEAR_SYM;
+      }
+      KindMap::iterator it = kinds.find(id.str());
+      return it==kinds.end() ? HC_NONE : it->second;
+    }
+    
+    /// Sorted copy of \a al, or NULL if it is already sorted
+    ArrayLit* sorted_elements(ArrayLit* al) {
+      std::vector<Expression*> v(al->v().size());
+      for (unsigned int i=0; i<v.size(); i++)
+        v[i] = al->v()[i];
+      if (std::is_sorted(v.begin(), v.end(), HashConsLess()))
+        return NULL;
+      std::stable_sort(v.begin(), v.end(), HashConsLess());
+      ArrayLit* nal = new ArrayLit(al->loc(), v);
+      nal->type(al->type());
+      return nal;
+    }
+  }
+  
+  void hashcons_call(EnvI& env, Call* c) {
+    if (!env.hashCons || c->args().size() < 2)
+      return;
+    bool changed = false;
+    HashConsKind kind = hashcons_kind(c->id());
+    switch (kind) {
+      case HC_NONE:
+        return;
+      case HC_SYMMETRIC:
+        if (c->args()[0]->type() == c->args()[1]->type() &&
+            hashcons_cmp(c->args()[0], c->args()[1]) > 0) {
+          Expression* tmp = c->args()[0];
+          c->args()[0] = c->args()[1];
+          c->args()[1] = tmp;
+          changed = true;
+        }
+        break;
+      case HC_ELEMENTS:
+        for (unsigned int i=0; i<2; i++) {
+          if (ArrayLit* al = c->args()[i]->dyn_cast<ArrayLit>()) {
+            if (ArrayLit* nal = sorted_elements(al)) {
+              c->args()[i] = nal;
+              changed = true;
+            }
+          }
+        }
+        break;
+      case HC_LINEAR:
+      case HC_LINEAR_SYM: {
+        ArrayLit* coeffs = c->args()[0]->dyn_cast<ArrayLit>();
+        ArrayLit* vars = c->args()[1]->dyn_cast<ArrayLit>();
+        if (coeffs==NULL || vars==NULL || coeffs->v().size() != vars->v().size() ||
+            vars->v().size()==0)
+          break;
+        std::vector<int> idx(vars->v().size());
+        for (unsigned int i=0; i<idx.size(); i++)
+          idx[i] = i;
+        struct CmpIdx {
+          ArrayLit* x;
+          bool operator ()(int i, int j) const {
+            return hashcons_cmp(x->v()[i], x->v()[j]) < 0;
+          }
+        } cmpIdx = { vars };
+        std::stable_sort(idx.begin(), idx.end(), cmpIdx);
+        /// Equations and disequations are normalised to a positive leading coefficient
+        bool negate = false;
+        if (kind==HC_LINEAR_SYM && c->args().size() >= 3) {
+          Expression* c0 = coeffs->v()[idx[0]];
+          Expression* rhs = c->args()[2];
+          if (c0->isa<IntLit>() && rhs->isa<IntLit>())
+            negate = c0->cast<IntLit>()->v() < 0;
+          else if (c0->isa<FloatLit>() && rhs->isa<FloatLit>())
+            negate = c0->cast<FloatLit>()->v() < 0.0;
+        }
+        bool sorted = true;
+        for (unsigned int i=0; i<idx.size(); i++)
+          sorted = sorted && idx[i]==static_cast<int>(i);
+        if (sorted && !negate)
+          break;
+        std::vector<Expression*> coeffs_v(idx.size());
+        std::vector<Expression*> vars_v(idx.size());
+        for (unsigned int i=0; i<idx.size(); i++) {
+          coeffs_v[i] = coeffs->v()[idx[i]];
+          vars_v[i] = vars->v()[idx[i]];
+        }
+        if (negate) {
+          for (unsigned int i=0; i<coeffs_v.size(); i++) {
+            if (coeffs_v[i]->isa<IntLit>())
+              coeffs_v[i] = IntLit::a(-coeffs_v[i]->cast<IntLit>()->v());
+            else
+              coeffs_v[i] = FloatLit::a(-coeffs_v[i]->cast<FloatLit>()->v());
+          }
+          Expression* rhs = c->args()[2];
+          if (rhs->isa<IntLit>())
+            c->args()[2] = IntLit::a(-rhs->cast<IntLit>()->v());
+          else
+            c->args()[2] = FloatLit::a(-rhs->cast<FloatLit>()->v());
+        }
+        ArrayLit* ncoeffs = new ArrayLit(coeffs->loc(), coeffs_v);
+        ncoeffs->type(coeffs->type());
+        ArrayLit* nvars = new ArrayLit(vars->loc(), vars_v);
+        nvars->type(vars->type());
+        c->args()[0] = ncoeffs;
+        c->args()[1] = nvars;
+        changed = true;
+      } break;
+    }
+    if (changed) {
+      /// Flat calls are hashed before their declaration is set, keep it that way
+      FunctionI* decl = c->decl();
+      c->decl(NULL);
+      c->rehash();
+      c->decl(decl);
+      ++env.n_hashcons_reordered;
+    }
+  }
   void EnvI::dump(void) {
     struct EED {
       static std::string d(const WW& ee) {
@@ -507,6 +713,20 @@ namespace MiniZinc {
     }
   };
   
+  /// The body to flatten for a call of \a decl (see DecompositionTemplates)
+  class TemplateItem {
+  public:
+    EnvI& env;
+    FunctionI* decl;
+    KeepAlive body;
+    TemplateItem(EnvI& env0, FunctionI* decl0) : env(env0), decl(decl0) {
+      body = env.templates.instantiate(env, decl);
+    }
+    ~TemplateItem(void) {
+      env.templates.release(decl);
+    }
+  };
+  
   FlatteningError::FlatteningError(EnvI& env, const Location& loc, const std::string& msg)
   : LocationException(env,loc,msg) {}
   
@@ -1062,6 +1282,7 @@ namespace MiniZinc {
 
             EnvI::Map::iterator it = env.map_find(al);
             if (it != env.map_end()) {
+              ++env.n_cse_hits;
               return it->second.r()->cast<VarDecl>()->id();
             }
 
@@ -1125,10 +1346,7 @@ namespace MiniZinc {
                 while (id != NULL) {
                   if (id->decl()->ti()->domain()) {
                     IntSetVal* domain = eval_intset(env,id->decl()->ti()->domain());
-                    IntSetRanges dr(domain);
-                    IntSetRanges ibr(ibv);
-                    Ranges::Inter<IntVal,IntSetRanges,IntSetRanges> i(dr,ibr);
-                    IntSetVal* newibv = IntSetVal::ai(i);
+                    IntSetVal* newibv = IntSetVal::intersect(domain,ibv);
                     if (ibv->card() == newibv->card()) {
                       id->decl()->ti()->setComputedDomain(true);
                     } else {
@@ -1228,16 +1446,11 @@ namespace MiniZinc {
                         vdi->ti()->domain(vd->ti()->domain());
                       } else {
                         IntSetVal* vdi_dom = eval_intset(env, vdi->ti()->domain());
-                        IntSetRanges isvr(isv);
-                        IntSetRanges vdi_domr(vdi_dom);
-                        Ranges::Inter<IntVal,IntSetRanges, IntSetRanges> inter(isvr,vdi_domr);
-                        IntSetVal* newdom = IntSetVal::ai(inter);
+                        IntSetVal* newdom = IntSetVal::intersect(isv,vdi_dom);
                         if (newdom->size()==0) {
                           env.fail();
                         } else {
-                          IntSetRanges vdi_domr2(vdi_dom);
-                          IntSetRanges newdomr(newdom);
-                          if (!Ranges::equal(vdi_domr2, newdomr)) {
+                          if (!vdi_dom->equal(newdom)) {
                             vdi->ti()->domain(new SetLit(Location().introduce(),newdom));
                             vdi->ti()->setComputedDomain(false);
                           }
@@ -1355,10 +1568,7 @@ namespace MiniZinc {
               if (ibv) {
                 if (vd->ti()->domain()) {
                   IntSetVal* domain = eval_intset(env,vd->ti()->domain());
-                  IntSetRanges dr(domain);
-                  IntSetRanges ibr(ibv);
-                  Ranges::Inter<IntVal,IntSetRanges,IntSetRanges> i(dr,ibr);
-                  IntSetVal* newibv = IntSetVal::ai(i);
+                  IntSetVal* newibv = IntSetVal::intersect(domain,ibv);
                   if (ibv->card() == newibv->card()) {
                     vd->ti()->setComputedDomain(true);
                   } else {
@@ -2161,18 +2371,12 @@ namespace MiniZinc {
       if (isv_else) {
         IntSetVal* isv = isv_else;
         for (unsigned int i=0; i<r_bounds_set.size(); i++) {
-          IntSetRanges i0(isv);
-          IntSetRanges i1(r_bounds_set[i]);
-          Ranges::Union<IntVal,IntSetRanges, IntSetRanges> u(i0,i1);
-          isv = IntSetVal::ai(u);
+          isv = IntSetVal::unite(isv,r_bounds_set[i]);
         }
         if (r) {
           IntSetVal* orig_r_bounds = compute_intset_bounds(env,r->id());
           if (orig_r_bounds) {
-            IntSetRanges i0(isv);
-            IntSetRanges i1(orig_r_bounds);
-            Ranges::Inter<IntVal,IntSetRanges, IntSetRanges> inter(i0,i1);
-            isv = IntSetVal::ai(inter);
+            isv = IntSetVal::intersect(isv,orig_r_bounds);
           }
         }
         SetLit* r_dom = new SetLit(Location().introduce(),isv);
@@ -3020,6 +3224,7 @@ namespace MiniZinc {
           ret.b = bind(env,Ctx(),b,constants().lit_true);
           return ret;
         } else if ( (it = env.map_find(e)) != env.map_end()) {
+          ++env.n_cse_hits;
           ret.r = bind(env,ctx,r,it->second.r()->cast<VarDecl>()->id());
           ret.b = bind(env,Ctx(),b,constants().lit_true);
           return ret;
@@ -3035,6 +3240,7 @@ namespace MiniZinc {
             return ret;
           }
           if ( (it = env.map_find(al)) != env.map_end()) {
+            ++env.n_cse_hits;
             ret.r = bind(env,ctx,r,it->second.r()->cast<VarDecl>()->id());
             ret.b = bind(env,Ctx(),b,constants().lit_true);
             return ret;
@@ -3268,6 +3474,7 @@ namespace MiniZinc {
                     env.map_insert(vd->e(),ee);
                 }
               } else {
+                ++env.n_cse_hits;
                 if (it->second.r()->isa<VarDecl>()) {
                   vd = it->second.r()->cast<VarDecl>();
                 } else {
@@ -3967,9 +4174,11 @@ namespace MiniZinc {
               cc = new Call(bo->loc().introduce(),opToBuiltin(bo,bot),args);
             }
             cc->type(bo->type());
+            hashcons_call(env,cc);
 
             EnvI::Map::iterator cit;
             if ( (cit = env.map_find(cc)) != env.map_end()) {
+              ++env.n_cse_hits;
               ret.b = bind(env,Ctx(),b,env.ignorePartial ? constants().lit_true : cit->second.b());
               ret.r = bind(env,ctx,r,cit->second.r());
             } else {
@@ -4338,10 +4547,7 @@ namespace MiniZinc {
                   bool changeDom = false;
                   if (id->decl()->ti()->domain()) {
                     IntSetVal* domain = eval_intset(env,id->decl()->ti()->domain());
-                    IntSetRanges dr(domain);
-                    IntSetRanges ibr(newdom);
-                    Ranges::Inter<IntVal,IntSetRanges,IntSetRanges> i(dr,ibr);
-                    IntSetVal* newibv = IntSetVal::ai(i);
+                    IntSetVal* newibv = IntSetVal::intersect(domain,newdom);
                     if (domain->card() != newibv->card()) {
                       newdom = newibv;
                       changeDom = true;
@@ -4443,8 +4649,10 @@ namespace MiniZinc {
                 }
               }
 
+              hashcons_call(env,cc);
               EnvI::Map::iterator cit = env.map_find(cc);
               if (cit != env.map_end()) {
+                ++env.n_cse_hits;
                 ees[2].b = cit->second.r();
                 if (doubleNeg) {
                   Type t = ees[2].b()->type();
@@ -4853,10 +5061,12 @@ namespace MiniZinc {
             cr_c->type(decl->rtype(env,e_args,false));
             assert(decl);
             cr_c->decl(decl);
+            hashcons_call(env,cr_c);
             cr = cr_c;
           }
           EnvI::Map::iterator cit = env.map_find(cr());
           if (cit != env.map_end()) {
+            ++env.n_cse_hits;
             ret.b = bind(env,Ctx(),b,env.ignorePartial ? constants().lit_true : cit->second.b());
             ret.r = bind(env,ctx,r,cit->second.r());
           } else {
@@ -5040,28 +5250,29 @@ namespace MiniZinc {
                 vd->flat(vd);
                 vd->e(args[i]());
               }
+              TemplateItem body(env, decl);
               
               if (decl->e()->type().isbool() && !decl->e()->type().isopt()) {
                 ret.b = bind(env,Ctx(),b,constants().lit_true);
                 if (ctx.b==C_ROOT && r==constants().var_true) {
-                  (void) flat_exp(env,Ctx(),decl->e(),r,constants().var_true);
+                  (void) flat_exp(env,Ctx(),body.body(),r,constants().var_true);
                 } else {
                   Ctx nctx;
                   if (!isTotal(decl)) {
                     nctx = ctx;
                     nctx.neg = false;
                   }
-                  EE ee = flat_exp(env,nctx,decl->e(),NULL,constants().var_true);
+                  EE ee = flat_exp(env,nctx,body.body(),NULL,constants().var_true);
                   ee.b = ee.r;
                   args_ee.push_back(ee);
                 }
                 ret.r = conj(env,r,ctx,args_ee);
               } else {
                 if (isTotal(decl)) {
-                  EE ee = flat_exp(env,Ctx(),decl->e(),r,constants().var_true);
+                  EE ee = flat_exp(env,Ctx(),body.body(),r,constants().var_true);
                   ret.r = bind(env,ctx,r,ee.r());
                 } else {
-                  ret = flat_exp(env,ctx,decl->e(),r,NULL);
+                  ret = flat_exp(env,ctx,body.body(),r,NULL);
                   args_ee.push_back(ret);
                   if (decl->e()->type().dim() > 0) {
                     ArrayLit* al = follow_id(ret.r())->cast<ArrayLit>();
@@ -5305,10 +5516,8 @@ namespace MiniZinc {
         return false;
     } else if (e->type()==Type::parsetint()) {
       IntSetVal* isv = eval_intset(env,domain);
-      IntSetRanges ir(isv);
       IntSetVal* rsv = eval_intset(env,e);
-      IntSetRanges rr(rsv);
-      if (!Ranges::subset(rr, ir))
+      if (!IntSetVal::subset(rsv, isv))
         return false;
     } else if (e->type()==Type::parsetfloat()) {
       FloatSetVal* fsv = eval_floatset(env,domain);
@@ -5326,6 +5535,9 @@ namespace MiniZinc {
     try {
 
       EnvI& env = e.envi();
+      env.hashCons = opt.hashCons;
+      env.decompositionTemplates = opt.decompositionTemplates;
+      env.mergeLinear = opt.mergeLinear;
       
       bool onlyRangeDomains = false;
       if ( opt.onlyRangeDomains ) {
@@ -6427,11 +6639,29 @@ namespace MiniZinc {
     } _cmp;
     // Perform final sorting
     std::stable_sort(m->begin(),m->end(),_cmp);
+
+    // Number the scalar variables densely, so that solvers can
+    // find them by index (see VarIdTable)
+    int nVars = 0;
+    for (VarDeclIterator it = m->begin_vardecls(); it != m->end_vardecls(); ++it) {
+      VarDecl* vd = it->e();
+      if (vd->type().isvar() && vd->type().dim()==0)
+        vd->payload(nVars++);
+      else
+        vd->payload(-1);
+    }
   }
 
   FlatModelStatistics statistics(Env& m) {
     Model* flat = m.flat();
     FlatModelStatistics stats;
+    stats.n_cse_hits = m.envi().n_cse_hits;
+    stats.n_hashcons_reordered = m.envi().n_hashcons_reordered;
+    stats.n_template_hits = m.envi().n_template_hits;
+    stats.n_template_misses = m.envi().n_template_misses;
+    stats.n_linear_dominated = m.envi().n_linear_dominated;
+    stats.n_linear_duplicates = m.envi().n_linear_duplicates;
+    stats.n_linear_bounds = m.envi().n_linear_bounds;
     for (unsigned int i=0; i<flat->size(); i++) {
       if (!(*flat)[i]->removed()) {
         if (VarDeclI* vdi = (*flat)[i]->dyn_cast<VarDeclI>()) {
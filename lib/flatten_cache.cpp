@@ -0,0 +1,270 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <minizinc/flatten_cache.hh>
+#include <minizinc/flatten.hh>
+#include <minizinc/prettyprinter.hh>
+#include <minizinc/file_utils.hh>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unordered_set>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <sys/utime.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <utime.h>
+#include <unistd.h>
+#endif
+
+namespace MiniZinc {
+
+  namespace {
+
+    /// SHA-256 (FIPS 180-4)
+    class Sha256 {
+      uint32_t _h[8];
+      unsigned char _buf[64];
+      size_t _nBuf;
+      uint64_t _nBits;
+      static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32-n)); }
+      void block(const unsigned char* p) {
+        static const uint32_t k[64] = {
+          0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+          0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+          0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+          0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+          0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+          0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+          0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+          0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+        uint32_t w[64];
+        for (int i=0; i<16; i++)
+          w[i] = uint32_t(p[4*i])<<24 | uint32_t(p[4*i+1])<<16 | uint32_t(p[4*i+2])<<8 | uint32_t(p[4*i+3]);
+        for (int i=16; i<64; i++) {
+          uint32_t s0 = rotr(w[i-15],7) ^ rotr(w[i-15],18) ^ (w[i-15] >> 3);
+          uint32_t s1 = rotr(w[i-2],17) ^ rotr(w[i-2],19) ^ (w[i-2] >> 10);
+          w[i] = w[i-16] + s0 + w[i-7] + s1;
+        }
+        uint32_t a=_h[0], b=_h[1], c=_h[2], d=_h[3], e=_h[4], f=_h[5], g=_h[6], h=_h[7];
+        for (int i=0; i<64; i++) {
+          uint32_t t1 = h + (rotr(e,6) ^ rotr(e,11) ^ rotr(e,25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+          uint32_t t2 = (rotr(a,2) ^ rotr(a,13) ^ rotr(a,22)) + ((a & b) ^ (a & c) ^ (b & c));
+          h = g; g = f; f = e; e = d + t1;
+          d = c; c = b; b = a; a = t1 + t2;
+        }
+        _h[0] += a; _h[1] += b; _h[2] += c; _h[3] += d;
+        _h[4] += e; _h[5] += f; _h[6] += g; _h[7] += h;
+      }
+    public:
+      Sha256(void) : _nBuf(0), _nBits(0) {
+        static const uint32_t h0[8] = {
+          0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+        std::copy(h0, h0+8, _h);
+      }
+      void add(const void* data, size_t n) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        _nBits += uint64_t(n) * 8;
+        while (n > 0) {
+          size_t m = std::min(n, 64-_nBuf);
+          std::copy(p, p+m, _buf+_nBuf);
+          _nBuf += m; p += m; n -= m;
+          if (_nBuf==64) {
+            block(_buf);
+            _nBuf = 0;
+          }
+        }
+      }
+      /// Add \a s, preceded by its length so that concatenations differ
+      void add(const std::string& s) {
+        std::ostringstream oss;
+        oss << s.size() << ':';
+        add(oss.str().data(), oss.str().size());
+        add(s.data(), s.size());
+      }
+      std::string hex(void) {
+        uint64_t nBits = _nBits;
+        unsigned char pad = 0x80;
+        add(&pad, 1);
+        pad = 0;
+        while (_nBuf != 56)
+          add(&pad, 1);
+        unsigned char len[8];
+        for (int i=0; i<8; i++)
+          len[i] = static_cast<unsigned char>(nBits >> (56-8*i));
+        add(len, 8);
+        std::ostringstream oss;
+        for (int i=0; i<8; i++)
+          oss << std::hex << std::setw(8) << std::setfill('0') << _h[i];
+        return oss.str();
+      }
+    };
+
+    std::string fileContents(const std::string& filename) {
+      std::ifstream is(filename.c_str(), std::ios::binary);
+      std::ostringstream oss;
+      oss << is.rdbuf();
+      return oss.str();
+    }
+
+    unsigned long long fileSize(const std::string& filename, time_t* mtime = NULL) {
+      struct stat info;
+      if (stat(filename.c_str(), &info) != 0)
+        return 0;
+      if (mtime)
+        *mtime = info.st_mtime;
+      return static_cast<unsigned long long>(info.st_size);
+    }
+
+    /// Write \a m to \a filename, via a temporary file
+    bool writeModel(Model* m, const std::string& filename) {
+      std::ostringstream tmp;
+      tmp << filename << ".tmp" << getpid();
+      {
+        std::ofstream os(tmp.str().c_str());
+        Printer p(os,0);
+        p.print(m);
+        if (!os.good()) {
+          os.close();
+          std::remove(tmp.str().c_str());
+          return false;
+        }
+      }
+      std::remove(filename.c_str());
+      return std::rename(tmp.str().c_str(), filename.c_str())==0;
+    }
+  }
+
+  FlatteningCache::FlatteningCache(const std::string& dir, unsigned long long maxBytes)
+    : _dir(dir), _maxBytes(maxBytes) {}
+
+  std::string FlatteningCache::key(Model* m, const std::vector<std::string>& datafiles,
+                                   const std::string& options) {
+    Sha256 sha;
+    sha.add(options);
+    // All models read by the parser, in a fixed order
+    std::vector<Model*> models(1, m);
+    std::unordered_set<Model*> seen;
+    seen.insert(m);
+    for (unsigned int i=0; i<models.size(); i++) {
+      Model* cm = models[i];
+      sha.add(cm->filepath().str());
+      sha.add(fileContents(cm->filepath().str()));
+      for (unsigned int j=0; j<cm->size(); j++) {
+        if (IncludeI* ii = (*cm)[j]->dyn_cast<IncludeI>()) {
+          if (ii->m() && seen.insert(ii->m()).second)
+            models.push_back(ii->m());
+        }
+      }
+    }
+    for (unsigned int i=0; i<datafiles.size(); i++) {
+      sha.add(datafiles[i]);
+      if (datafiles[i].compare(0, 5, "cmd:/") != 0)
+        sha.add(fileContents(datafiles[i]));
+    }
+    return sha.hex();
+  }
+
+  bool FlatteningCache::lookup(const std::string& key, std::string& fzn, std::string& ozn) {
+    fzn = _dir+"/"+key+".fzn";
+    ozn = _dir+"/"+key+".ozn";
+    bool hit = FileUtils::file_exists(fzn) && FileUtils::file_exists(ozn);
+    if (hit) {
+      // Mark the entry as recently used
+      utime(fzn.c_str(), NULL);
+      ++_hits;
+    } else {
+      ++_misses;
+    }
+    updateStatistics(hit ? 1 : 0, hit ? 0 : 1);
+    return hit;
+  }
+
+  void FlatteningCache::store(const std::string& key, Env& env) {
+    if (!FileUtils::directory_exists(_dir))
+      return;
+    // The .fzn is written last, as it marks a complete entry
+    if (!writeModel(env.output(), _dir+"/"+key+".ozn") ||
+        !writeModel(env.flat(), _dir+"/"+key+".fzn")) {
+      std::cerr << "  WARNING: could not write to the flattening cache '" << _dir << "'." << std::endl;
+      return;
+    }
+    evict();
+  }
+
+  void FlatteningCache::evict(void) {
+    std::vector<std::string> entries = FileUtils::directory_list(_dir, "fzn");
+    std::vector<std::pair<time_t,std::string> > byAge;
+    unsigned long long total = 0;
+    for (unsigned int i=0; i<entries.size(); i++) {
+      // Only consider files named like entries
+      if (entries[i].size() != 64+4 ||
+          entries[i].find_first_not_of("0123456789abcdef") != 64)
+        continue;
+      std::string base = _dir+"/"+entries[i].substr(0, 64);
+      time_t mtime = 0;
+      unsigned long long size = fileSize(base+".fzn", &mtime) + fileSize(base+".ozn");
+      total += size;
+      byAge.push_back(std::make_pair(mtime, base));
+    }
+    std::sort(byAge.begin(), byAge.end());
+    for (unsigned int i=0; i<byAge.size() && total > _maxBytes; i++) {
+      total -= fileSize(byAge[i].second+".fzn") + fileSize(byAge[i].second+".ozn");
+      std::remove((byAge[i].second+".fzn").c_str());
+      std::remove((byAge[i].second+".ozn").c_str());
+      ++_evicted;
+    }
+  }
+
+  void FlatteningCache::updateStatistics(int hits, int misses) {
+    std::string filename = _dir+"/cache.stats";
+    long long int totalHits = 0;
+    long long int totalMisses = 0;
+    {
+      std::ifstream is(filename.c_str());
+      std::string word;
+      long long int n;
+      while (is >> word >> n) {
+        if (word=="hits")
+          totalHits = n;
+        else if (word=="misses")
+          totalMisses = n;
+      }
+    }
+    std::ofstream os(filename.c_str());
+    os << "hits " << totalHits+hits << "\nmisses " << totalMisses+misses << "\n";
+  }
+
+  void FlatteningCache::printStatistics(std::ostream& os) {
+    long long int totalHits = 0;
+    long long int totalMisses = 0;
+    std::ifstream is((_dir+"/cache.stats").c_str());
+    std::string word;
+    long long int n;
+    while (is >> word >> n) {
+      if (word=="hits")
+        totalHits = n;
+      else if (word=="misses")
+        totalMisses = n;
+    }
+    os << "Flattening cache: " << (_hits ? "hit" : "miss");
+    if (_evicted)
+      os << ", " << _evicted << " entries evicted";
+    os << " (" << totalHits << " hits, " << totalMisses << " misses overall)\n";
+  }
+
+}
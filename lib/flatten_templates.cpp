@@ -0,0 +1,476 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <minizinc/flatten_internal.hh>
+#include <minizinc/astiterator.hh>
+#include <minizinc/copy.hh>
+
+#include <unordered_set>
+
+namespace MiniZinc {
+
+  namespace {
+
+    /// Maximum number of templates per function
+    const unsigned int maxTemplates = 64;
+    /// Number of distinct shapes after which a function without any
+    /// reused template is no longer considered
+    const unsigned int maxUnusedShapes = 256;
+
+    /// Whether \a id is a builtin whose result depends on more than its
+    /// arguments, or that has a side effect
+    bool isImpureBuiltin(const ASTString& id) {
+      static const char* names[] = {
+        "abort", "trace", "trace_stdout", "mzn_in_redundant_constraint",
+        "bernoulli", "binomial", "cauchy", "chisquared", "discrete_distribution",
+        "exponential", "fdistribution", "gamma", "lognormal", "normal",
+        "poisson", "tdistribution", "uniform", "weibull"
+      };
+      for (unsigned int i=0; i<sizeof(names)/sizeof(names[0]); i++)
+        if (id == names[i])
+          return true;
+      return false;
+    }
+
+    /// Whether \a id only inspects the index sets of its arguments
+    bool isIndexSetFn(const ASTString& id) {
+      return id == "length" || id.str().compare(0, 9, "index_set")==0;
+    }
+
+    /// Whether \a id returns the bounds or domain of its (var) argument
+    bool isBoundsFn(const ASTString& id) {
+      return id == "lb" || id == "ub" || id == "dom" || id == "has_bounds" ||
+        id == "lb_array" || id == "ub_array" || id == "dom_array" || id == "dom_bounds_array";
+    }
+
+    bool isLiteral(Expression* e) {
+      switch (e->eid()) {
+        case Expression::E_INTLIT:
+        case Expression::E_FLOATLIT:
+        case Expression::E_BOOLLIT:
+        case Expression::E_STRINGLIT:
+          return true;
+        case Expression::E_SETLIT:
+          {
+            SetLit* sl = e->cast<SetLit>();
+            if (sl->isv() || sl->fsv())
+              return true;
+            for (unsigned int i=0; i<sl->v().size(); i++)
+              if (!isLiteral(sl->v()[i]))
+                return false;
+            return true;
+          }
+        case Expression::E_ARRAYLIT:
+          {
+            ArrayLit* al = e->cast<ArrayLit>();
+            for (unsigned int i=0; i<al->v().size(); i++)
+              if (!isLiteral(al->v()[i]))
+                return false;
+            return true;
+          }
+        default:
+          return false;
+      }
+    }
+
+    /// Collects the declarations made and referenced in an expression,
+    /// and whether it calls an impure function
+    class ScanBody : public EVisitor {
+    public:
+      DecompositionTemplates& dt;
+      std::unordered_set<VarDecl*> declared;
+      std::vector<VarDecl*> referenced;
+      bool impure;
+      ScanBody(DecompositionTemplates& dt0) : dt(dt0), impure(false) {}
+      bool enter(Expression*) { return true; }
+      void vVarDecl(const VarDecl& vd) { declared.insert(const_cast<VarDecl*>(&vd)); }
+      void vId(const Id& id) {
+        if (id.decl())
+          referenced.push_back(id.decl());
+      }
+      void vCall(const Call& c) {
+        if (isImpureBuiltin(c.id()) || (c.decl() && !dt.pure(c.decl())))
+          impure = true;
+      }
+    };
+
+    /// Finds the maximal subexpressions of a function body that only
+    /// depend on the shape of the arguments
+    class ShapeAnalysis {
+    public:
+      DecompositionTemplates& dt;
+      FunctionI* fi;
+      /// Declarations whose value only depends on the shape
+      std::unordered_set<VarDecl*> shape;
+      std::vector<Expression*> shapeExps;
+      /// Calls such as lb(x) on var parameters, which depend on the
+      /// bounds of the argument rather than the shape
+      std::vector<Expression*> boundsCalls;
+      std::unordered_set<Expression*> boundsCallSet;
+      ShapeAnalysis(DecompositionTemplates& dt0, FunctionI* fi0) : dt(dt0), fi(fi0) {
+        for (unsigned int i=0; i<fi->params().size(); i++)
+          if (fi->params()[i]->type().ispar())
+            shape.insert(fi->params()[i]);
+      }
+      bool isParam(Expression* e) {
+        if (Id* id = e->dyn_cast<Id>())
+          for (unsigned int i=0; i<fi->params().size(); i++)
+            if (id->decl()==fi->params()[i])
+              return true;
+        return false;
+      }
+      bool shapeOnly(Expression* e) {
+        if (e==NULL || isLiteral(e))
+          return true;
+        Type t = e->type();
+        if (!t.ispar() || t.isann() || t.isopt())
+          return false;
+        switch (e->eid()) {
+          case Expression::E_ID:
+            {
+              VarDecl* vd = e->cast<Id>()->decl();
+              return vd != NULL && (shape.find(vd) != shape.end() ||
+                                    (vd->toplevel() && vd->type().ispar() && vd->e() != NULL));
+            }
+          case Expression::E_SETLIT:
+            {
+              SetLit* sl = e->cast<SetLit>();
+              for (unsigned int i=0; i<sl->v().size(); i++)
+                if (!shapeOnly(sl->v()[i]))
+                  return false;
+              return true;
+            }
+          case Expression::E_ARRAYLIT:
+            {
+              ArrayLit* al = e->cast<ArrayLit>();
+              for (unsigned int i=0; i<al->v().size(); i++)
+                if (!shapeOnly(al->v()[i]))
+                  return false;
+              return true;
+            }
+          case Expression::E_ARRAYACCESS:
+            {
+              ArrayAccess* aa = e->cast<ArrayAccess>();
+              for (unsigned int i=0; i<aa->idx().size(); i++)
+                if (!shapeOnly(aa->idx()[i]))
+                  return false;
+              return shapeOnly(aa->v());
+            }
+          case Expression::E_COMP:
+            {
+              // The generator variables are only bound within the comprehension
+              Comprehension* comp = e->cast<Comprehension>();
+              std::vector<VarDecl*> decls;
+              bool ret = true;
+              for (int i=0; ret && i<comp->n_generators(); i++) {
+                ret = shapeOnly(comp->in(i));
+                for (int j=0; j<comp->n_decls(i); j++) {
+                  decls.push_back(comp->decl(i,j));
+                  shape.insert(comp->decl(i,j));
+                }
+              }
+              ret = ret && shapeOnly(comp->where()) && shapeOnly(comp->e());
+              for (unsigned int i=0; i<decls.size(); i++)
+                shape.erase(decls[i]);
+              return ret;
+            }
+          case Expression::E_ITE:
+            {
+              ITE* ite = e->cast<ITE>();
+              for (int i=0; i<ite->size(); i++)
+                if (!shapeOnly(ite->e_if(i)) || !shapeOnly(ite->e_then(i)))
+                  return false;
+              return shapeOnly(ite->e_else());
+            }
+          case Expression::E_BINOP:
+            {
+              BinOp* bo = e->cast<BinOp>();
+              if (bo->decl() && !dt.pure(bo->decl()))
+                return false;
+              return shapeOnly(bo->lhs()) && shapeOnly(bo->rhs());
+            }
+          case Expression::E_UNOP:
+            {
+              UnOp* uo = e->cast<UnOp>();
+              if (uo->decl() && !dt.pure(uo->decl()))
+                return false;
+              return shapeOnly(uo->e());
+            }
+          case Expression::E_CALL:
+            {
+              Call* c = e->cast<Call>();
+              if (c->decl()==NULL || isImpureBuiltin(c->id()) || !dt.pure(c->decl()))
+                return false;
+              if (isBoundsFn(c->id()) && c->args().size()==1 && isParam(c->args()[0]) &&
+                  c->args()[0]->type().isvar()) {
+                if (boundsCallSet.insert(c).second)
+                  boundsCalls.push_back(c);
+                return true;
+              }
+              bool indexSets = isIndexSetFn(c->id());
+              for (unsigned int i=0; i<c->args().size(); i++)
+                if (!(indexSets && isParam(c->args()[i])) && !shapeOnly(c->args()[i]))
+                  return false;
+              return true;
+            }
+          default:
+            return false;
+        }
+      }
+      /// Whether evaluating \a e once saves any work
+      bool worthwhile(Expression* e) {
+        return !isLiteral(e) && !e->isa<Id>();
+      }
+      void collect(Expression* e) {
+        if (e==NULL)
+          return;
+        if (worthwhile(e) && shapeOnly(e)) {
+          shapeExps.push_back(e);
+          return;
+        }
+        switch (e->eid()) {
+          case Expression::E_SETLIT:
+            for (unsigned int i=0; i<e->cast<SetLit>()->v().size(); i++)
+              collect(e->cast<SetLit>()->v()[i]);
+            break;
+          case Expression::E_ARRAYLIT:
+            for (unsigned int i=0; i<e->cast<ArrayLit>()->v().size(); i++)
+              collect(e->cast<ArrayLit>()->v()[i]);
+            break;
+          case Expression::E_ARRAYACCESS:
+            collect(e->cast<ArrayAccess>()->v());
+            for (unsigned int i=0; i<e->cast<ArrayAccess>()->idx().size(); i++)
+              collect(e->cast<ArrayAccess>()->idx()[i]);
+            break;
+          case Expression::E_COMP:
+            {
+              Comprehension* comp = e->cast<Comprehension>();
+              for (int i=0; i<comp->n_generators(); i++)
+                collect(comp->in(i));
+              collect(comp->where());
+              collect(comp->e());
+            }
+            break;
+          case Expression::E_ITE:
+            {
+              ITE* ite = e->cast<ITE>();
+              for (int i=0; i<ite->size(); i++) {
+                collect(ite->e_if(i));
+                collect(ite->e_then(i));
+              }
+              collect(ite->e_else());
+            }
+            break;
+          case Expression::E_BINOP:
+            collect(e->cast<BinOp>()->lhs());
+            collect(e->cast<BinOp>()->rhs());
+            break;
+          case Expression::E_UNOP:
+            collect(e->cast<UnOp>()->e());
+            break;
+          case Expression::E_CALL:
+            for (unsigned int i=0; i<e->cast<Call>()->args().size(); i++)
+              collect(e->cast<Call>()->args()[i]);
+            break;
+          case Expression::E_LET:
+            {
+              Let* let = e->cast<Let>();
+              for (unsigned int i=0; i<let->let().size(); i++) {
+                if (VarDecl* vd = let->let()[i]->dyn_cast<VarDecl>()) {
+                  collect(vd->ti());
+                  if (vd->e() && vd->type().ispar() && shapeOnly(vd->e())) {
+                    shape.insert(vd);
+                    if (worthwhile(vd->e()))
+                      shapeExps.push_back(vd->e());
+                  } else {
+                    collect(vd->e());
+                  }
+                } else {
+                  collect(let->let()[i]);
+                }
+              }
+              collect(let->in());
+            }
+            break;
+          case Expression::E_TI:
+            {
+              TypeInst* ti = e->cast<TypeInst>();
+              for (unsigned int i=0; i<ti->ranges().size(); i++)
+                collect(ti->ranges()[i]);
+              collect(ti->domain());
+            }
+            break;
+          default:
+            break;
+        }
+      }
+    };
+
+  }
+
+  bool
+  DecompositionTemplates::pure(FunctionI* fi) {
+    UNORDERED_NAMESPACE::unordered_map<FunctionI*,bool>::iterator it = _pure.find(fi);
+    if (it != _pure.end())
+      return it->second;
+    if (fi->e()==NULL)
+      return _pure[fi] = !isImpureBuiltin(fi->id());
+    // Assume recursive calls are pure while scanning the body
+    _pure[fi] = true;
+    ScanBody sb(*this);
+    topDown(sb, fi->e());
+    return _pure[fi] = !sb.impure;
+  }
+
+  bool
+  DecompositionTemplates::KeyEq::operator()(const Key& k0, const Key& k1) const {
+    if (k0.hash != k1.hash || k0.bounds != k1.bounds)
+      return false;
+    for (unsigned int i=0; i<k0.values.size(); i++)
+      if (!Expression::equal(k0.values[i](), k1.values[i]()))
+        return false;
+    return true;
+  }
+
+  void
+  DecompositionTemplates::analyse(EnvI& env, FunctionI* decl, FnInfo& info) {
+    for (unsigned int i=0; i<decl->params().size(); i++) {
+      VarDecl* p = decl->params()[i];
+      Type t = p->type();
+      // Polymorphic parameters may be par or var
+      bool poly = p->ti()->domain() && p->ti()->domain()->isa<TIId>();
+      for (unsigned int j=0; j<p->ti()->ranges().size(); j++)
+        poly = poly || (p->ti()->ranges()[j]->domain() && p->ti()->ranges()[j]->domain()->isa<TIId>());
+      if (poly || t.isann() || t.isopt() || t.bt()==Type::BT_TOP || t.bt()==Type::BT_BOT)
+        return;
+    }
+    ShapeAnalysis sa(*this, decl);
+    sa.collect(decl->e());
+    if (sa.shapeExps.empty())
+      return;
+    ScanBody sb(*this);
+    topDown(sb, decl->e());
+    std::unordered_set<VarDecl*> outer;
+    for (unsigned int i=0; i<sb.referenced.size(); i++) {
+      VarDecl* vd = sb.referenced[i];
+      if (sb.declared.find(vd)==sb.declared.end() && outer.insert(vd).second)
+        info.outerDecls.push_back(vd);
+    }
+    info.shapeExps = sa.shapeExps;
+    info.boundsCalls = sa.boundsCalls;
+    info.enabled = true;
+  }
+
+  bool
+  DecompositionTemplates::key(EnvI& env, FunctionI* decl, const FnInfo& info, Key& k) {
+    HASH_NAMESPACE::hash<long long int> h;
+    k.hash = 0;
+    for (unsigned int i=0; i<decl->params().size(); i++) {
+      VarDecl* p = decl->params()[i];
+      Expression* arg = p->e();
+      if (arg==NULL)
+        return false;
+      if (p->type().ispar()) {
+        Expression* v = follow_id(arg);
+        if (v==NULL || v->isa<Id>())
+          return false;
+        k.values.push_back(v);
+        k.hash ^= Expression::hash(v) + 0x9e3779b9 + (k.hash << 6) + (k.hash >> 2);
+      } else if (p->type().dim() > 0) {
+        ArrayLit* al = follow_id(arg)->dyn_cast<ArrayLit>();
+        if (al==NULL)
+          return false;
+        for (int j=0; j<al->dims(); j++) {
+          k.bounds.push_back(al->min(j));
+          k.bounds.push_back(al->max(j));
+          k.hash ^= h(al->min(j)) + 0x9e3779b9 + (k.hash << 6) + (k.hash >> 2);
+          k.hash ^= h(al->max(j)) + 0x9e3779b9 + (k.hash << 6) + (k.hash >> 2);
+        }
+      }
+    }
+    for (unsigned int i=0; i<info.boundsCalls.size(); i++) {
+      Expression* v;
+      try {
+        v = eval_par(env, info.boundsCalls[i]);
+      } catch (Exception&) {
+        return false;
+      }
+      if (v==NULL)
+        return false;
+      k.values.push_back(v);
+      k.hash ^= Expression::hash(v) + 0x9e3779b9 + (k.hash << 6) + (k.hash >> 2);
+    }
+    return true;
+  }
+
+  Expression*
+  DecompositionTemplates::instantiate(EnvI& env, FunctionI* decl) {
+    UNORDERED_NAMESPACE::unordered_map<FunctionI*,FnInfo>::iterator it = _fns.find(decl);
+    if (it==_fns.end()) {
+      it = _fns.insert(std::make_pair(decl, FnInfo())).first;
+      if (env.decompositionTemplates)
+        analyse(env, decl, it->second);
+    }
+    FnInfo& info = it->second;
+    info.active++;
+    if (!info.enabled)
+      return decl->e();
+
+    GCLock lock;
+    Key k;
+    if (!key(env, decl, info, k)) {
+      ++env.n_template_misses;
+      return decl->e();
+    }
+    Template& t = info.templates[k];
+    if (t.body()) {
+      ++env.n_template_hits;
+      ++info.n_hits;
+      return t.body();
+    }
+    ++env.n_template_misses;
+    ++t.n;
+    if (info.n_hits==0 && info.templates.size() > maxUnusedShapes) {
+      // Calls of this function hardly ever have the same shape
+      info.enabled = false;
+      info.templates.clear();
+      return decl->e();
+    }
+    // Only build a template for a shape that occurs repeatedly, and not
+    // while the body is being flattened further up (its let-bound
+    // variables would be bound then)
+    if (t.n < 2 || info.n_templates >= maxTemplates || info.active > 1)
+      return decl->e();
+
+    CopyMap cm;
+    for (unsigned int i=0; i<info.outerDecls.size(); i++)
+      cm.insert(info.outerDecls[i], info.outerDecls[i]);
+    for (unsigned int i=0; i<decl->params().size(); i++)
+      cm.insert(decl->params()[i], decl->params()[i]);
+    for (unsigned int i=0; i<info.shapeExps.size(); i++) {
+      Expression* e = info.shapeExps[i];
+      try {
+        Expression* v = eval_par(env, e);
+        if (v != NULL && v != e)
+          cm.insert(e, v);
+      } catch (Exception&) {
+        // Keep the expression, so that evaluating it fails (or not) just
+        // like for the original body
+      }
+    }
+    t.body = copy(env, cm, decl->e());
+    info.n_templates++;
+    return t.body();
+  }
+
+  void
+  DecompositionTemplates::release(FunctionI* decl) {
+    UNORDERED_NAMESPACE::unordered_map<FunctionI*,FnInfo>::iterator it = _fns.find(decl);
+    if (it != _fns.end())
+      it->second.active--;
+  }
+
+}
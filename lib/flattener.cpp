@@ -19,6 +19,13 @@
 #include <minizinc/flattener.hh>
 #include <fstream>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
 using namespace std;
 using namespace MiniZinc;
 
@@ -50,15 +57,29 @@ void Flattener::printHelp(ostream& os)
   << "  -e, --model-check-only\n    Check the model (without requiring data) for errors, but do not\n    convert to FlatZinc." << std::endl
   << "  --model-interface-only\n    Only extract parameters and output variables." << std::endl
   << "  --no-optimize\n    Do not optimize the FlatZinc" << std::endl
+  << "  --hashcons\n    Put flat constraints into canonical form (argument order of commutative\n    builtins, order of linear terms) so that equal ones are created only once" << std::endl
+  << "  --merge-linear\n    When optimizing, remove linear constraints that are dominated by or\n    duplicate others, and turn those on a single variable into bounds" << std::endl
+  << "  --decomposition-templates\n    Specialise the bodies of predicates and functions for the shape of their\n    arguments, and reuse the specialisation for calls of the same shape" << std::endl
   // \n    Currently does nothing (only available for compatibility with 1.6)
   << "  -d <file>, --data <file>\n    File named <file> contains data used by the model." << std::endl
   << "  -D <data>, --cmdline-data <data>\n    Include the given data assignment in the model." << std::endl
   << "  --stdlib-dir <dir>\n    Path to MiniZinc standard library directory" << std::endl
   << "  -G --globals-dir --mzn-globals-dir <dir>\n    Search for included globals in <stdlib>/<dir>." << std::endl
   << "  - --input-from-stdin\n    Read problem from standard input" << std::endl
+  << "  --json-data-from-stdin\n    Read JSON data from standard input (streamed)" << std::endl
+  << "  --typecheck-threads <n>\n    Scan large data arrays with <n> threads during type checking" << std::endl
   << "  -I --search-dir\n    Additionally search for included files in <dir>." << std::endl
   << "  -D \"fMIPdomains=false\"\n    No domain unification for MIP" << std::endl
   << "  --only-range-domains\n    When no MIPdomains: all domains contiguous, holes replaced by inequalities" << std::endl
+  << "  --MIPdomains-threads <n>\n    Analyse the variable cliques of MIPdomains with <n> threads" << std::endl
+  << "  --gc-page-size <n>\n    Allocate the flattener's heap in pages of <n> KB (default 1024)" << std::endl
+  << "  --gc-mmap\n    Reserve heap pages in large regions with mmap instead of malloc" << std::endl
+  << "  --gc-huge-pages\n    Ask for transparent huge pages for the heap (implies --gc-mmap)" << std::endl
+  << "  --gc-release-pages\n    Give heap pages without live nodes back after each garbage collection" << std::endl
+  << "  --fzn-cache <dir>\n    Reuse the FlatZinc and output model cached in <dir> if the model, data and\n    options have been flattened before, otherwise add them to the cache" << std::endl
+  << "  --fzn-cache-size <n>\n    Limit the size of the flattening cache to <n> MB (default 1024)" << std::endl
+  << "  --batch\n    Treat each data file as a separate instance: parse and type check the model\n    once, then flatten (and solve) it for each data file. The outputs go to\n    <output-base>_<data file>.fzn/.ozn (and .sol when solving). -D data is\n    shared by all instances. Not available on Windows." << std::endl
+  << "  --batch-jobs <n>\n    Process up to <n> batch instances in parallel (default 1)" << std::endl
   << std::endl;
   os
   << "Flattener output options:" << std::endl
@@ -121,14 +142,20 @@ bool Flattener::processOption(int& i, const int argc, const char** argv)
       goto error;
     }
   } else if ( cop.getOption( "- --input-from-stdin" ) ) {
-      if (datafiles.size() > 0 || filenames.size() > 0)
+      if (datafiles.size() > 0 || filenames.size() > 0 || flag_stdinJSONData)
         goto error;
       flag_stdinInput = true;
+  } else if ( cop.getOption( "--json-data-from-stdin" ) ) {
+      if (flag_stdinInput)
+        goto error;
+      flag_stdinJSONData = true;
   } else if ( cop.getOption( "-d --data", &buffer ) ) {
     if (flag_stdinInput)
       goto error;
-    if ( buffer.length()<=4 ||
-         buffer.substr(buffer.length()-4,string::npos) != ".dzn")
+    if ( !( (buffer.length()>4 &&
+             buffer.substr(buffer.length()-4,string::npos) == ".dzn") ||
+            (buffer.length()>5 &&
+             buffer.substr(buffer.length()-5,string::npos) == ".json") ) )
       goto error;
     datafiles.push_back(buffer);
   } else if ( cop.getOption( "--stdlib-dir", &std_lib_dir ) ) {
@@ -137,8 +164,38 @@ bool Flattener::processOption(int& i, const int argc, const char** argv)
     if (flag_stdinInput)
       goto error;
     datafiles.push_back("cmd:/"+buffer);
+  } else if ( cop.getOption( "--typecheck-threads", &flag_typecheck_threads ) ) {
+    if (flag_typecheck_threads < 1)
+      goto error;
   } else if ( cop.getOption( "--only-range-domains" ) ) {
     flag_only_range_domains = true;
+  } else if ( cop.getOption( "--hashcons" ) ) {
+    flag_hashcons = true;
+  } else if ( cop.getOption( "--decomposition-templates" ) ) {
+    flag_decomposition_templates = true;
+  } else if ( cop.getOption( "--merge-linear" ) ) {
+    flag_merge_linear = true;
+  } else if ( cop.getOption( "--MIPdomains-threads", &flag_MIPdomains_threads ) ) {
+    if (flag_MIPdomains_threads < 1)
+      goto error;
+  } else if ( cop.getOption( "--gc-page-size", &flag_gc_page_size ) ) {
+    if (flag_gc_page_size < 4)
+      goto error;
+  } else if ( cop.getOption( "--gc-mmap" ) ) {
+    flag_gc_mmap = true;
+  } else if ( cop.getOption( "--gc-huge-pages" ) ) {
+    flag_gc_huge_pages = true;
+  } else if ( cop.getOption( "--gc-release-pages" ) ) {
+    flag_gc_release_pages = true;
+  } else if ( cop.getOption( "--fzn-cache-size", &flag_fzn_cache_size ) ) {
+    if (flag_fzn_cache_size < 1)
+      goto error;
+  } else if ( cop.getOption( "--fzn-cache", &flag_fzn_cache ) ) {
+  } else if ( cop.getOption( "--batch" ) ) {
+    flag_batch = true;
+  } else if ( cop.getOption( "--batch-jobs", &flag_batch_jobs ) ) {
+    if (flag_batch_jobs < 1)
+      goto error;
   } else if ( cop.getOption( "--no-MIPdomains" ) ) {   // internal
     flag_noMIPdomains = true;
   } else if ( cop.getOption( "-Werror" ) ) {
@@ -202,6 +259,18 @@ void Flattener::flatten()
   if (flag_verbose)
     printVersion(cerr);
 
+  if (flag_statistics)
+    GC::trackStats(true);
+  if (flag_gc_page_size || flag_gc_mmap || flag_gc_huge_pages || flag_gc_release_pages) {
+    GCPageOptions gcOpts;
+    if (flag_gc_page_size)
+      gcOpts.pageSize = static_cast<size_t>(flag_gc_page_size) << 10;
+    gcOpts.mmapRegions = flag_gc_mmap || flag_gc_huge_pages;
+    gcOpts.hugePages = flag_gc_huge_pages;
+    gcOpts.releasePages = flag_gc_release_pages;
+    GC::pageOptions(gcOpts);
+  }
+
   // controlled from redefs and command line:
 //   if (beginswith(globals_dir, "linear")) {
 //     flag_only_range_domains = true;
@@ -213,6 +282,20 @@ void Flattener::flatten()
     throw runtime_error( "Error: no model file given." );
   }
 
+  if (flag_batch) {
+#ifdef _WIN32
+    std::cerr << "Error: batch mode is not available on this platform." << std::endl;
+    std::exit(EXIT_FAILURE);
+#endif
+    if (flag_stdinInput || flag_stdinJSONData || is_flatzinc || !flag_typecheck ||
+        flag_instance_check_only || flag_model_check_only || flag_model_interface_only ||
+        flag_output_fzn_stdout || flag_output_ozn_stdout) {
+      std::cerr << "Error: batch mode needs a model file and cannot be combined with input from\n"
+        << "standard input, output to standard output, or checking only." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
   if (std_lib_dir=="") {
     std::string mypath = FileUtils::progpath();
     if (!mypath.empty()) {
@@ -301,18 +384,84 @@ void Flattener::flatten()
             std::cerr << ", '" << sFln << '\'';
           std::cerr << " ..." << std::endl;
         }
-        m = parse(env, filenames, datafiles, includePaths, flag_ignoreStdlib, false, flag_verbose, errstream);
+        std::vector<std::string> sharedData;
+        for (const auto& sFln: datafiles)
+          if (!flag_batch || sFln.compare(0, 5, "cmd:/")==0)
+            sharedData.push_back(sFln);
+        m = parse(env, filenames, sharedData, includePaths, flag_ignoreStdlib, false, flag_verbose, errstream);
+      }
+      if (m && flag_stdinJSONData) {
+        GCLock lock;
+        if (flag_verbose)
+          std::cerr << "Parsing JSON data from standard input ..." << endl;
+        JSONParser jp(env.envi());
+        jp.parse(m, std::cin, "stdin");
+      }
+      std::unique_ptr<FlatteningCache> cache;
+      std::string cacheKey;
+      bool fromCache = false;
+      if (m && flag_fzn_cache != "" && !flag_batch && !flag_stdinInput && !flag_stdinJSONData && !is_flatzinc &&
+          flag_typecheck && !flag_instance_check_only && !flag_model_check_only &&
+          !flag_model_interface_only) {
+        if (!FileUtils::directory_exists(flag_fzn_cache)) {
+          std::cerr << "  WARNING: cannot access cache directory '" << flag_fzn_cache << "'." << std::endl;
+        } else {
+          cache.reset(new FlatteningCache(flag_fzn_cache,
+                                          static_cast<unsigned long long>(flag_fzn_cache_size) << 20));
+          std::ostringstream options;
+          options << MZN_VERSION_MAJOR << "." << MZN_VERSION_MINOR << "." << MZN_VERSION_PATCH
+                  << " " << __DATE__ << " " << __TIME__
+                  << " ignoreStdlib=" << flag_ignoreStdlib << " newfzn=" << flag_newfzn
+                  << " optimize=" << flag_optimize << " onlyRangeDomains=" << flag_only_range_domains
+                  << " noMIPdomains=" << flag_noMIPdomains << " hashcons=" << flag_hashcons
+                  << " decompositionTemplates=" << flag_decomposition_templates
+                  << " mergeLinear=" << flag_merge_linear
+                  << " outputMode=" << flag_output_mode;
+          cacheKey = cache->key(m, datafiles, options.str());
+          std::string cachedFzn;
+          std::string cachedOzn;
+          if (cache->lookup(cacheKey, cachedFzn, cachedOzn)) {
+            if (flag_verbose)
+              std::cerr << "Reading cached FlatZinc '" << cachedFzn << "'" << std::endl;
+            delete m;
+            // Typecheck the output model as the current model, then move it into place
+            Model* om = parse(env, vector<string>(1, cachedOzn), vector<string>(), includePaths,
+                              flag_ignoreStdlib, false, false, errstream);
+            m = om ? parse(env, vector<string>(1, cachedFzn), vector<string>(), includePaths,
+                           flag_ignoreStdlib, false, false, errstream) : NULL;
+            if (om) {
+              vector<TypeError> typeErrors;
+              env.model(om);
+              // Output parameters are only assigned by solutions
+              MiniZinc::typecheck(env, om, typeErrors, true);
+              if (typeErrors.size() > 0)
+                throw InternalError("cannot typecheck cached output model "+cachedOzn);
+              MiniZinc::registerBuiltins(env, om);
+              env.envi().swap_output();
+              delete env.model();
+            }
+            is_flatzinc = true;
+            fromCache = true;
+          }
+        }
       }
       if (m) {
         env.model(m);
 //         pModel.reset(m);   // seems to be unnec
-        if (flag_typecheck) {
+        if (flag_batch) {
           if (flag_verbose)
             std::cerr << " done parsing (" << stoptime(lasttime) << ")" << std::endl;
+          forkBatch(env, m);
+          m = env.model();
+        }
+        if (flag_typecheck && !batch_typechecked) {
+          if (flag_verbose && !flag_batch)
+            std::cerr << " done parsing (" << stoptime(lasttime) << ")" << std::endl;
           if (flag_verbose)
             std::cerr << "Typechecking ...";
           vector<TypeError> typeErrors;
-          MiniZinc::typecheck(env, m, typeErrors, flag_model_check_only || flag_model_interface_only);
+          MiniZinc::typecheck(env, m, typeErrors, flag_model_check_only || flag_model_interface_only,
+                              flag_typecheck_threads);
           if (typeErrors.size() > 0) {
             for (unsigned int i=0; i<typeErrors.size(); i++) {
               if (flag_verbose)
@@ -325,6 +474,8 @@ void Flattener::flatten()
           MiniZinc::registerBuiltins(env, m);
           if (flag_verbose)
             std::cerr << " done (" << stoptime(lasttime) << ")" << std::endl;
+        }
+        if (flag_typecheck) {
 
           if (flag_model_interface_only) {
             MiniZinc::output_model_interface(env, m, std::cout);
@@ -334,7 +485,22 @@ void Flattener::flatten()
             if (is_flatzinc) {
               GCLock lock;
               env.swap();
-              populateOutput(env);
+              if (fromCache) {
+                // Keep the library includes out of the printed models, but alive
+                // with the (now empty) original model
+                Model* models[] = { env.flat(), env.envi().output };
+                for (Model* cm : models) {
+                  for (unsigned int i=0; i<cm->size(); i++) {
+                    if (IncludeI* ii = (*cm)[i]->dyn_cast<IncludeI>()) {
+                      env.model()->addItem(ii);
+                      ii->remove();
+                    }
+                  }
+                  cm->compact();
+                }
+              } else {
+                populateOutput(env);
+              }
             } else {
               if (flag_verbose)
                 std::cerr << "Flattening ...";
@@ -342,6 +508,9 @@ void Flattener::flatten()
               try {
                 fopts.onlyRangeDomains = flag_only_range_domains;
                 fopts.outputMode = flag_output_mode;
+                fopts.hashCons = flag_hashcons;
+                fopts.decompositionTemplates = flag_decomposition_templates;
+                fopts.mergeLinear = flag_merge_linear;
                 ::flatten(env,fopts);
               } catch (LocationException& e) {
                 if (flag_verbose)
@@ -357,6 +526,8 @@ void Flattener::flatten()
               if (flag_werror && env.warnings().size() > 0) {
                 exit(EXIT_FAILURE);
               }
+              // Flattening warnings would not be repeated for a cached model
+              bool cacheable = env.warnings().empty();
               env.clearWarnings();
               //            Model* flat = env.flat();
               if (flag_verbose)
@@ -366,7 +537,7 @@ void Flattener::flatten()
               if ( ! flag_noMIPdomains ) {
                 if (flag_verbose)
                   std::cerr << "MIP domains ...";
-                MIPdomains(env, flag_statistics);
+                MIPdomains(env, flag_statistics, flag_MIPdomains_threads);
                 if (flag_verbose)
                   std::cerr << " done (" << stoptime(lasttime) << ")" << std::endl;
               }
@@ -395,8 +566,13 @@ void Flattener::flatten()
                 env.flat()->compact();
                 env.output()->compact();
               }
+              if (cache && cacheable && env.warnings().empty() && !env.envi().failed())
+                cache->store(cacheKey, env);
             }
 
+            if (cache && (flag_verbose || flag_statistics))
+              cache->printStatistics(std::cerr);
+
             if (flag_statistics) {
               FlatModelStatistics stats = statistics(env);
               std::cerr << "Generated FlatZinc statistics:\n";
@@ -418,6 +594,21 @@ void Flattener::flatten()
               if (!ho)
                 std::cerr << "none";
               std::cerr << "\n";
+              if (stats.n_cse_hits || stats.n_hashcons_reordered) {
+                std::cerr << "Common subexpressions: " << stats.n_cse_hits << " reused";
+                if (flag_hashcons)
+                  std::cerr << ", " << stats.n_hashcons_reordered << " calls canonicalised";
+                std::cerr << "\n";
+              }
+              if (stats.n_template_hits || stats.n_template_misses) {
+                std::cerr << "Decomposition templates: " << stats.n_template_hits << " hits, "
+                          << stats.n_template_misses << " misses\n";
+              }
+              if (stats.n_linear_dominated || stats.n_linear_duplicates || stats.n_linear_bounds) {
+                std::cerr << "Linear constraints removed: " << stats.n_linear_dominated << " dominated, "
+                          << stats.n_linear_duplicates << " duplicate equalities, "
+                          << stats.n_linear_bounds << " turned into bounds\n";
+              }
               /// Objective+bounds / SAT
               SolveI* solveItem = env.flat()->solveItem();
               if (solveItem->st() != SolveI::SolveType::ST_SAT) {
@@ -431,6 +622,7 @@ void Flattener::flatten()
               } else {
                 cerr << "    This is a satisfiability problem." << endl;
               }
+              GC::printStats(std::cerr);
             }
 
             if (flag_output_fzn_stdout) {
@@ -527,6 +719,122 @@ void Flattener::flatten()
   }
 }
 
+void Flattener::forkBatch(Env& env, Model* m)
+{
+#ifndef _WIN32
+  std::vector<std::string> instances;
+  for (const auto& sFln: datafiles)
+    if (sFln.compare(0, 5, "cmd:/")!=0)
+      instances.push_back(sFln);
+  if (instances.empty()) {
+    std::cerr << "Error: batch mode needs at least one data file." << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  // Enums defined by data change the model itself, so those are
+  // type checked for each instance
+  class DataEnums : public ItemVisitor {
+  public:
+    bool found = false;
+    void vVarDeclI(VarDeclI* vdi) {
+      if (vdi->e()->ti()->isEnum() && vdi->e()->e()==NULL)
+        found = true;
+    }
+  } dataEnums;
+  iterItems(dataEnums, m);
+  if (!dataEnums.found) {
+    if (flag_verbose)
+      std::cerr << "Typechecking ...";
+    vector<TypeError> typeErrors;
+    MiniZinc::typecheck(env, m, typeErrors, true, flag_typecheck_threads);
+    if (typeErrors.size() > 0) {
+      for (unsigned int i=0; i<typeErrors.size(); i++) {
+        if (flag_verbose)
+          std::cerr << std::endl;
+        std::cerr << typeErrors[i].loc() << ":" << std::endl;
+        std::cerr << typeErrors[i].what() << ": " << typeErrors[i].msg() << std::endl;
+      }
+      exit(EXIT_FAILURE);
+    }
+    MiniZinc::registerBuiltins(env, m);
+    if (flag_verbose)
+      std::cerr << " done (" << stoptime(lasttime) << ")" << std::endl;
+  }
+
+  // The instances share the type checked model copy-on-write
+  std::cout << std::flush;
+  std::cerr << std::flush;
+  std::map<pid_t,std::string> running;
+  int nFailed = 0;
+  auto waitOne = [&]() {
+    int status;
+    pid_t pid = wait(&status);
+    if (pid == -1)
+      return;
+    if (!WIFEXITED(status) || WEXITSTATUS(status)!=0) {
+      std::cerr << "  Batch instance '" << running[pid] << "' failed." << std::endl;
+      ++nFailed;
+    } else if (flag_verbose) {
+      std::cerr << "  Batch instance '" << running[pid] << "' done." << std::endl;
+    }
+    running.erase(pid);
+  };
+  for (unsigned int i=0; i<instances.size(); i++) {
+    while (running.size() >= static_cast<size_t>(flag_batch_jobs))
+      waitOne();
+    pid_t pid = fork();
+    if (pid == -1) {
+      std::cerr << "Error: cannot fork a process for batch instance '" << instances[i] << "'." << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+      std::string stem = instances[i].substr(instances[i].find_last_of("/\\")+1);
+      stem = stem.substr(0, stem.find_last_of('.'));
+      std::string base = flag_output_base+"_"+stem;
+      if (flag_output_fzn != "")
+        flag_output_fzn = base+".fzn";
+      if (flag_output_ozn != "")
+        flag_output_ozn = base+".ozn";
+      if (!fOutputByDefault) {
+        // Solutions of the instance
+        int fd = open((base+".sol").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1 || dup2(fd, STDOUT_FILENO) == -1) {
+          std::cerr << "Error: cannot write solution file '" << base << ".sol'." << std::endl;
+          std::_Exit(EXIT_FAILURE);
+        }
+        close(fd);
+      }
+      Model* md = parseData(env, m, vector<string>(1, instances[i]), includePaths,
+                            true, false, flag_verbose, std::cerr);
+      if (md == NULL)
+        std::exit(EXIT_FAILURE);
+      if (!dataEnums.found) {
+        vector<TypeError> typeErrors;
+        MiniZinc::typecheck_data(env, m, typeErrors);
+        if (typeErrors.size() > 0) {
+          for (unsigned int i=0; i<typeErrors.size(); i++) {
+            std::cerr << typeErrors[i].loc() << ":" << std::endl;
+            std::cerr << typeErrors[i].what() << ": " << typeErrors[i].msg() << std::endl;
+          }
+          exit(EXIT_FAILURE);
+        }
+        batch_typechecked = true;
+      }
+      return;
+    }
+    running[pid] = instances[i];
+  }
+  while (!running.empty())
+    waitOne();
+  if (flag_verbose)
+    std::cerr << "Batch of " << instances.size() << " instances done, "
+              << nFailed << " failed." << std::endl;
+  std::exit(nFailed ? EXIT_FAILURE : EXIT_SUCCESS);
+#else
+  assert(false);
+#endif
+}
+
 void Flattener::printStatistics(ostream&)
 {
 }
@@ -17,11 +17,15 @@
 
 #include <vector>
 #include <cstring>
+#include <cstddef>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
 
-//#define MINIZINC_GC_STATS
-
-#if defined(MINIZINC_GC_STATS)
-#include <map>
+#ifdef HAS_MMAP
+#include <sys/mman.h>
 #endif
 
 namespace MiniZinc {
@@ -53,59 +57,152 @@ namespace MiniZinc {
 
   class FreeListNode : public ASTNode {
   public:
+    /// Size of the node (fills the node header)
+    unsigned int size;
     FreeListNode* next;
-    size_t size;
     FreeListNode(size_t s, FreeListNode* n)
       : ASTNode(ASTNode::NID_FL)
-      , next(n)
-      , size(s) {
+      , size(static_cast<unsigned int>(s))
+      , next(n) {
       _gc_mark = 1;
     }
-    FreeListNode(size_t s) : ASTNode(ASTNode::NID_FL), next(NULL), size(s) {}
+    FreeListNode(size_t s)
+      : ASTNode(ASTNode::NID_FL), size(static_cast<unsigned int>(s)), next(NULL) {}
+  };
+
+  /// Source of the memory for heap pages that are at least a standard page
+  class PageProvider {
+  public:
+    virtual ~PageProvider(void) {}
+    /// Return \a s bytes of memory, or NULL
+    virtual void* alloc(size_t s) = 0;
+    /// Give back memory \a p of \a s bytes obtained from alloc
+    virtual void free(void* p, size_t s) = 0;
+  };
+
+#ifdef HAS_MMAP
+  /// Carves standard pages out of large regions reserved with mmap.
+  /// Freed standard pages are kept for reuse (after returning their memory
+  /// to the OS if requested), larger pages are mapped individually.
+  class MmapPageProvider : public PageProvider {
+  protected:
+    /// Alignment of regions, so that they can be backed by huge pages
+    static const size_t regionAlign = 2<<20;
+    /// Size of a standard page in the regions
+    size_t _unit;
+    /// Size of a region
+    size_t _regionSize;
+    bool _hugePages;
+    bool _release;
+    /// Unused part of the current region
+    char* _cur;
+    char* _end;
+    /// Freed standard pages
+    std::vector<void*> _freePages;
+    /// All regions, unmapped when the provider is destroyed
+    std::vector<char*> _regions;
+    static size_t roundUp(size_t s, size_t a) { return (s+a-1)/a*a; }
+    /// Map \a s bytes aligned to \a align
+    void* map(size_t s, size_t align) {
+      int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+      flags |= MAP_NORESERVE;
+#endif
+      void* p = mmap(NULL, s+align, PROT_READ | PROT_WRITE, flags, -1, 0);
+      if (p==MAP_FAILED)
+        return NULL;
+      char* c = static_cast<char*>(p);
+      char* a = reinterpret_cast<char*>(roundUp(reinterpret_cast<size_t>(c), align));
+      if (a > c)
+        munmap(c, a-c);
+      if (c+align > a)
+        munmap(a+s, c+align-a);
+#ifdef MADV_HUGEPAGE
+      if (_hugePages)
+        madvise(a, s, MADV_HUGEPAGE);
+#endif
+      return a;
+    }
+  public:
+    MmapPageProvider(size_t pageBytes, bool hugePages, bool release)
+      : _unit(roundUp(pageBytes, 4096))
+      , _regionSize(roundUp(32*_unit, regionAlign))
+      , _hugePages(hugePages)
+      , _release(release)
+      , _cur(NULL)
+      , _end(NULL) {}
+    virtual ~MmapPageProvider(void) {
+      for (unsigned int i=0; i<_regions.size(); i++)
+        munmap(_regions[i], _regionSize);
+    }
+    virtual void* alloc(size_t s) {
+      if (s > _unit)
+        return map(roundUp(s, 4096), _hugePages ? regionAlign : 4096);
+      if (!_freePages.empty()) {
+        void* p = _freePages.back();
+        _freePages.pop_back();
+        return p;
+      }
+      if (_cur+_unit > _end) {
+        _cur = static_cast<char*>(map(_regionSize, regionAlign));
+        if (_cur==NULL) {
+          _end = NULL;
+          return NULL;
+        }
+        _end = _cur+_regionSize;
+        _regions.push_back(_cur);
+      }
+      void* p = _cur;
+      _cur += _unit;
+      return p;
+    }
+    virtual void free(void* p, size_t s) {
+      if (s > _unit) {
+        munmap(p, roundUp(s, 4096));
+      } else {
+        if (_release)
+          madvise(p, _unit, MADV_DONTNEED);
+        _freePages.push_back(p);
+      }
+    }
   };
+#endif
 
   class HeapPage {
   public:
     HeapPage* next;
+    /// Where the memory of the page comes from (NULL for malloc)
+    PageProvider* provider;
     size_t size;
     size_t used;
+    /// Whether the page holds a single node allocated exactly
+    /// (a full word, so that data stays aligned)
+    size_t exact;
     char data[1];
-    HeapPage(HeapPage* n, size_t s) : next(n), size(s), used(0) {}
+    HeapPage(HeapPage* n, PageProvider* pp, size_t s, bool e)
+      : next(n), provider(pp), size(s), used(0), exact(e) {}
   };
 
   /// Memory managed by the garbage collector
   class GC::Heap {
     friend class GC;
-#if defined(MINIZINC_GC_STATS)
-    static const char* _nodeid[Item::II_END+1];
-    struct GCStat {
-      int first;
-      int second;
-      int keepalive;
-      int inmodel;
-      size_t total;
-      GCStat(void) : first(0), second(0), keepalive(0), inmodel(0), total(0) {}
-    };
-    std::map<int,GCStat> gc_stats;
-#endif
   protected:
     HeapPage* _page;
     Model* _rootset;
     KeepAlive* _roots;
     WeakRef* _weakRefs;
     ASTNodeWeakMap* _nodeWeakMaps;
-    static const int _max_fl = 5;
+    static const int _max_fl = 10;
+    static_assert(_max_fl+1 == GCHeapInfo::n_freeLists, "GCHeapInfo::n_freeLists must match the free lists");
     FreeListNode* _fl[_max_fl+1];
     static const size_t _fl_size[_max_fl+1];
     int _fl_slot(size_t _size) {
       size_t size = _size;
       assert(size <= _fl_size[_max_fl]);
       assert(size >= _fl_size[0]);
-      size -= sizeof(Item);
       assert(size % sizeof(void*) == 0);
       size /= sizeof(void*);
-      assert(size >= 1);
-      int slot = static_cast<int>(size)-1;
+      int slot = static_cast<int>(size)-2;
       return slot;
     }
 
@@ -117,6 +214,18 @@ namespace MiniZinc {
     size_t _gc_threshold;
     /// High water mark of all allocated memory
     size_t _max_alloced_mem;
+    /// Whether statistics are collected
+    bool _trackStats;
+    /// Chunks of the LocationTable used by live nodes, filled by sweep()
+    std::vector<bool> _liveLocations;
+    /// Statistics, valid if _trackStats
+    GCStats _stats;
+    /// Page options
+    GCPageOptions _pageOpts;
+    /// Provider for pages of at least the standard size (NULL for malloc)
+    PageProvider* _provider;
+    /// All providers created so far, pages may still refer to old ones
+    std::vector<PageProvider*> _providers;
 
     /// A trail item
     struct TItem {
@@ -138,30 +247,41 @@ namespace MiniZinc {
       , _alloced_mem(0)
       , _free_mem(0)
       , _gc_threshold(10)
-      , _max_alloced_mem(0) {
+      , _max_alloced_mem(0)
+      , _trackStats(false)
+      , _provider(NULL) {
       for (int i=_max_fl+1; i--;)
         _fl[i] = NULL;
     }
+    ~Heap(void) {
+      while (_page) {
+        HeapPage* p = _page;
+        _page = p->next;
+        freePage(p);
+      }
+      for (unsigned int i=0; i<_providers.size(); i++)
+        delete _providers[i];
+    }
 
-    /// Default size of pages to allocate
-    static const size_t pageSize = 1<<20;
-    
     HeapPage* allocPage(size_t s, bool exact=false) {
       if (!exact)
-        s = std::max(s,pageSize);
+        s = std::max(s,_pageOpts.pageSize);
+      /// Small exact pages always come from malloc
+      PageProvider* pp = s >= _pageOpts.pageSize ? _provider : NULL;
+      size_t bytes = sizeof(HeapPage)+s-1;
       HeapPage* newPage =
-        static_cast<HeapPage*>(::malloc(sizeof(HeapPage)+s-1));
+        static_cast<HeapPage*>(pp ? pp->alloc(bytes) : ::malloc(bytes));
       if (newPage==NULL) {
         throw InternalError("out of memory");
       }
 #ifndef NDEBUG
-      memset(newPage,255,sizeof(HeapPage)+s-1);
+      memset(newPage,255,bytes);
 #endif
       _alloced_mem += s;
       _max_alloced_mem = std::max(_max_alloced_mem, _alloced_mem);
       _free_mem += s;
       if (exact && _page) {
-        new (newPage) HeapPage(_page->next,s);
+        new (newPage) HeapPage(_page->next,pp,s,true);
         _page->next = newPage;
       } else {
         if (_page) {
@@ -180,7 +300,7 @@ namespace MiniZinc {
             assert(_alloced_mem >= _free_mem);
           }
         }
-        new (newPage) HeapPage(_page,s);
+        new (newPage) HeapPage(_page,pp,s,exact);
         _page = newPage;
       }
       return newPage;
@@ -188,7 +308,7 @@ namespace MiniZinc {
 
     void*
     alloc(size_t size, bool exact=false) {
-      assert(size<=80 || exact);
+      assert(size<=_fl_size[_max_fl] || exact);
       /// Align to word boundary
       size += ((8 - (size & 7)) & 7);
       HeapPage* p = _page;
@@ -223,23 +343,59 @@ namespace MiniZinc {
 
     void rungc(void) {
       if (_alloced_mem > _gc_threshold) {
-#ifdef MINIZINC_GC_STATS
-        std::cerr << "GC\n\talloced " << (_alloced_mem/1024) << "\n\tfree " << (_free_mem/1024) << "\n\tdiff "
-                  << ((_alloced_mem-_free_mem)/1024)
-                  << "\n\tthreshold " << (_gc_threshold/1024)
-                  << "\n";
-#endif
+        std::chrono::steady_clock::time_point t0;
+        size_t usedBefore = 0;
+        if (_trackStats) {
+          t0 = std::chrono::steady_clock::now();
+          usedBefore = _alloced_mem-_free_mem;
+          std::fill(_stats.liveCount, _stats.liveCount+GCStats::n_kinds, 0);
+          std::fill(_stats.liveBytes, _stats.liveBytes+GCStats::n_kinds, 0);
+        }
         mark();
         sweep();
         _gc_threshold = static_cast<size_t>(_alloced_mem * 1.5);
-#ifdef MINIZINC_GC_STATS
-        std::cerr << "done\n\talloced " << (_alloced_mem/1024) << "\n\tfree " << (_free_mem/1024) << "\n\tdiff "
-                  << ((_alloced_mem-_free_mem)/1024)
-                  << "\n\tthreshold " << (_gc_threshold/1024)
-                  << "\n";
-#endif
+        if (_trackStats) {
+          double pause = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+          size_t usedAfter = _alloced_mem-_free_mem;
+          _stats.collections++;
+          _stats.lastReclaimed = usedBefore > usedAfter ? usedBefore-usedAfter : 0;
+          _stats.reclaimed += _stats.lastReclaimed;
+          _stats.totalPause += pause;
+          _stats.maxPause = std::max(_stats.maxPause, pause);
+          int bucket = 0;
+          for (double us = pause*1e6; us >= 1.0 && bucket < GCStats::n_pauseBuckets-1; us /= 2.0)
+            bucket++;
+          _stats.pauses[bucket]++;
+        }
+      }
+    }
+    /// Give the memory of page \a p back to where it came from
+    static void freePage(HeapPage* p) {
+      if (p->provider)
+        p->provider->free(p, sizeof(HeapPage)+p->size-1);
+      else
+        ::free(p);
+    }
+    /// Whether \a n lies in one of the pages of this heap
+    bool contains(const void* n) const {
+      const char* c = static_cast<const char*>(n);
+      for (HeapPage* p = _page; p != NULL; p = p->next)
+        if (c >= p->data && c < p->data+p->size)
+          return true;
+      return false;
+    }
+    /// Whether page \a p contains marked nodes
+    static bool hasLiveNodes(HeapPage* p) {
+      size_t off = 0;
+      while (off < p->used) {
+        ASTNode* n = reinterpret_cast<ASTNode*>(p->data+off);
+        if (n->_gc_mark==1 && n->_id != ASTNode::NID_FL)
+          return true;
+        off += nodesize(n);
       }
+      return false;
     }
+    void setPageOptions(const GCPageOptions& o);
     void mark(void);
     void sweep(void);
 
@@ -298,44 +454,60 @@ namespace MiniZinc {
 
   };
 
-#ifdef MINIZINC_GC_STATS
+  static_assert(offsetof(HeapPage,data) % 8 == 0, "heap nodes must be aligned");
+  static_assert(GCStats::n_kinds == Item::II_END+1, "GCStats::n_kinds must cover all node ids");
+
   const char*
-  GC::Heap::_nodeid[] = {
-    "FreeList      ", // NID_FL
-    "Chunk         ", // NID_CHUNK
-    "Vec           ", // NID_VEC
-    "IntLit        ",        // E_INTLIT
-    "FloatLit      ",      // E_FLOATLIT
-    "SetLit        ",        // E_SETLIT
-    "BoolLit       ",       // E_BOOLLIT
-    "StringLit     ",     // E_STRINGLIT
-    "Id            ",            // E_ID
-    "AnonVar       ",       // E_ANON
-    "ArrayLit      ",      // E_ARRAYLIT
-    "ArrayAccess   ",   // E_ARRAYACCESS
-    "Comprehension ", // E_COMP
-    "ITE           ",           // E_ITE
-    "BinOp         ",         // E_BINOP
-    "UnOp          ",          // E_UNOP
-    "Call          ",          // E_CALL
-    "VarDecl       ",       // E_VARDECL
-    "Let           ",           // E_LET
-    "TypeInst      ",      // E_TI
-    "TIId          ",          // E_TIID
-    "IncludeI      ",      // II_INC
-    "VarDeclI      ",      // II_VD
-    "AssignI       ",       // II_ASN
-    "ConstraintI   ",   // II_CON
-    "SolveI        ",        // II_SOL
-    "OutputI       ",       // II_OUT
-    "FunctionI     "      // II_FUN
-  };
-#endif
+  GCStats::kindName(int k) {
+    static const char* _kindName[n_kinds] = {
+      "FreeList", "Chunk", "Vec",
+      "IntLit", "FloatLit", "SetLit", "BoolLit", "StringLit", "Id", "AnonVar",
+      "ArrayLit", "ArrayAccess", "Comprehension", "ITE", "BinOp", "UnOp",
+      "Call", "VarDecl", "Let", "TypeInst", "TIId",
+      "IncludeI", "VarDeclI", "AssignI", "ConstraintI", "SolveI", "OutputI",
+      "FunctionI"
+    };
+    assert(k >= 0 && k < n_kinds);
+    return _kindName[k];
+  }
+
+  void
+  GCStats::clear(void) {
+    collections = 0;
+    reclaimed = 0;
+    lastReclaimed = 0;
+    totalPause = 0.0;
+    maxPause = 0.0;
+    std::fill(pauses, pauses+n_pauseBuckets, 0);
+    std::fill(liveCount, liveCount+n_kinds, 0);
+    std::fill(liveBytes, liveBytes+n_kinds, 0);
+    std::fill(freedCount, freedCount+n_kinds, 0);
+    std::fill(freedBytes, freedBytes+n_kinds, 0);
+    releasedPages = 0;
+  }
+
+  GCHeapInfo::GCHeapInfo(void) : pages(0), pageBytes(0), unusedBytes(0) {
+    std::fill(freeListCount, freeListCount+n_freeLists, 0);
+    std::fill(freeListBytes, freeListBytes+n_freeLists, 0);
+    std::fill(nodeCount, nodeCount+GCStats::n_kinds, 0);
+    std::fill(nodeBytes, nodeBytes+GCStats::n_kinds, 0);
+  }
+
   
+  namespace {
+    /// Destroys the heap of a thread when the thread exits
+    struct GCThreadExit {
+      ~GCThreadExit(void) { GC::threadExit(); }
+    };
+  }
+
   void
   GC::lock(void) {
     if (gc()==NULL) {
       gc() = new GC();
+      /// Created once in each thread that uses the collector
+      static thread_local GCThreadExit threadExit;
+      (void) threadExit;
     }
     if (gc()->_lock_count==0)
       gc()->_heap->rungc();
@@ -347,19 +519,48 @@ namespace MiniZinc {
     gc()->_lock_count--;
   }
 
-  const size_t GC::Heap::pageSize;
-
   const size_t
   GC::Heap::_fl_size[GC::Heap::_max_fl+1] = {
-    sizeof(Item)+1*sizeof(void*),
-    sizeof(Item)+2*sizeof(void*),
-    sizeof(Item)+3*sizeof(void*),
-    sizeof(Item)+4*sizeof(void*),
-    sizeof(Item)+5*sizeof(void*),
-    sizeof(Item)+6*sizeof(void*),
+     2*sizeof(void*),
+     3*sizeof(void*),
+     4*sizeof(void*),
+     5*sizeof(void*),
+     6*sizeof(void*),
+     7*sizeof(void*),
+     8*sizeof(void*),
+     9*sizeof(void*),
+    10*sizeof(void*),
+    11*sizeof(void*),
+    12*sizeof(void*),
   };
 
-  GC::GC(void) : _heap(new Heap()), _lock_count(0) {}
+  static_assert(sizeof(FreeListNode) <= 2*sizeof(void*), "free list nodes must fit the smallest size class");
+
+  GC::GC(void) : _heap(new Heap()), _lock_count(0) {
+    LocationTable::addHeap();
+  }
+
+  GC::~GC(void) {
+    delete _heap;
+    LocationTable::removeHeap();
+  }
+
+  void
+  GC::threadExit(void) {
+    GC*& gc = GC::gc();
+    if (gc==NULL || gc->_lock_count > 0)
+      return;
+    Heap* h = gc->_heap;
+    if (h->_rootset || h->_roots || h->_weakRefs || h->_nodeWeakMaps)
+      return;
+    /// The location table keeps the file names of its entries
+    std::vector<ASTString> files = LocationTable::files();
+    for (unsigned int i=0; i<files.size(); i++)
+      if (h->contains(files[i].aststr()))
+        return;
+    delete gc;
+    gc = NULL;
+  }
 
   void
   GC::add(Model* m) {
@@ -402,23 +603,13 @@ namespace MiniZinc {
 
   void
   GC::Heap::mark(void) {
-#if defined(MINIZINC_GC_STATS)
-    std::cerr << "================= mark =================: ";
-    gc_stats.clear();
-#endif
-
+    LocationTable::mark();
     for (KeepAlive* e = _roots; e != NULL; e = e->next()) {
       if ((*e)() && (*e)()->_gc_mark==0) {
         Expression::mark((*e)());
-#if defined(MINIZINC_GC_STATS)
-        gc_stats[(*e)()->_id].keepalive++;
-#endif
       }
     }
-#if defined(MINIZINC_GC_STATS)
-    std::cerr << "+";
-#endif
-    
+
     Model* m = _rootset;
     if (m==NULL)
       return;
@@ -429,16 +620,12 @@ namespace MiniZinc {
         Item* i = m->_items[j];
         if (i->_gc_mark==0) {
           i->_gc_mark = 1;
-          i->loc().mark();
           switch (i->iid()) {
           case Item::II_INC:
             i->cast<IncludeI>()->f().mark();
             break;
           case Item::II_VD:
             Expression::mark(i->cast<VarDeclI>()->e());
-#if defined(MINIZINC_GC_STATS)
-            gc_stats[i->cast<VarDeclI>()->e()->Expression::eid()].inmodel++;
-#endif
             break;
           case Item::II_ASN:
             i->cast<AssignI>()->id().mark();
@@ -447,9 +634,6 @@ namespace MiniZinc {
             break;
           case Item::II_CON:
             Expression::mark(i->cast<ConstraintI>()->e());
-#if defined(MINIZINC_GC_STATS)
-            gc_stats[i->cast<ConstraintI>()->e()->Expression::eid()].inmodel++;
-#endif
             break;
           case Item::II_SOL:
             {
@@ -520,33 +704,55 @@ namespace MiniZinc {
         wr->_m.erase(n);
       }
     }
-
-#if defined(MINIZINC_GC_STATS)
-    std::cerr << "+";
-    std::cerr << "\n";
-#endif
   }
     
   void
-  GC::Heap::sweep(void) {
-#if defined(MINIZINC_GC_STATS)
-    std::cerr << "=============== GC sweep =============\n";
+  GC::Heap::setPageOptions(const GCPageOptions& o) {
+    _pageOpts = o;
+    /// Pages must at least hold the largest free list node
+    _pageOpts.pageSize = std::max(_pageOpts.pageSize, size_t(4096));
+    _provider = NULL;
+#ifdef HAS_MMAP
+    if (_pageOpts.mmapRegions || _pageOpts.hugePages) {
+      _provider = new MmapPageProvider(sizeof(HeapPage)+_pageOpts.pageSize-1,
+                                       _pageOpts.hugePages, _pageOpts.releasePages);
+      _providers.push_back(_provider);
+    }
+#else
+    _pageOpts.mmapRegions = false;
+    _pageOpts.hugePages = false;
 #endif
+  }
+
+  void
+  GC::Heap::sweep(void) {
+    const bool track = _trackStats;
+    const bool release = _pageOpts.releasePages;
+    _liveLocations.clear();
+    if (release) {
+      /// The free lists are rebuilt from the pages that are kept
+      for (int i=_max_fl+1; i--;)
+        _fl[i] = NULL;
+    }
     HeapPage* p = _page;
     HeapPage* prev = NULL;
     while (p) {
       size_t off = 0;
       bool wholepage = false;
+      /// Standard pages without live nodes are released as a whole
+      /// (except for the current allocation page)
+      const bool emptypage = release && !p->exact && p != _page && !hasLiveNodes(p);
+      /// Free list bytes on an empty page
+      size_t flBytes = 0;
       while (off < p->used) {
         ASTNode* n = reinterpret_cast<ASTNode*>(p->data+off);
         size_t ns = nodesize(n);
         assert(ns != 0);
-#if defined(MINIZINC_GC_STATS)
-        GCStat& stats = gc_stats[n->_id];
-        stats.first++;
-        stats.total += ns;
-#endif
         if (n->_gc_mark==0) {
+          if (track) {
+            _stats.freedCount[n->_id]++;
+            _stats.freedBytes[n->_id] += ns;
+          }
           switch (n->_id) {
             case Item::II_FUN:
               static_cast<FunctionI*>(n)->ann().~Annotation();
@@ -563,14 +769,13 @@ namespace MiniZinc {
                 static_cast<Expression*>(n)->ann().~Annotation();
               }
           }
-          if (ns >= _fl_size[0] && ns <= _fl_size[_max_fl]) {
+          if (emptypage) {
+            // nothing to do, the page is freed below
+          } else if (ns >= _fl_size[0] && ns <= _fl_size[_max_fl]) {
             FreeListNode* fln = static_cast<FreeListNode*>(n);
             new (fln) FreeListNode(ns, _fl[_fl_slot(ns)]);
             _fl[_fl_slot(ns)] = fln;
             _free_mem += ns;
-#if defined(MINIZINC_GC_STATS)
-            gc_stats[fln->_id].second++;
-#endif
             assert(_alloced_mem >= _free_mem);
           } else {
             assert(off==0);
@@ -578,14 +783,33 @@ namespace MiniZinc {
             wholepage = true;
           }
         } else {
-#if defined(MINIZINC_GC_STATS)
-          stats.second++;
-#endif
-          if (n->_id != ASTNode::NID_FL)
+          if (n->_id != ASTNode::NID_FL) {
             n->_gc_mark=0;
+            if (n->_id > ASTNode::NID_END && n->_id <= Expression::EID_END)
+              LocationTable::used(static_cast<Expression*>(n), _liveLocations);
+            else if (n->_id >= Item::II_INC && n->_id <= Item::II_END)
+              LocationTable::used(static_cast<Item*>(n), _liveLocations);
+            if (track) {
+              _stats.liveCount[n->_id]++;
+              _stats.liveBytes[n->_id] += ns;
+            }
+          } else if (emptypage) {
+            flBytes += ns;
+          } else if (release) {
+            FreeListNode* fln = static_cast<FreeListNode*>(n);
+            fln->next = _fl[_fl_slot(ns)];
+            _fl[_fl_slot(ns)] = fln;
+          }
         }
         off += ns;
       }
+      if (emptypage) {
+        assert(_free_mem >= flBytes);
+        _free_mem -= flBytes;
+        wholepage = true;
+        if (track)
+          _stats.releasedPages++;
+      }
       if (wholepage) {
 #ifndef NDEBUG
         memset(p->data,42,p->size);
@@ -600,28 +824,13 @@ namespace MiniZinc {
         p = p->next;
         _alloced_mem -= pf->size;
         assert(_alloced_mem >= _free_mem);
-        ::free(pf);
+        freePage(pf);
       } else {
         prev = p;
         p = p->next;
       }
     }
-#if defined(MINIZINC_GC_STATS)
-    for (auto stat: gc_stats) {
-      std::cerr << _nodeid[stat.first] << ":\t" << stat.second.first << " / " << stat.second.second
-      << " / " << stat.second.keepalive << " / " << stat.second.inmodel << " / ";
-      if (stat.second.total > 1024) {
-        if (stat.second.total > 1024*1024) {
-          std::cerr << (stat.second.total / 1024 / 1024) << "M";
-        } else {
-          std::cerr << (stat.second.total / 1024) << "K";
-        }
-      } else {
-        std::cerr << (stat.second.total);
-      }
-      std::cerr << std::endl;
-    }
-#endif
+    LocationTable::release(_liveLocations);
   }
 
   ASTVec::ASTVec(size_t size)
@@ -668,6 +877,137 @@ namespace MiniZinc {
     GC* gc = GC::gc();
     return gc->_heap->_max_alloced_mem;
   }
+
+  void
+  GC::trackStats(bool b) {
+    if (gc()==NULL) {
+      gc() = new GC();
+    }
+    gc()->_heap->_trackStats = b;
+    if (b)
+      gc()->_heap->_stats.clear();
+  }
+  bool
+  GC::trackingStats(void) {
+    return gc() && gc()->_heap->_trackStats;
+  }
+  void
+  GC::pageOptions(const GCPageOptions& o) {
+    if (gc()==NULL) {
+      gc() = new GC();
+    }
+    gc()->_heap->setPageOptions(o);
+  }
+  const GCPageOptions&
+  GC::pageOptions(void) {
+    if (gc()==NULL) {
+      gc() = new GC();
+    }
+    return gc()->_heap->_pageOpts;
+  }
+
+  const GCStats&
+  GC::stats(void) {
+    if (gc()==NULL) {
+      gc() = new GC();
+    }
+    return gc()->_heap->_stats;
+  }
+
+  void
+  GC::inspect(GCHeapInfo& hi) {
+    hi = GCHeapInfo();
+    if (gc()==NULL)
+      return;
+    Heap* h = gc()->_heap;
+    for (HeapPage* p = h->_page; p != NULL; p = p->next) {
+      hi.pages++;
+      hi.pageBytes += p->size;
+      hi.unusedBytes += p->size-p->used;
+      size_t off = 0;
+      while (off < p->used) {
+        ASTNode* n = reinterpret_cast<ASTNode*>(p->data+off);
+        size_t ns = Heap::nodesize(n);
+        if (n->_id == ASTNode::NID_FL && ns >= Heap::_fl_size[0] && ns <= Heap::_fl_size[Heap::_max_fl]) {
+          int slot = h->_fl_slot(ns);
+          hi.freeListCount[slot]++;
+          hi.freeListBytes[slot] += ns;
+        } else {
+          hi.nodeCount[n->_id]++;
+          hi.nodeBytes[n->_id] += ns;
+        }
+        off += ns;
+      }
+    }
+  }
+
+  namespace {
+    /// Print \a b bytes with a binary unit
+    std::string showBytes(double b) {
+      std::ostringstream oss;
+      const char* unit[] = { "B", "KB", "MB", "GB", "TB" };
+      int u = 0;
+      while (b >= 1024.0 && u < 4) {
+        b /= 1024.0;
+        u++;
+      }
+      oss << std::fixed << std::setprecision(u==0 ? 0 : 1) << b << " " << unit[u];
+      return oss.str();
+    }
+  }
+
+  void
+  GC::printStats(std::ostream& os) {
+    const GCStats& st = stats();
+    GCHeapInfo hi;
+    inspect(hi);
+    os << "Garbage collector: " << st.collections << " collections, "
+       << showBytes(static_cast<double>(st.reclaimed)) << " reclaimed, pauses "
+       << st.totalPause << " s total, " << st.maxPause << " s max, peak heap "
+       << showBytes(static_cast<double>(maxMem())) << "\n";
+    if (st.collections) {
+      os << "  Pause histogram (us):";
+      for (int i=0; i<GCStats::n_pauseBuckets; i++) {
+        if (st.pauses[i]) {
+          if (i==GCStats::n_pauseBuckets-1)
+            os << " >=" << (1ull << (i-1)) << ":" << st.pauses[i];
+          else
+            os << " <" << (1ull << i) << ":" << st.pauses[i];
+        }
+      }
+      os << "\n";
+    }
+    size_t flBytes = 0;
+    size_t flCount = 0;
+    for (int i=0; i<GCHeapInfo::n_freeLists; i++) {
+      flBytes += hi.freeListBytes[i];
+      flCount += hi.freeListCount[i];
+    }
+    os << "  Heap: " << hi.pages << " pages, " << showBytes(static_cast<double>(hi.pageBytes))
+       << ", " << showBytes(static_cast<double>(hi.unusedBytes)) << " never used, "
+       << showBytes(static_cast<double>(flBytes)) << " in " << flCount << " free list nodes\n";
+    if (st.releasedPages)
+      os << "  Released " << st.releasedPages << " empty pages\n";
+    /// Node kinds ordered by current heap bytes
+    std::vector<int> kinds;
+    for (int k=0; k<GCStats::n_kinds; k++)
+      if (hi.nodeBytes[k] || st.freedBytes[k])
+        kinds.push_back(k);
+    std::sort(kinds.begin(), kinds.end(), [&hi](int a, int b) { return hi.nodeBytes[a] > hi.nodeBytes[b]; });
+    if (!kinds.empty()) {
+      os << "  " << std::left << std::setw(14) << "Kind" << std::right
+         << std::setw(12) << "nodes" << std::setw(12) << "bytes"
+         << std::setw(12) << "live" << std::setw(12) << "reclaimed" << "\n";
+      for (unsigned int i=0; i<kinds.size(); i++) {
+        int k = kinds[i];
+        os << "  " << std::left << std::setw(14) << GCStats::kindName(k) << std::right
+           << std::setw(12) << hi.nodeCount[k]
+           << std::setw(12) << showBytes(static_cast<double>(hi.nodeBytes[k]))
+           << std::setw(12) << showBytes(static_cast<double>(st.liveBytes[k]))
+           << std::setw(12) << showBytes(static_cast<double>(st.freedBytes[k])) << "\n";
+      }
+    }
+  }
   
 
   void*
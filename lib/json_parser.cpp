@@ -13,6 +13,8 @@
 
 #include <fstream>
 #include <sstream>
+#include <cstdlib>
+#include <climits>
 
 using namespace std;
 
@@ -26,11 +28,11 @@ namespace MiniZinc {
   public:
     Token(void) : t(T_EOF) {}
     std::string s;
-    int i;
+    long long int i;
     double d;
     bool b;
     Token(std::string s0) : t(T_STRING), s(s0) {}
-    Token(int i0) : t(T_INT), i(i0), d(i0) {}
+    Token(long long int i0) : t(T_INT), i(i0), d(static_cast<double>(i0)) {}
     Token(double d0) : t(T_FLOAT), d(d0) {}
     Token(bool b0) : t(T_BOOL), i(b0), d(b0), b(b0) {}
     static Token listOpen() { return Token(T_LIST_OPEN); }
@@ -64,6 +66,7 @@ namespace MiniZinc {
         case T_EOF:
           return "eof";
       }
+      return "";
     }
   };
   
@@ -75,136 +78,184 @@ namespace MiniZinc {
     loc.first_column = column;
     return loc;
   }
-  
+
+  bool
+  JSONParser::fill(void) {
+    if (_is==NULL || !_is->good())
+      return false;
+    _is->read(&_buf[0], _buf.size());
+    _bufPos = 0;
+    _bufEnd = static_cast<size_t>(_is->gcount());
+    if (_bufEnd==0 && _is->bad())
+      throw JSONError(env,errLocation(),"tokenization failed");
+    return _bufEnd > 0;
+  }
+
+  int
+  JSONParser::skipSpace(void) {
+    for (;;) {
+      int c = peek();
+      switch (c) {
+        case '\n':
+          line++;
+          column = -1;
+          // fall through
+        case ' ':
+        case '\t':
+        case '\r':
+          get();
+          break;
+        default:
+          return c;
+      }
+    }
+  }
+
   JSONParser::Token
-  JSONParser::readToken(istream& is) {
+  JSONParser::readNumber(int c0) {
+    // Integers are accumulated directly, only floats go through strtod
+    char fbuf[64];
+    unsigned int fpos = 0;
+    bool neg = (c0=='-');
+    int c = c0;
+    if (neg) {
+      fbuf[fpos++] = '-';
+      c = get();
+      if (c<'0' || c>'9')
+        throw JSONError(env,errLocation(),"invalid number");
+    }
+    // A negative literal may reach -LLONG_MIN, one more than LLONG_MAX
+    const unsigned long long int limit =
+      static_cast<unsigned long long int>(LLONG_MAX) + (neg ? 1 : 0);
+    unsigned long long int v = 0;
+    bool overflow = false;
+    for (;;) {
+      unsigned int digit = static_cast<unsigned int>(c-'0');
+      if (v > (limit-digit)/10)
+        overflow = true;
+      v = v*10+digit;
+      if (fpos < sizeof(fbuf)-1)
+        fbuf[fpos++] = static_cast<char>(c);
+      c = peek();
+      if (c<'0' || c>'9')
+        break;
+      get();
+    }
+    if (c!='.' && c!='e' && c!='E') {
+      if (overflow)
+        throw JSONError(env,errLocation(),"integer literal out of range");
+      if (neg)
+        return Token(-static_cast<long long int>(v-1)-1);
+      return Token(static_cast<long long int>(v));
+    }
+    // floating point number
+    for (;;) {
+      if (fpos >= sizeof(fbuf)-1)
+        throw JSONError(env,errLocation(),"floating point literal too long");
+      fbuf[fpos++] = static_cast<char>(get());
+      c = peek();
+      if ( !( (c>='0' && c<='9') || c=='.' || c=='e' || c=='E' || c=='+' || c=='-') )
+        break;
+    }
+    fbuf[fpos] = 0;
+    char* endp;
+    double d = strtod(fbuf, &endp);
+    if (endp != fbuf+fpos)
+      throw JSONError(env,errLocation(),"invalid number "+string(fbuf));
+    return Token(d);
+  }
+
+  string
+  JSONParser::readString(void) {
+    // precondition: opening quote has been read
     string result;
-    char buf[1];
-    enum { S_NOTHING, S_STRING, S_INT, S_FLOAT } state;
-    state = S_NOTHING;
-    while (is.good()) {
-      is.read(buf, sizeof(buf));
-      column += sizeof(buf);
-      if (is.eof())
-        return Token::eof();
-      if (!is.good())
-        throw JSONError(env,errLocation(),"tokenization failed");
-      switch (state) {
-        case S_NOTHING:
-          switch (buf[0]) {
-            case '\n':
-              line++;
-              column = 0;
-              // fall through
-            case ' ':
-            case '\t':
-              break;
-            case '[': return Token::listOpen();
-            case ']': return Token::listClose();
-            case '{': return Token::objOpen();
-            case '}': return Token::objClose();
-            case ',': return Token::comma();
-            case ':': return Token::colon();
-            case '"':
-              result="";
-              state=S_STRING;
-              break;
-            case 't':
-            {
-              char rest[3];
-              is.read(rest,sizeof(rest));
-              column += sizeof(rest);
-              if (!is.good() || rest != string("rue"))
-                throw JSONError(env,errLocation(),"unexpected token `"+string(rest)+"'");
-              state = S_NOTHING;
-              return Token(true);
-            }
-              break;
-            case 'f':
-            {
-              char rest[4];
-              is.read(rest,sizeof(rest));
-              column += sizeof(rest);
-              if (!is.good() || rest != string("alse"))
-                throw JSONError(env,errLocation(),"unexpected token "+string(rest));
-              state = S_NOTHING;
-              return Token(false);
-            }
-              break;
+    for (;;) {
+      int c = get();
+      switch (c) {
+        case -1:
+          throw JSONError(env,errLocation(),"unterminated string");
+        case '"':
+          return result;
+        case '\\':
+          c = get();
+          switch (c) {
+            case 'n': result += '\n'; break;
+            case 't': result += '\t'; break;
+            case 'r': result += '\r'; break;
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case '"': case '\\': case '/': result += static_cast<char>(c); break;
             default:
-              if (buf[0]>='0' && buf[0]<='9') {
-                result = buf;
-                state=S_INT;
-              } else {
-                throw JSONError(env,errLocation(),"unexpected token "+string(buf));
-              }
-              break;
-          }
-          break;
-        case S_STRING:
-          if (buf[0]=='"') {
-            state=S_NOTHING;
-            return Token(result);
-          }
-          result += buf[0];
-          break;
-        case S_INT:
-          if (buf[0]=='.') {
-            result += buf[0];
-            state=S_FLOAT;
-          } else if (buf[0]>='0' && buf[0]<='9') {
-            result += buf[0];
-          } else {
-            is.unget();
-            std::istringstream iss(result);
-            int v;
-            iss >> v;
-            state=S_NOTHING;
-            return Token(v);
+              throw JSONError(env,errLocation(),"unsupported escape sequence in string");
           }
           break;
-        case S_FLOAT:
-          if (buf[0]>='0' && buf[0]<='9') {
-            result += buf[0];
-          } else {
-            is.unget();
-            std::istringstream iss(result);
-            double v;
-            iss >> v;
-            state=S_NOTHING;
-            return Token(v);
-          }
+        case '\n':
+          line++;
+          column = 0;
+          // fall through
+        default:
+          result += static_cast<char>(c);
           break;
       }
     }
-    throw JSONError(env,errLocation(),"unexpected token "+string(result));
   }
   
-  void JSONParser::expectToken(istream& is, JSONParser::TokenT t) {
-    Token rt = readToken(is);
+  JSONParser::Token
+  JSONParser::readToken(void) {
+    int c = skipSpace();
+    if (c==-1)
+      return Token::eof();
+    get();
+    switch (c) {
+      case '[': return Token::listOpen();
+      case ']': return Token::listClose();
+      case '{': return Token::objOpen();
+      case '}': return Token::objClose();
+      case ',': return Token::comma();
+      case ':': return Token::colon();
+      case '"': return Token(readString());
+      case 't':
+      case 'f':
+      {
+        const char* rest = (c=='t' ? "rue" : "alse");
+        for (const char* r = rest; *r; ++r) {
+          if (get() != *r)
+            throw JSONError(env,errLocation(),"unexpected token `"+string(1,static_cast<char>(c))+"'");
+        }
+        return Token(c=='t');
+      }
+      default:
+        if ((c>='0' && c<='9') || c=='-')
+          return readNumber(c);
+        throw JSONError(env,errLocation(),"unexpected token "+string(1,static_cast<char>(c)));
+    }
+  }
+  
+  void JSONParser::expectToken(JSONParser::TokenT t) {
+    Token rt = readToken();
     if (rt.t != t) {
       throw JSONError(env,errLocation(),"unexpected token");
     }
   }
   
-  string JSONParser::expectString(istream& is) {
-    Token rt = readToken(is);
+  string JSONParser::expectString(void) {
+    Token rt = readToken();
     if (rt.t != T_STRING) {
       throw JSONError(env,errLocation(),"unexpected token, expected string");
     }
     return rt.s;
   }
   
-  SetLit* JSONParser::parseSetLit(istream& is) {
+  SetLit* JSONParser::parseSetLit(void) {
     // precondition: found T_OBJ_OPEN
-    Token setid = readToken(is);
+    Token setid = readToken();
     if (setid.t != T_STRING || setid.s != "set")
       throw JSONError(env,errLocation(),"invalid set literal");
-    expectToken(is, T_COLON);
-    expectToken(is, T_LIST_OPEN);
+    expectToken(T_COLON);
+    expectToken(T_LIST_OPEN);
     vector<Token> elems;
     TokenT listT = T_COLON; // dummy marker
-    for (Token next = readToken(is); next.t != T_LIST_CLOSE; next = readToken(is)) {
+    for (Token next = readToken(); next.t != T_LIST_CLOSE; next = readToken()) {
       switch (next.t) {
         case T_COMMA:
           break;
@@ -238,7 +289,7 @@ namespace MiniZinc {
           throw JSONError(env,errLocation(),"invalid set literal");
       }
     }
-    expectToken(is, T_OBJ_CLOSE);
+    expectToken(T_OBJ_CLOSE);
     vector<Expression*> elems_e(elems.size());
     switch (listT) {
       case T_COLON:
@@ -270,7 +321,7 @@ namespace MiniZinc {
   }
 
   ArrayLit*
-  JSONParser::parseArray(std::istream &is) {
+  JSONParser::parseArray(void) {
     // precondition: opening parenthesis has been read
     vector<Expression*> exps;
     vector<pair<int,int> > dims;
@@ -279,7 +330,7 @@ namespace MiniZinc {
     hadDim.push_back(false);
     Token next;
     for (;;) {
-      next = readToken(is);
+      next = readToken();
       if (next.t!=T_LIST_OPEN)
         break;
       dims.push_back(make_pair(1, 0));
@@ -292,6 +343,12 @@ namespace MiniZinc {
           if (!hadDim[curDim] && dims[curDim].second>0)
             dims[curDim].second++;
           hadDim[curDim] = true;
+          if (curDim==dims.size()-1 && curDim>0) {
+            // First innermost row complete: its length is a good estimate
+            // for the growth of the remaining rows
+            if (exps.capacity() < 2*exps.size())
+              exps.reserve(2*exps.size());
+          }
           curDim--;
           if (curDim<0)
             goto list_done;
@@ -305,9 +362,45 @@ namespace MiniZinc {
           break;
         case T_INT:
           exps.push_back(IntLit::a(next.i));
+          // Fast path for runs of numbers: no generic tokenization
+          for (;;) {
+            int c = skipSpace();
+            if (c!=',')
+              break;
+            get();
+            if (!hadDim[curDim])
+              dims[curDim].second++;
+            c = skipSpace();
+            if ((c>='0' && c<='9') || c=='-') {
+              get();
+              Token num = readNumber(c);
+              if (num.t==T_INT)
+                exps.push_back(IntLit::a(num.i));
+              else
+                exps.push_back(new FloatLit(Location().introduce(),num.d));
+            } else {
+              break;
+            }
+          }
           break;
         case T_FLOAT:
           exps.push_back(new FloatLit(Location().introduce(),next.d));
+          for (;;) {
+            int c = skipSpace();
+            if (c!=',')
+              break;
+            get();
+            if (!hadDim[curDim])
+              dims[curDim].second++;
+            c = skipSpace();
+            if ((c>='0' && c<='9') || c=='-') {
+              get();
+              Token num = readNumber(c);
+              exps.push_back(new FloatLit(Location().introduce(),num.d));
+            } else {
+              break;
+            }
+          }
           break;
         case T_STRING:
           exps.push_back(new StringLit(Location().introduce(),next.s));
@@ -316,21 +409,21 @@ namespace MiniZinc {
           exps.push_back(new BoolLit(Location().introduce(),next.b));
           break;
         case T_OBJ_OPEN:
-          exps.push_back(parseSetLit(is));
+          exps.push_back(parseSetLit());
           break;
         default:
           throw JSONError(env,errLocation(),"cannot parse JSON file");
           break;
       }
-      next = readToken(is);
+      next = readToken();
     }
   list_done:
     return new ArrayLit(Location().introduce(),exps,dims);
   }
   
   Expression*
-  JSONParser::parseExp(std::istream &is) {
-    Token next = readToken(is);
+  JSONParser::parseExp(void) {
+    Token next = readToken();
     switch (next.t) {
       case T_INT:
         return IntLit::a(next.i);
@@ -342,9 +435,9 @@ namespace MiniZinc {
       case T_BOOL:
         return new BoolLit(Location().introduce(),next.b);
       case T_OBJ_OPEN:
-        return parseSetLit(is);
+        return parseSetLit();
       case T_LIST_OPEN:
-        return parseArray(is);
+        return parseArray();
       default:
         throw JSONError(env,errLocation(),"cannot parse JSON file");
         break;
@@ -353,29 +446,38 @@ namespace MiniZinc {
   
   void
   JSONParser::parse(Model* m, std::string filename0) {
-    filename = filename0;
     ifstream is;
-    is.open(filename, ios::in);
-    line = 0;
-    column = 0;
+    is.open(filename0, ios::in | ios::binary);
     if (!is.good()) {
-      throw JSONError(env,Location().introduce(),"cannot open file "+filename);
+      throw JSONError(env,Location().introduce(),"cannot open file "+filename0);
     }
-    expectToken(is, T_OBJ_OPEN);
+    parse(m, is, filename0);
+  }
+
+  void
+  JSONParser::parse(Model* m, std::istream& is, std::string filename0) {
+    filename = filename0;
+    line = 0;
+    column = 0;
+    _is = &is;
+    _buf.resize(1<<16);
+    _bufPos = _bufEnd = 0;
+    expectToken(T_OBJ_OPEN);
     for (;;) {
-      string ident = expectString(is);
-      expectToken(is, T_COLON);
-      Expression* e = parseExp(is);
+      string ident = expectString();
+      expectToken(T_COLON);
+      Expression* e = parseExp();
       if (ident[0]!='_') {
         AssignI* ai = new AssignI(Location().introduce(),ident,e);
         m->addItem(ai);
       }
-      Token next = readToken(is);
+      Token next = readToken();
       if (next.t==T_OBJ_CLOSE)
         break;
       if (next.t!=T_COMMA)
         throw JSONError(env,errLocation(),"cannot parse JSON file");
     }
+    _is = NULL;
   }
   
-}
\ No newline at end of file
+}
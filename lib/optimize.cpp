@@ -20,6 +20,7 @@
 
 #include <vector>
 #include <deque>
+#include <cstdlib>
 
 namespace MiniZinc {
 
@@ -158,10 +159,7 @@ namespace MiniZinc {
           if (id0->type().isint() || id0->type().isintset()) {
             IntSetVal* isv0 = eval_intset(env,id0->decl()->ti()->domain());
             IntSetVal* isv1 = eval_intset(env,id1->decl()->ti()->domain());
-            IntSetRanges isv0r(isv0);
-            IntSetRanges isv1r(isv1);
-            Ranges::Inter<IntVal,IntSetRanges,IntSetRanges> inter(isv0r,isv1r);
-            IntSetVal* nd = IntSetVal::ai(inter);
+            IntSetVal* nd = IntSetVal::intersect(isv0,isv1);
             if (nd->size()==0) {
               env.fail();
             } else if (nd->card() != isv1->card()) {
@@ -234,6 +232,8 @@ namespace MiniZinc {
                           std::deque<Item*>& constraintQueue,
                           std::deque<int>& vardeclQueue);
   
+  void mergeLinearConstraints(EnvI& env, std::vector<VarDecl*>& deletedVarDecls);
+  
   void pushVarDecl(EnvI& env, VarDeclI* vdi, int vd_idx, std::deque<int>& q) {
     if (!vdi->removed() && !vdi->flag()) {
       vdi->flag(true);
@@ -742,6 +742,9 @@ namespace MiniZinc {
 
       }
       
+      if (envi.mergeLinear)
+        mergeLinearConstraints(envi, deletedVarDecls);
+      
       while (!deletedVarDecls.empty()) {
         VarDecl* cur = deletedVarDecls.back(); deletedVarDecls.pop_back();
         if (envi.vo.occurrences(cur) == 0) {
@@ -1159,9 +1162,7 @@ namespace MiniZinc {
                 } else if (vdi->e()->e()->type().isintset()) {
                   IntSetVal* isv = eval_intset(env, vdi->e()->e());
                   IntSetVal* dom = eval_intset(env, vdi->e()->ti()->domain());
-                  IntSetRanges isv_r(isv);
-                  IntSetRanges dom_r(dom);
-                  if (!Ranges::subset(isv_r, dom_r))
+                  if (!IntSetVal::subset(isv, dom))
                     env.fail();
                 } else if (vdi->e()->e()->type().isfloat()) {
                   FloatVal fv = eval_float(env, vdi->e()->e());
@@ -1474,4 +1475,322 @@ namespace MiniZinc {
     }
   }
 
+
+  namespace {
+
+    /// A linear constraint  sum c[i]*x[i] <= d  (or = d)  in canonical form:
+    /// variables sorted and merged, fixed terms moved into d, and integer
+    /// coefficients divided by their gcd. Equalities have a positive first
+    /// coefficient.
+    template<class Lit>
+    struct LinRow {
+      typedef typename LinearTraits<Lit>::Val Val;
+      ConstraintI* ci;
+      bool eq;
+      std::vector<Val> c;
+      std::vector<KeepAlive> x;
+      Val d;
+      /// Whether the constraint is annotated (e.g. defines a variable)
+      bool pinned;
+    };
+
+    long long int gcd(long long int a, long long int b) {
+      while (b != 0) {
+        long long int t = a % b;
+        a = b;
+        b = t;
+      }
+      return a;
+    }
+
+    /// Normalise coefficients and right hand side, return false if the row
+    /// has no integer solution
+    bool normaliseLinRow(LinRow<IntLit>& r) {
+      long long int g = 0;
+      for (unsigned int i=0; i<r.c.size(); i++)
+        g = gcd(g, std::abs(r.c[i].toInt()));
+      if (g > 1) {
+        long long int d = r.d.toInt();
+        long long int q = d / g;
+        if (d % g != 0) {
+          if (r.eq)
+            return false;
+          if (d < 0)
+            q--;
+        }
+        for (unsigned int i=0; i<r.c.size(); i++)
+          r.c[i] = r.c[i].toInt() / g;
+        r.d = q;
+      }
+      if (r.eq && r.c.size() > 0 && r.c[0] < 0) {
+        for (unsigned int i=0; i<r.c.size(); i++)
+          r.c[i] = -r.c[i];
+        r.d = -r.d;
+      }
+      return true;
+    }
+    bool normaliseLinRow(LinRow<FloatLit>& r) {
+      // Scaling float coefficients would not be exact
+      if (r.eq && r.c.size() > 0 && r.c[0] < 0) {
+        for (unsigned int i=0; i<r.c.size(); i++)
+          r.c[i] = -r.c[i];
+        r.d = -r.d;
+      }
+      return true;
+    }
+
+    /// Whether the domain of \a vd is the single value \a v
+    bool fixedByDomain(EnvI& env, VarDecl* vd, IntVal& v) {
+      IntSetVal* dom = eval_intset(env, vd->ti()->domain());
+      if (dom->size() != 1 || dom->min() != dom->max())
+        return false;
+      v = dom->min();
+      return v.isFinite();
+    }
+    bool fixedByDomain(EnvI& env, VarDecl* vd, FloatVal& v) {
+      FloatSetVal* dom = eval_floatset(env, vd->ti()->domain());
+      if (dom->size() != 1 || dom->min() != dom->max())
+        return false;
+      v = dom->min();
+      return v.isFinite();
+    }
+
+    template<class Lit>
+    bool canonicalLinRow(EnvI& env, ConstraintI* ci, bool eq, LinRow<Lit>& r) {
+      Call* c = ci->e()->cast<Call>();
+      ArrayLit* al_x = follow_id(c->args()[1])->dyn_cast<ArrayLit>();
+      if (al_x==NULL)
+        return false;
+      ArrayLit* al_c = eval_array_lit(env, c->args()[0]);
+      r.ci = ci;
+      r.eq = eq;
+      r.pinned = !c->ann().isEmpty();
+      for (unsigned int i=0; i<al_c->v().size(); i++) {
+        r.c.push_back(LinearTraits<Lit>::eval(env, al_c->v()[i]));
+        r.x.push_back(al_x->v()[i]);
+      }
+      typename LinearTraits<Lit>::Val d = 0;
+      simplify_lin<Lit>(r.c, r.x, d);
+      // Variables fixed only through their domain
+      for (unsigned int i=0; i<r.x.size();) {
+        Expression* xi = r.x[i]();
+        Id* id = xi->dyn_cast<Id>();
+        typename LinearTraits<Lit>::Val v;
+        if (id && id->decl()->ti()->domain() && fixedByDomain(env, id->decl(), v)) {
+          d += r.c[i]*v;
+          r.c.erase(r.c.begin()+i);
+          r.x.erase(r.x.begin()+i);
+        } else {
+          i++;
+        }
+      }
+      r.d = LinearTraits<Lit>::eval(env, c->args()[2]) - d;
+      for (unsigned int i=0; i<r.x.size(); i++) {
+        Expression* x = r.x[i]();
+        if (!x->isa<Id>())
+          return false;
+      }
+      return true;
+    }
+
+    template<class Lit>
+    size_t hashLinRow(const LinRow<Lit>& r, bool negated) {
+      HASH_NAMESPACE::hash<typename LinearTraits<Lit>::Val> hv;
+      HASH_NAMESPACE::hash<VarDecl*> hx;
+      size_t h = r.c.size();
+      for (unsigned int i=0; i<r.c.size(); i++) {
+        h ^= hv(negated ? -r.c[i] : r.c[i]) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        h ^= hx(r.x[i]()->template cast<Id>()->decl()) + 0x9e3779b9 + (h << 6) + (h >> 2);
+      }
+      return h;
+    }
+
+    /// Whether \a r0 and \a r1 (negated if \a negated) have the same coefficients
+    template<class Lit>
+    bool sameLinTerms(const LinRow<Lit>& r0, const LinRow<Lit>& r1, bool negated) {
+      if (r0.c.size() != r1.c.size())
+        return false;
+      for (unsigned int i=0; i<r0.c.size(); i++) {
+        if ((negated ? -r1.c[i] : r1.c[i]) != r0.c[i] ||
+            r0.x[i]()->template cast<Id>()->decl() != r1.x[i]()->template cast<Id>()->decl())
+          return false;
+      }
+      return true;
+    }
+
+    /// Rows with the same coefficients, indexed by hash
+    typedef UNORDERED_NAMESPACE::unordered_map<size_t,std::vector<int> > LinRowIndex;
+
+    template<class Lit>
+    int findLinRow(const std::vector<LinRow<Lit> >& rows, LinRowIndex& index,
+                   const LinRow<Lit>& r, bool negated) {
+      LinRowIndex::iterator it = index.find(hashLinRow(r, negated));
+      if (it != index.end()) {
+        for (unsigned int i=0; i<it->second.size(); i++)
+          if (sameLinTerms(rows[it->second[i]], r, negated))
+            return it->second[i];
+      }
+      return -1;
+    }
+
+    void removeLinRow(EnvI& env, ConstraintI* ci, std::vector<VarDecl*>& deletedVarDecls) {
+      CollectDecls cd(env.vo,deletedVarDecls,ci);
+      topDown(cd,ci->e());
+      env.flat_removeItem(ci);
+    }
+
+    /// Intersect the domain of \a vd with [lb,ub]. Returns false, leaving
+    /// the domain alone, if the result would be unbounded: FlatZinc has no
+    /// half-infinite domains
+    bool tightenDomain(EnvI& env, VarDecl* vd, IntVal lb, IntVal ub) {
+      IntSetVal* dom = vd->ti()->domain() ? eval_intset(env, vd->ti()->domain())
+                                          : IntSetVal::a(-IntVal::infinity(), IntVal::infinity());
+      IntSetVal* ndom = LinearTraits<IntLit>::intersect_domain(dom, lb, ub);
+      if (ndom->size()==0) {
+        env.fail();
+        return true;
+      }
+      if (!ndom->min().isFinite() || !ndom->max().isFinite())
+        return false;
+      vd->ti()->domain(new SetLit(Location().introduce(), ndom));
+      vd->ti()->setComputedDomain(false);
+      return true;
+    }
+    bool tightenDomain(EnvI& env, VarDecl* vd, FloatVal lb, FloatVal ub) {
+      FloatSetVal* dom = vd->ti()->domain() ? eval_floatset(env, vd->ti()->domain()) : NULL;
+      FloatSetVal* ndom = LinearTraits<FloatLit>::intersect_domain(dom, lb, ub);
+      if (ndom->size()==0) {
+        env.fail();
+        return true;
+      }
+      if (!ndom->min().isFinite() || !ndom->max().isFinite())
+        return false;
+      vd->ti()->domain(new SetLit(Location().introduce(), ndom));
+      vd->ti()->setComputedDomain(false);
+      return true;
+    }
+
+    template<class Lit>
+    void mergeLinearRows(EnvI& env, const ASTString& id_le, const ASTString& id_eq,
+                         const ASTString& id_bound, std::vector<VarDecl*>& deletedVarDecls) {
+      typedef typename LinearTraits<Lit>::Val Val;
+      Model& m = *env.flat();
+      std::vector<LinRow<Lit> > rows;
+      LinRowIndex le;
+      LinRowIndex eq;
+      for (unsigned int i=0; i<m.size(); i++) {
+        ConstraintI* ci = m[i]->dyn_cast<ConstraintI>();
+        if (ci==NULL || ci->removed())
+          continue;
+        Call* c = ci->e()->dyn_cast<Call>();
+        if (c==NULL || c->args().size() != 3 || (c->id() != id_le && c->id() != id_eq))
+          continue;
+        rows.push_back(LinRow<Lit>());
+        LinRow<Lit>& r = rows.back();
+        if (!canonicalLinRow<Lit>(env, ci, c->id()==id_eq, r)) {
+          rows.pop_back();
+          continue;
+        }
+        if (!normaliseLinRow(r))
+          env.fail();
+        if (r.c.empty()) {
+          if (r.eq ? r.d != 0 : r.d < 0)
+            env.fail();
+          if (!r.pinned) {
+            removeLinRow(env, ci, deletedVarDecls);
+            ++env.n_linear_dominated;
+          }
+          rows.pop_back();
+          continue;
+        }
+        if (r.c.size()==1 && (r.c[0]==1 || r.c[0]==-1) && !r.pinned) {
+          // A bound on a single variable
+          VarDecl* vd = r.x[0]()->template cast<Id>()->decl();
+          Val inf = Val::infinity();
+          bool tightened;
+          if (r.eq)
+            tightened = tightenDomain(env, vd, r.d, r.d);
+          else if (r.c[0]==1)
+            tightened = tightenDomain(env, vd, -inf, r.d);
+          else
+            tightened = tightenDomain(env, vd, -r.d, inf);
+          if (tightened) {
+            ++env.n_linear_bounds;
+          } else {
+            // Keep the bound as a constraint, added before removing the
+            // row so that vd stays in use
+            std::vector<Expression*> args(2);
+            args[r.c[0]==1 ? 0 : 1] = vd->id();
+            args[r.c[0]==1 ? 1 : 0] = Lit::a(r.c[0]==1 ? r.d : -r.d);
+            Call* call = new Call(Location().introduce(), id_bound, args);
+            call->type(Type::varbool());
+            call->decl(env.orig->matchFn(env, call, false));
+            env.flat_addItem(new ConstraintI(Location().introduce(), call));
+          }
+          removeLinRow(env, ci, deletedVarDecls);
+          rows.pop_back();
+          continue;
+        }
+        int idx = rows.size()-1;
+        LinRowIndex& index = r.eq ? eq : le;
+        int k = findLinRow(rows, index, r, false);
+        if (k == -1) {
+          index[hashLinRow(r, false)].push_back(idx);
+          continue;
+        }
+        LinRow<Lit>& rk = rows[k];
+        if (r.eq) {
+          // Parallel equalities
+          if (r.d != rk.d)
+            env.fail();
+          if (!r.pinned) {
+            removeLinRow(env, ci, deletedVarDecls);
+            ++env.n_linear_duplicates;
+          } else if (!rk.pinned) {
+            removeLinRow(env, rk.ci, deletedVarDecls);
+            ++env.n_linear_duplicates;
+            rk = r;
+          }
+        } else {
+          // Keep the row with the smaller right hand side
+          if (r.d >= rk.d && !r.pinned) {
+            removeLinRow(env, ci, deletedVarDecls);
+            ++env.n_linear_dominated;
+          } else if (r.d <= rk.d) {
+            if (!rk.pinned) {
+              removeLinRow(env, rk.ci, deletedVarDecls);
+              ++env.n_linear_dominated;
+            }
+            rk = r;
+          }
+        }
+        rows.pop_back();
+      }
+      // Inequalities implied by an equality with the same (or negated) coefficients
+      for (LinRowIndex::iterator it = le.begin(); it != le.end(); ++it) {
+        for (unsigned int i=0; i<it->second.size(); i++) {
+          LinRow<Lit>& r = rows[it->second[i]];
+          bool negated = r.c[0] < 0;
+          int k = findLinRow(rows, eq, r, negated);
+          if (k == -1)
+            continue;
+          if ((negated ? -rows[k].d : rows[k].d) > r.d)
+            env.fail();
+          if (!r.pinned) {
+            removeLinRow(env, r.ci, deletedVarDecls);
+            ++env.n_linear_dominated;
+          }
+        }
+      }
+    }
+
+  }
+
+  void mergeLinearConstraints(EnvI& env, std::vector<VarDecl*>& deletedVarDecls) {
+    mergeLinearRows<IntLit>(env, constants().ids.int_.lin_le, constants().ids.int_.lin_eq,
+                            constants().ids.int_.le, deletedVarDecls);
+    mergeLinearRows<FloatLit>(env, constants().ids.float_.lin_le, constants().ids.float_.lin_eq,
+                              constants().ids.float_.le, deletedVarDecls);
+  }
+
 }
@@ -0,0 +1,99 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <minizinc/output_pipeline.hh>
+#include <minizinc/exception.hh>
+
+#include <iostream>
+#include <cassert>
+
+namespace MiniZinc {
+
+  SolutionPipeline::SolutionPipeline(Renderer r, int capacity, bool fCoalesce)
+    : _render(r), _ring(capacity<1 ? 1 : capacity), _fCoalesce(fCoalesce) {
+    _thread = std::thread(&SolutionPipeline::run, this);
+  }
+
+  SolutionPipeline::~SolutionPipeline() {
+    {
+      std::unique_lock<std::mutex> lck(_mtx);
+      _fStop = true;
+    }
+    _cvFilled.notify_all();
+    if (_thread.joinable())
+      _thread.join();
+  }
+
+  void SolutionPipeline::push(const Filler& f) {
+    std::lock_guard<std::mutex> lckPush(_mtxPush);
+    size_t iSlot;
+    {
+      std::unique_lock<std::mutex> lck(_mtx);
+      if (_size == _ring.size() && _fCoalesce) {
+        /// Drop the oldest pending snapshot, its slot is reused below
+        _head = (_head+1) % _ring.size();
+        --_size;
+        ++_nCoalesced;
+      }
+      while (_size == _ring.size())
+        _cvFree.wait(lck);
+      iSlot = (_head+_size) % _ring.size();
+    }
+    /// The renderer never touches slots beyond _head+_size
+    SolutionSnapshot& slot = _ring[iSlot];
+    slot.clear();
+    f(slot);
+    {
+      std::unique_lock<std::mutex> lck(_mtx);
+      assert( (_head+_size) % _ring.size() == iSlot );
+      ++_size;
+      ++_nPushed;
+    }
+    _cvFilled.notify_one();
+  }
+
+  void SolutionPipeline::drain() {
+    std::unique_lock<std::mutex> lck(_mtx);
+    while (_size || _fBusy)
+      _cvFree.wait(lck);
+  }
+
+  void SolutionPipeline::run() {
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lck(_mtx);
+        while (0==_size && !_fStop)
+          _cvFilled.wait(lck);
+        if (0==_size)
+          break;      // stopped and nothing left
+        std::swap(_ring[_head], _current);
+        _head = (_head+1) % _ring.size();
+        --_size;
+        _fBusy = true;
+      }
+      _cvFree.notify_all();
+      try {
+        _render(_current);
+      } catch (const Exception& e) {
+        std::cerr << std::endl;
+        std::cerr << "  Error when rendering a solution:  " << e.what() << ": " << e.msg() << std::endl;
+      } catch (const std::exception& e) {
+        std::cerr << std::endl;
+        std::cerr << "  Error when rendering a solution:  " << e.what() << std::endl;
+      } catch (...) {
+        std::cerr << std::endl;
+        std::cerr << "  Error when rendering a solution:  " << "  UNKNOWN EXCEPTION." << std::endl;
+      }
+      {
+        std::unique_lock<std::mutex> lck(_mtx);
+        _fBusy = false;
+        ++_nRendered;
+      }
+      _cvFree.notify_all();
+    }
+  }
+
+}
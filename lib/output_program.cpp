@@ -0,0 +1,419 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <minizinc/output_program.hh>
+#include <minizinc/ast.hh>
+#include <minizinc/astiterator.hh>
+#include <minizinc/eval_par.hh>
+#include <minizinc/prettyprinter.hh>
+#include <minizinc/flatten_internal.hh>
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <sstream>
+#include <limits>
+
+namespace MiniZinc {
+
+  namespace {
+    /// Finds identifiers of solution-dependent variables.
+    /// Calls of functions with a body are not looked into, so count as dependent
+    class SolutionDependence : public EVisitor {
+    public:
+      const std::unordered_set<VarDecl*>& _solVars;
+      const std::unordered_set<VarDecl*>& _derived;
+      bool _found = false;
+      SolutionDependence(const std::unordered_set<VarDecl*>& sv,
+                         const std::unordered_set<VarDecl*>& dv)
+        : _solVars(sv), _derived(dv) {}
+      bool enter(Expression*) { return !_found; }
+      void vId(const Id& id) {
+        VarDecl* vd = id.decl();
+        if (vd && (_solVars.count(vd) || _derived.count(vd)))
+          _found = true;
+      }
+      void vCall(const Call& c) {
+        if (c.decl() && c.decl()->e())
+          _found = true;
+      }
+    };
+
+    bool isCall(Expression* e, const char* name, unsigned int nArgs) {
+      Call* c = e->dyn_cast<Call>();
+      return c && c->args().size()==nArgs && c->id().str()==name;
+    }
+
+    void appendFloat(std::string& buf, double d) {
+      if (!std::isfinite(d)) {
+        buf += d>0 ? "infinity" : "-infinity";
+        return;
+      }
+      /// As ppFloatVal()
+      char s[64];
+      int n = snprintf(s, sizeof(s), "%.*g", std::numeric_limits<double>::digits10+1, d);
+      buf.append(s, n);
+      if (0==strchr(s, 'e') && 0==strchr(s, '.'))
+        buf += ".0";
+    }
+
+    void appendValue(std::string& buf, const SolutionValue& sv, int justify) {
+      const size_t pos = buf.size();
+      switch (sv.kind) {
+        case SolutionValue::SV_INT:
+        {
+          char s[32];
+          int n = snprintf(s, sizeof(s), "%lld", sv.i);
+          buf.append(s, n);
+          break;
+        }
+        case SolutionValue::SV_BOOL:
+          buf += sv.i ? "true" : "false";
+          break;
+        case SolutionValue::SV_FLOAT:
+          appendFloat(buf, sv.f);
+          break;
+        case SolutionValue::SV_TEXT:
+          buf += sv.s;
+          break;
+        default:
+          if (sv.e) {
+            std::ostringstream oss;
+            Printer p(oss,0,false);
+            p.print(sv.e);
+            buf += oss.str();
+          }
+      }
+      if (justify) {
+        const int len = static_cast<int>(buf.size()-pos);
+        if (justify > len)
+          buf.insert(pos, justify-len, ' ');
+        else if (-justify > len)
+          buf.append(-justify-len, ' ');
+      }
+    }
+
+    bool literalValue(Expression* e, SolutionValue& sv) {
+      if (IntLit* il = e->dyn_cast<IntLit>()) {
+        if (!il->v().isFinite())
+          return false;
+        sv = SolutionValue::mkInt(il->v().toInt());
+      } else if (FloatLit* fl = e->dyn_cast<FloatLit>()) {
+        sv = SolutionValue::mkFloat(fl->v().toDouble());
+      } else if (BoolLit* bl = e->dyn_cast<BoolLit>()) {
+        sv = SolutionValue::mkBool(bl->v());
+      } else {
+        return false;
+      }
+      return true;
+    }
+  }
+
+  /// Compiles the elements of a comprehension while eval_comp() binds its generators
+  class EvalOutputElement {
+  public:
+    typedef bool ArrayVal;
+    OutputProgram& _op;
+    const std::string* _sep;
+    bool& _fFirst;
+    EvalOutputElement(OutputProgram& op, const std::string* sep, bool& fFirst)
+      : _op(op), _sep(sep), _fFirst(fFirst) {}
+    bool e(EnvI&, Expression* e) { return _op.compileElement(e, _sep, _fFirst); }
+  };
+
+  bool OutputProgram::compile(EnvI& env, Expression* outputExpr,
+                              const std::vector<VarDecl*>& solVars) {
+    _ops.clear();
+    _text.clear();
+    _vars.clear();
+    _varSize.clear();
+    _varFirst.clear();
+    _varIdx.clear();
+    _varRanges.clear();
+    _nValues = 0;
+    _fCompiled = false;
+    _env = &env;
+    _solVars.clear();
+    _solVars.insert(solVars.begin(), solVars.end());
+    _derived.clear();
+    /// Output model variables defined in terms of the solution
+    for (bool fChanged=true; fChanged; ) {
+      fChanged = false;
+      for (VarDeclIterator it = env.output->begin_vardecls(); it != env.output->end_vardecls(); ++it) {
+        VarDecl* vd = it->e();
+        if (vd->e() && !_solVars.count(vd) && !_derived.count(vd) && dependsOnSolution(vd->e())) {
+          _derived.insert(vd);
+          fChanged = true;
+        }
+      }
+    }
+    bool fFirst = true;
+    _fCompiled = compileStringArray(outputExpr, NULL, fFirst);
+    _solVars.clear();
+    _derived.clear();
+    _varIdx.clear();
+    _varRanges.clear();
+    if (!_fCompiled) {
+      _ops.clear();
+      _text.clear();
+    }
+    return _fCompiled;
+  }
+
+  bool OutputProgram::dependsOnSolution(Expression* e) const {
+    SolutionDependence sd(_solVars, _derived);
+    topDown(sd, e);
+    return sd._found;
+  }
+
+  int OutputProgram::findVar(VarDecl* vd) {
+    auto it = _varIdx.find(vd);
+    if (it != _varIdx.end())
+      return it->second;
+    int& iVar = _varIdx[vd];
+    iVar = -1;
+    Type t = vd->type();
+    if (t.isopt() || t.st()!=Type::ST_PLAIN || t.enumId()!=0 ||
+        (t.bt()!=Type::BT_INT && t.bt()!=Type::BT_BOOL && t.bt()!=Type::BT_FLOAT))
+      return -1;
+    std::vector<std::pair<long long int, long long int> > ranges;
+    long long int size = 1;
+    for (unsigned int i=0; i<vd->ti()->ranges().size(); i++) {
+      Expression* dom = vd->ti()->ranges()[i]->domain();
+      if (dom==NULL)
+        return -1;
+      IntSetVal* isv = eval_intset(*_env, dom);
+      if (isv->size()==0) {
+        ranges.push_back(std::make_pair(1ll, 0ll));
+        size = 0;
+      } else {
+        if (isv->size()!=1 || !isv->min().isFinite() || !isv->max().isFinite())
+          return -1;
+        ranges.push_back(std::make_pair(isv->min().toInt(), isv->max().toInt()));
+        size *= ranges.back().second-ranges.back().first+1;
+      }
+    }
+    if (size > std::numeric_limits<int>::max()-_nValues)
+      return -1;
+    iVar = static_cast<int>(_vars.size());
+    _vars.push_back(vd);
+    _varSize.push_back(static_cast<int>(size));
+    _varFirst.push_back(_nValues);
+    _varRanges.push_back(ranges);
+    _nValues += static_cast<int>(size);
+    return iVar;
+  }
+
+  void OutputProgram::addText(const std::string& s) {
+    if (s.empty())
+      return;
+    if (!_ops.empty() && OP_TEXT==_ops.back().kind) {
+      _ops.back().b += static_cast<int>(s.size());
+    } else {
+      Op op = { OP_TEXT, static_cast<int>(_text.size()), static_cast<int>(s.size()), 0 };
+      _ops.push_back(op);
+    }
+    _text += s;
+  }
+
+  bool OutputProgram::compileStringArray(Expression* e, const std::string* sep, bool& fFirst) {
+    if (ArrayLit* al = e->dyn_cast<ArrayLit>()) {
+      for (unsigned int i=0; i<al->v().size(); i++)
+        if (!compileElement(al->v()[i], sep, fFirst))
+          return false;
+      return true;
+    }
+    if (BinOp* bo = e->dyn_cast<BinOp>()) {
+      if (bo->op()==BOT_PLUSPLUS)
+        return compileStringArray(bo->lhs(), sep, fFirst) &&
+          compileStringArray(bo->rhs(), sep, fFirst);
+    }
+    if (Comprehension* c = e->dyn_cast<Comprehension>()) {
+      if (!c->set())
+        return compileComprehension(c, sep, fFirst);
+      return false;
+    }
+    if (!dependsOnSolution(e)) {
+      ArrayLit* al = eval_array_lit(*_env, e);
+      for (unsigned int i=0; i<al->v().size(); i++)
+        if (!compileElement(al->v()[i], sep, fFirst))
+          return false;
+      return true;
+    }
+    return false;
+  }
+
+  bool OutputProgram::compileComprehension(Comprehension* c, const std::string* sep, bool& fFirst) {
+    for (int i=0; i<c->n_generators(); i++)
+      if (dependsOnSolution(c->in(i)))
+        return false;
+    if (c->where() && dependsOnSolution(c->where()))
+      return false;
+    EvalOutputElement eval(*this, sep, fFirst);
+    std::vector<bool> a = eval_comp<EvalOutputElement>(*_env, eval, c);
+    for (unsigned int i=0; i<a.size(); i++)
+      if (!a[i])
+        return false;
+    return true;
+  }
+
+  bool OutputProgram::compileElement(Expression* e, const std::string* sep, bool& fFirst) {
+    if (sep && !fFirst)
+      addText(*sep);
+    fFirst = false;
+    return compileString(e);
+  }
+
+  bool OutputProgram::compileString(Expression* e) {
+    if (StringLit* sl = e->dyn_cast<StringLit>()) {
+      addText(sl->v().str());
+      return true;
+    }
+    if (!dependsOnSolution(e)) {
+      addText(eval_string(*_env, e));
+      return true;
+    }
+    if (BinOp* bo = e->dyn_cast<BinOp>()) {
+      if (bo->op()==BOT_PLUSPLUS)
+        return compileString(bo->lhs()) && compileString(bo->rhs());
+      return false;
+    }
+    if (ITE* ite = e->dyn_cast<ITE>()) {
+      for (int i=0; i<ite->size(); i++) {
+        if (dependsOnSolution(ite->e_if(i)))
+          return false;
+        if (eval_bool(*_env, ite->e_if(i)))
+          return compileString(ite->e_then(i));
+      }
+      return compileString(ite->e_else());
+    }
+    if (Call* c = e->dyn_cast<Call>()) {
+      if (isCall(c, "show", 1))
+        return compileShow(c->args()[0], 0);
+      if (isCall(c, "show_int", 2)) {
+        if (dependsOnSolution(c->args()[0]))
+          return false;
+        int justify = static_cast<int>(eval_int(*_env, c->args()[0]).toInt());
+        return compileShow(c->args()[1], justify);
+      }
+      bool fFirst = true;
+      if (isCall(c, "concat", 1))
+        return compileStringArray(c->args()[0], NULL, fFirst);
+      if (isCall(c, "join", 2)) {
+        if (dependsOnSolution(c->args()[0]))
+          return false;
+        std::string sep = eval_string(*_env, c->args()[0]);
+        return compileStringArray(c->args()[1], &sep, fFirst);
+      }
+    }
+    return false;
+  }
+
+  bool OutputProgram::compileShow(Expression* e, int justify) {
+    while (isCall(e, "fix", 1))
+      e = e->cast<Call>()->args()[0];
+    if (Id* id = e->dyn_cast<Id>()) {
+      VarDecl* vd = id->decl();
+      if (vd==NULL || !_solVars.count(vd))
+        return false;
+      int iVar = findVar(vd);
+      if (iVar < 0)
+        return false;
+      if (vd->type().dim()==0) {
+        if (justify && vd->type().bt()!=Type::BT_INT)
+          return false;
+        Op op = { OP_VALUE, _varFirst[iVar], 1, justify };
+        _ops.push_back(op);
+      } else {
+        if (justify)
+          return false;
+        Op op = { OP_ARRAY, _varFirst[iVar], _varSize[iVar], 0 };
+        _ops.push_back(op);
+      }
+      return true;
+    }
+    if (ArrayAccess* aa = e->dyn_cast<ArrayAccess>()) {
+      Id* id = aa->v()->dyn_cast<Id>();
+      if (id==NULL || id->decl()==NULL || !_solVars.count(id->decl()))
+        return false;
+      int iVar = findVar(id->decl());
+      if (iVar < 0)
+        return false;
+      if (justify && id->decl()->type().bt()!=Type::BT_INT)
+        return false;
+      const std::vector<std::pair<long long int, long long int> >& ranges = _varRanges[iVar];
+      if (aa->idx().size()!=ranges.size())
+        return false;
+      long long int iFlat = 0;
+      for (unsigned int i=0; i<ranges.size(); i++) {
+        if (dependsOnSolution(aa->idx()[i]))
+          return false;
+        IntVal iv = eval_int(*_env, aa->idx()[i]);
+        if (!iv.isFinite() || iv.toInt()<ranges[i].first || iv.toInt()>ranges[i].second)
+          return false;       // the evaluator reports the error
+        iFlat = iFlat*(ranges[i].second-ranges[i].first+1) + (iv.toInt()-ranges[i].first);
+      }
+      Op op = { OP_VALUE, _varFirst[iVar]+static_cast<int>(iFlat), 1, justify };
+      _ops.push_back(op);
+      return true;
+    }
+    return false;
+  }
+
+  bool OutputProgram::readValues(std::vector<SolutionValue>& values) const {
+    values.resize(_nValues);
+    for (unsigned int i=0; i<_vars.size(); i++) {
+      Expression* e = _vars[i]->e();
+      if (e==NULL)
+        return false;
+      if (_vars[i]->type().dim()==0) {
+        if (!literalValue(e, values[_varFirst[i]]))
+          return false;
+        continue;
+      }
+      if (Call* c = e->dyn_cast<Call>()) {     // arrayXd() from a parsed solution
+        if (c->args().size()==0)
+          return false;
+        e = c->args()[c->args().size()-1];
+      }
+      ArrayLit* al = e->dyn_cast<ArrayLit>();
+      if (al==NULL || al->v().size()!=static_cast<unsigned int>(_varSize[i]))
+        return false;
+      for (unsigned int j=0; j<al->v().size(); j++)
+        if (!literalValue(al->v()[j], values[_varFirst[i]+j]))
+          return false;
+    }
+    return true;
+  }
+
+  void OutputProgram::render(const std::vector<SolutionValue>& values, std::string& buf) const {
+    buf.clear();
+    for (unsigned int i=0; i<_ops.size(); i++) {
+      const Op& op = _ops[i];
+      switch (op.kind) {
+        case OP_TEXT:
+          buf.append(_text, op.a, op.b);
+          break;
+        case OP_VALUE:
+          appendValue(buf, values[op.a], op.justify);
+          break;
+        case OP_ARRAY:
+          buf += '[';
+          for (int j=0; j<op.b; j++) {
+            if (j)
+              buf += ", ";
+            appendValue(buf, values[op.a+j], 0);
+          }
+          buf += ']';
+          break;
+      }
+    }
+    /// As EnvI::evalOutput()
+    if (!buf.empty() && '\n'!=buf.back())
+      buf += '\n';
+  }
+
+}
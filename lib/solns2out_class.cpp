@@ -16,7 +16,11 @@
 #endif
 
 #include <minizinc/solns2out.hh>
+#include <minizinc/eval_par.hh>
 #include <fstream>
+#include <limits>
+#include <sstream>
+#include <cctype>
 
 using namespace std;
 using namespace MiniZinc;
@@ -44,6 +48,11 @@ void Solns2Out::printHelp(ostream& os)
   << "  --no-output-comments\n    Do not print comments in the FlatZinc solution stream." << std::endl
   << "  --output-time\n    Print timing information in the FlatZinc solution stream." << std::endl
   << "  --no-flush-output\n    Don't flush output stream after every line." << std::endl
+  << "  --async-output\n    Print solutions in a separate thread (linked solvers only). Compiles the\n    output item (see --output-compiled) and is only used when that succeeds,\n    not with JSON-lines output." << std::endl
+  << "  --async-output-buffer <n>\n    Number of pending solutions buffered for asynchronous output. The default: 4." << std::endl
+  << "  --coalesce-output\n    With --async-output, skip older pending solutions when output falls behind." << std::endl
+  << "  --output-json-lines\n    Print each solution, status, statistics and comments as a one-line JSON object\n    built directly from the solution values (the output item is not used)." << std::endl
+  << "  --output-compiled\n    Compile the output item once instead of evaluating it for every solution." << std::endl
   ;
 }
 
@@ -59,6 +68,15 @@ bool Solns2Out::processOption(int& i, const int argc, const char** argv)
   } else if ( cop.getOption( "-i --ignore-lines --ignore-leading-lines", &_opt.flag_ignore_lines ) ) {
   } else if ( cop.getOption( "--output-time" ) ) {
     _opt.flag_output_time = true;
+  } else if ( cop.getOption( "--async-output" ) ) {
+    _opt.flag_output_async = true;
+  } else if ( cop.getOption( "--async-output-buffer", &_opt.flag_output_async_buffer ) ) {
+  } else if ( cop.getOption( "--coalesce-output" ) ) {
+    _opt.flag_output_coalesce = true;
+  } else if ( cop.getOption( "--output-json-lines" ) ) {
+    _opt.flag_output_json_lines = true;
+  } else if ( cop.getOption( "--output-compiled" ) ) {
+    _opt.flag_output_compiled = true;
   } else if ( cop.getOption( "--soln-sep --soln-separator --solution-separator", &_opt.solution_separator ) ) {
   } else if ( cop.getOption( "--soln-comma --solution-comma", &_opt.solution_comma ) ) {
   } else if ( cop.getOption( "--unsat-msg --unsatisfiable-msg", &_opt.unsatisfiable_msg ) ) {
@@ -161,45 +179,353 @@ void Solns2Out::parseAssignments(string& solution) {
   declNewOutput();
 }
 
+OutputProgram* Solns2Out::getOutputProgram() {
+  if ( 0==outputExpr || _opt.flag_output_json_lines ||
+       !( _opt.flag_output_compiled || _opt.flag_output_async ) )
+    return 0;
+  if ( !fOutputProgramTried ) {
+    fOutputProgramTried = true;
+    prepareOutputMap();
+    std::vector<VarDecl*> solVars;
+    for ( auto& de : declmap )
+      if ( 0==de.second.second() )        // assigned by the solver
+        solVars.push_back( de.second.first );
+    try {
+      GCLock lock;
+      outputProgram.compile( pEnv->envi(), outputExpr, solVars );
+    } catch ( const Exception& ) {    // reported by the general evaluator
+    }
+  }
+  return outputProgram.compiled() ? &outputProgram : 0;
+}
+
+bool Solns2Out::evalOutput(const std::vector<SolutionValue>& values) {
+  pOutputValues = &values;
+  bool fRes = evalOutput();
+  pOutputValues = 0;
+  return fRes;
+}
+
 void Solns2Out::declNewOutput() {
   fNewSol2Print=true;
+  std::lock_guard<std::mutex> lck( mtxPrint );
   status = SolverInstance::SAT;
 }
 
+bool Solns2Out::renderOutput(const std::vector<SolutionValue>& values) {
+  assert( outputProgram.compiled() );
+  outputProgram.render( values, renderBuffer );
+  if (!_opt.solution_separator.empty())
+    renderBuffer += _opt.solution_separator + '\n';
+  printSolutionText( renderBuffer );
+  return true;
+}
+
 bool Solns2Out::evalOutput() {
   if ( !fNewSol2Print )
     return true;
   ostringstream oss;
-  if (!__evalOutput( oss, false ))
+  if ( _opt.flag_output_json_lines ) {
+    if (!__evalOutputJSON( oss ))
+      return false;
+  } else if (!__evalOutput( oss, false ))
     return false;
+  if ( !printSolutionText( oss.str() ) )
+    return true;
+  restoreDefaults();     // cleans data. evalOutput() should not be called again w/o assigning new data.
+  return true;
+}
+
+bool Solns2Out::printSolutionText( const std::string& sol ) {
+  std::lock_guard<std::mutex> lck( mtxPrint );
   if ( _opt.flag_unique || _opt.flag_canonicalize ) {
-    auto res = sSolsCanon.insert( oss.str() );
+    auto res = sSolsCanon.insert( sol );
     if ( !res.second )            // repeated solution
-      return true;
+      return false;
   }
   ++nSolns;
   if ( _opt.flag_canonicalize ) {
     if ( pOfs_non_canon.get() )
       if ( pOfs_non_canon->good() ) {
-        (*pOfs_non_canon) << oss.str();
-        (*pOfs_non_canon) << comments;
-        if (_opt.flag_output_time)
-          (*pOfs_non_canon) << "% time elapsed: " << stoptime(starttime) << "\n";
+        (*pOfs_non_canon) << sol;
+        if ( _opt.flag_output_json_lines ) {
+          if ( !comments.empty() )
+            printJSONRecord( *pOfs_non_canon, "comment", "text", comments );
+        } else {
+          (*pOfs_non_canon) << comments;
+          if (_opt.flag_output_time)
+            (*pOfs_non_canon) << "% time elapsed: " << stoptime(starttime) << "\n";
+        }
         if ( _opt.flag_output_flush )
           pOfs_non_canon->flush();
       }
   } else {
-    if ( _opt.solution_comma.size() && nSolns>1 )
+    if ( _opt.solution_comma.size() && nSolns>1 && !_opt.flag_output_json_lines )
       getOutput() << _opt.solution_comma << '\n';
-    getOutput() << oss.str();
+    getOutput() << sol;
     if ( _opt.flag_output_flush )
       getOutput().flush();
   }
-  getOutput() << comments;      // should not be sorted
+  if ( _opt.flag_output_json_lines ) {
+    if ( !comments.empty() )
+      printJSONRecord( getOutput(), "comment", "text", comments );
+  } else {
+    getOutput() << comments;      // should not be sorted
+    if (_opt.flag_output_time)
+      getOutput() << "% time elapsed: " << stoptime(starttime) << "\n";
+  }
   comments = "";
-  if (_opt.flag_output_time)
-    getOutput() << "% time elapsed: " << stoptime(starttime) << "\n";
-  restoreDefaults();     // cleans data. evalOutput() should not be called again w/o assigning new data.
+  return true;
+}
+
+namespace {
+  void writeJSONString( ostream& os, const std::string& s ) {
+    os << '"';
+    for ( char c : s ) {
+      switch ( c ) {
+        case '"': os << "\\\""; break;
+        case '\\': os << "\\\\"; break;
+        case '\n': os << "\\n"; break;
+        case '\t': os << "\\t"; break;
+        case '\r': os << "\\r"; break;
+        default:
+          if ( static_cast<unsigned char>(c) < 0x20 ) {
+            os << "\\u00" << "0123456789abcdef"[(c>>4)&0xf] << "0123456789abcdef"[c&0xf];
+          } else
+            os << c;
+      }
+    }
+    os << '"';
+  }
+
+  /// JSON has no infinity
+  void writeJSONNumber( ostream& os, IntVal v ) {
+    if ( v.isFinite() )
+      os << v;
+    else
+      os << "null";
+  }
+  void writeJSONNumber( ostream& os, FloatVal v ) {
+    if ( v.isFinite() )
+      os << v.toDouble();
+    else
+      os << "null";
+  }
+
+  void writeJSONValue( EnvI& env, ostream& os, Expression* e );
+
+  std::string trimmed( const std::string& s ) {
+    size_t b = s.find_first_not_of( " \t\r" );
+    if ( string::npos==b )
+      return "";
+    return s.substr( b, s.find_last_not_of( " \t\r" )-b+1 );
+  }
+
+  /// Whether \a v is a number in JSON syntax
+  bool isJSONNumber( const std::string& v ) {
+    size_t i = 0, n = v.size();
+    auto digits = [&]() { size_t i0 = i; while ( i<n && isdigit( v[i] ) ) ++i; return i>i0; };
+    if ( i<n && '-'==v[i] )
+      ++i;
+    if ( i<n && '0'==v[i] )
+      ++i;
+    else if ( !digits() )
+      return false;
+    if ( i<n && '.'==v[i] ) {
+      ++i;
+      if ( !digits() )
+        return false;
+    }
+    if ( i<n && ( 'e'==v[i] || 'E'==v[i] ) ) {
+      ++i;
+      if ( i<n && ( '+'==v[i] || '-'==v[i] ) )
+        ++i;
+      if ( !digits() )
+        return false;
+    }
+    return i==n;
+  }
+
+  /// A statistics value: a number if it is one, otherwise a string
+  void writeJSONStatValue( ostream& os, const std::string& v ) {
+    if ( isJSONNumber( v ) )
+      os << v;
+    else if ( v.size()>=2 && '"'==v[0] && '"'==v[v.size()-1] )
+      writeJSONString( os, v.substr( 1, v.size()-2 ) );
+    else
+      writeJSONString( os, v );
+  }
+
+  /// Split statistics lines into key/value pairs. Understood are
+  /// "%%%mzn-stat k=v" and "% k1, k2: v1, v2" with as many keys as values
+  /// (the legend form of the solver statistics). Other lines are
+  /// appended to \a rest
+  void parseStatistics( const std::string& stats,
+                        vector<pair<std::string,std::string> >& kv, std::string& rest ) {
+    istringstream iss( stats );
+    std::string line;
+    while ( getline( iss, line ) ) {
+      std::string l = trimmed( line );
+      if ( l.empty() )
+        continue;
+      if ( 0==l.compare( 0, 11, "%%%mzn-stat" ) ) {
+        l = trimmed( l.substr( 11 ) );
+        if ( l.size() && ':'==l[0] )
+          l = trimmed( l.substr( 1 ) );
+        size_t eq = l.find( '=' );
+        if ( string::npos!=eq && eq>0 )
+          kv.push_back( make_pair( trimmed( l.substr( 0, eq ) ), trimmed( l.substr( eq+1 ) ) ) );
+        continue;                   // e.g. %%%mzn-stat-end
+      }
+      size_t colon = l.find( ':' );
+      if ( '%'==l[0] && string::npos!=colon ) {
+        vector<std::string> keys, vals;
+        istringstream issK( l.substr( l.find_first_not_of( '%' ), colon-l.find_first_not_of( '%' ) ) );
+        istringstream issV( l.substr( colon+1 ) );
+        std::string item;
+        while ( getline( issK, item, ',' ) )
+          keys.push_back( trimmed( item ) );
+        while ( getline( issV, item, ',' ) )
+          vals.push_back( trimmed( item ) );
+        if ( 1==keys.size() ) {
+          vals.assign( 1, trimmed( l.substr( colon+1 ) ) );
+        }
+        if ( keys.size()==vals.size() && !keys[0].empty() ) {
+          for ( size_t i=0; i<keys.size(); ++i )
+            kv.push_back( make_pair( keys[i], vals[i] ) );
+          continue;
+        }
+      }
+      rest += line;
+      rest += '\n';
+    }
+  }
+
+  /// Nested lists for dimension \a d of \a al, starting at element \a idx
+  void writeJSONArray( EnvI& env, ostream& os, ArrayLit* al, int d, int& idx ) {
+    os << '[';
+    int n = al->max(d) - al->min(d) + 1;
+    for ( int i=0; i<n; ++i ) {
+      if ( i )
+        os << ',';
+      if ( d+1 < al->dims() )
+        writeJSONArray( env, os, al, d+1, idx );
+      else
+        writeJSONValue( env, os, al->v()[idx++] );
+    }
+    os << ']';
+  }
+
+  void writeJSONValue( EnvI& env, ostream& os, Expression* e ) {
+    if ( 0==e ) {
+      os << "null";
+      return;
+    }
+    switch ( e->eid() ) {
+      case Expression::E_INTLIT:
+        writeJSONNumber( os, e->cast<IntLit>()->v() );
+        break;
+      case Expression::E_FLOATLIT:
+        writeJSONNumber( os, e->cast<FloatLit>()->v() );
+        break;
+      case Expression::E_BOOLLIT:
+        os << ( e->cast<BoolLit>()->v() ? "true" : "false" );
+        break;
+      case Expression::E_STRINGLIT:
+        writeJSONString( os, e->cast<StringLit>()->v().str() );
+        break;
+      case Expression::E_SETLIT: {
+        SetLit* sl = e->cast<SetLit>();
+        os << "{\"set\":[";
+        /// Ranges as [min,max] pairs, as in show_json()
+        if ( IntSetVal* isv = sl->isv() ) {
+          for ( int i=0; i<isv->size(); ++i ) {
+            if ( i )
+              os << ',';
+            if ( isv->min(i)==isv->max(i) )
+              writeJSONNumber( os, isv->min(i) );
+            else {
+              os << '[';
+              writeJSONNumber( os, isv->min(i) );
+              os << ',';
+              writeJSONNumber( os, isv->max(i) );
+              os << ']';
+            }
+          }
+        } else if ( FloatSetVal* fsv = sl->fsv() ) {
+          for ( int i=0; i<fsv->size(); ++i ) {
+            if ( i )
+              os << ',';
+            if ( fsv->min(i)==fsv->max(i) )
+              writeJSONNumber( os, fsv->min(i) );
+            else {
+              os << '[';
+              writeJSONNumber( os, fsv->min(i) );
+              os << ',';
+              writeJSONNumber( os, fsv->max(i) );
+              os << ']';
+            }
+          }
+        } else {
+          for ( unsigned int i=0; i<sl->v().size(); ++i ) {
+            if ( i )
+              os << ',';
+            writeJSONValue( env, os, sl->v()[i] );
+          }
+        }
+        os << "]}";
+      } break;
+      case Expression::E_ARRAYLIT: {
+        ArrayLit* al = e->cast<ArrayLit>();
+        int idx = 0;
+        if ( al->v().size()==0 )
+          os << "[]";
+        else
+          writeJSONArray( env, os, al, 0, idx );
+      } break;
+      default: {
+        /// E.g. arrayXd() calls from parsed solver output
+        GCLock lock;
+        Expression* ev = eval_par( env, e );
+        if ( ev==e )
+          throw InternalError( "solns2out_base: cannot print non-literal value as JSON" );
+        writeJSONValue( env, os, ev );
+      }
+    }
+  }
+}
+
+void Solns2Out::printJSONRecord(ostream& os, const char* type, const char* key, const std::string& text) {
+  os << "{\"type\":\"" << type << "\",\"time\":" << static_cast<long long int>( starttime.ms() );
+  if ( !text.empty() ) {
+    os << ",\"" << key << "\":";
+    writeJSONString( os, text );
+  }
+  os << "}\n";
+}
+
+bool Solns2Out::__evalOutputJSON( ostream& os ) {
+  if ( jsonVars.empty() ) {
+    prepareOutputMap();
+    for (unsigned int i=0; i<getModel()->size(); i++) {
+      if (VarDeclI* vdi = (*getModel())[i]->dyn_cast<VarDeclI>()) {
+        auto it = declmap.find( vdi->e()->id()->str().str() );
+        if ( declmap.end()!=it && 0==it->second.second() )     // assigned by the solver
+          jsonVars.push_back( make_pair( it->first, vdi->e() ) );
+      }
+    }
+  }
+  os.precision( std::numeric_limits<double>::digits10+2 );
+  os << "{\"type\":\"solution\",\"time\":" << static_cast<long long int>( starttime.ms() )
+    << ",\"solution\":{";
+  for ( unsigned int i=0; i<jsonVars.size(); ++i ) {
+    if ( i )
+      os << ',';
+    writeJSONString( os, jsonVars[i].first );
+    os << ':';
+    writeJSONValue( pEnv->envi(), os, jsonVars[i].second->e() );
+  }
+  os << "}}\n";
   return true;
 }
 
@@ -223,7 +549,12 @@ bool Solns2Out::__evalOutput( ostream& fout, bool flag_output_flush ) {
 //       if (flag_output_flush)
 //         fout.flush();
 //     }
-    pEnv->envi().evalOutput( fout );
+    OutputProgram* pProg = getOutputProgram();
+    if ( pProg && ( pOutputValues || pProg->readValues( outputValues ) ) ) {
+      pProg->render( pOutputValues ? *pOutputValues : outputValues, outputBuffer );
+      fout << outputBuffer;
+    } else
+      pEnv->envi().evalOutput( fout );
   }
   if (!_opt.solution_separator.empty())
     fout << _opt.solution_separator << '\n';
@@ -233,6 +564,7 @@ bool Solns2Out::__evalOutput( ostream& fout, bool flag_output_flush ) {
 }
 
 bool Solns2Out::evalStatus( SolverInstance::Status status ) {
+  std::lock_guard<std::mutex> lck( mtxPrint );
   if ( _opt.flag_canonicalize )
     __evalOutputFinal( _opt.flag_output_flush );
   __evalStatusMsg( status );
@@ -258,6 +590,27 @@ bool Solns2Out::__evalStatusMsg( SolverInstance::Status status ) {
   stat2msg[ SolverInstance::UNSATorUNBND ] = _opt.unsatorunbnd_msg;
   stat2msg[ SolverInstance::UNKNOWN ] = _opt.unknown_msg;
   stat2msg[ SolverInstance::ERROR ] = _opt.error_msg;
+  if ( _opt.flag_output_json_lines ) {
+    std::map<SolverInstance::Status, string> stat2name;
+    stat2name[ SolverInstance::OPT ] = "COMPLETE";
+    stat2name[ SolverInstance::SAT ] = "SATISFIED";
+    stat2name[ SolverInstance::UNSAT ] = "UNSATISFIABLE";
+    stat2name[ SolverInstance::UNBND ] = "UNBOUNDED";
+    stat2name[ SolverInstance::UNSATorUNBND ] = "UNSAT_OR_UNBOUNDED";
+    stat2name[ SolverInstance::UNKNOWN ] = "UNKNOWN";
+    stat2name[ SolverInstance::ERROR ] = "ERROR";
+    auto it=stat2name.find(status);
+    MZN_ASSERT_HARD_MSG( stat2name.end()!=it,
+                         "solns2out_base: undefined solution status code " << status );
+    printJSONRecord( getOutput(), "status", "status", it->second );
+    if ( !comments.empty() )
+      printJSONRecord( getOutput(), "comment", "text", comments );
+    if ( _opt.flag_output_flush )
+      getOutput().flush();
+    Solns2Out::status = status;
+    comments = "";
+    return true;
+  }
   auto it=stat2msg.find(status);
   if ( stat2msg.end()!=it ) {
     if (!it->second.empty())
@@ -360,6 +713,7 @@ bool Solns2Out::feedRawDataChunk(const char* data) {
       if ( _opt.flag_output_comments ) {
         size_t comment_pos = line.find('%');
         if (comment_pos != string::npos) {
+          std::lock_guard<std::mutex> lck( mtxPrint );
           comments += line.substr(comment_pos);
           comments += "\n";
         }
@@ -387,3 +741,32 @@ void Solns2Out::createInputMap() {
 void Solns2Out::printStatistics(ostream&)
 {
 }
+
+bool Solns2Out::evalStatisticsJSON(const std::string& stats)
+{
+  if ( !_opt.flag_output_json_lines )
+    return false;
+  std::lock_guard<std::mutex> lck( mtxPrint );
+  vector<pair<std::string,std::string> > kv;
+  std::string rest;
+  parseStatistics( stats, kv, rest );
+  ostream& os = getOutput();
+  os << "{\"type\":\"statistics\",\"time\":" << static_cast<long long int>( starttime.ms() )
+    << ",\"statistics\":{";
+  for ( size_t i=0; i<kv.size(); ++i ) {
+    if ( i )
+      os << ',';
+    writeJSONString( os, kv[i].first );
+    os << ':';
+    writeJSONStatValue( os, kv[i].second );
+  }
+  os << '}';
+  if ( !rest.empty() ) {
+    os << ",\"text\":";
+    writeJSONString( os, rest );
+  }
+  os << "}\n";
+  if ( _opt.flag_output_flush )
+    getOutput().flush();
+  return true;
+}
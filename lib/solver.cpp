@@ -89,6 +89,8 @@ MznSolver::~MznSolver()
 //   if (si)                         // first the solver
 //     CleanupSolverInterface(si);
   // TODO cleanup the used solver interfaces
+  if (si)                         // s2out is destroyed before the solver
+    si->finishOutput();
   si=0;
   if (flt)
     cleanupGlobalFlattener(flt);
@@ -214,13 +216,16 @@ void MznSolver::solve()
   getSI()->getOptions().setBoolParam  (constants().opts.verbose.str(),  get_flag_verbose());
   getSI()->getOptions().setBoolParam  (constants().opts.statistics.str(),  get_flag_statistics());
   getSI()->processFlatZinc();
+  getSI()->startOutput();
   SolverInstance::Status status = getSI()->solve();
   if (status==SolverInstance::SAT || status==SolverInstance::OPT) {
     getSI()->printSolution();             // What if it's already printed?  TODO
+    getSI()->finishOutput();
     if ( !getSI()->getSolns2Out()->fStatusPrinted )
       getSI()->getSolns2Out()->evalStatus( status );
   }
   else {
+    getSI()->finishOutput();
     if ( !getSI()->getSolns2Out()->fStatusPrinted )
       getSI()->getSolns2Out()->evalStatus( status );
     if (get_flag_statistics())    // it's summary in fact
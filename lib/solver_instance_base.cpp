@@ -11,6 +11,10 @@
 
 #include <minizinc/solver_instance_base.hh>
 #include <minizinc/eval_par.hh>
+#include <minizinc/prettyprinter.hh>
+
+#include <sstream>
+#include <unordered_map>
 
 #ifdef _MSC_VER 
 #define _CRT_SECURE_NO_WARNINGS
@@ -58,15 +62,129 @@ namespace MiniZinc {
     }
     else
       getSolns2Out()->evalOutput();
-    if ( getOptions().getBoolParam(constants().opts.statistics.str()) )
-      printStatistics(std::cout, 1);
+    if ( getOptions().getBoolParam(constants().opts.statistics.str()) ) {
+      if ( pS2Out && pS2Out->_opt.flag_output_json_lines ) {
+        std::ostringstream oss;
+        printStatistics(oss, 1);
+        pS2Out->evalStatisticsJSON(oss.str());
+      } else
+        printStatistics(std::cout, 1);
+    }
   }
 
   void SolverInstanceBase2::printSolution() {
+    if ( _pipeline ) {
+      /// The status belongs to this thread, the renderer only prints
+      getSolns2Out()->declNewOutput();
+      _pipeline->push( [this](SolutionSnapshot& snap) {
+        GCLock lock;
+        snapshotSolution(snap);
+        /// The renderer must not see the AST
+        for (auto& sv : snap.values)
+          if ( SolutionValue::SV_EXPR==sv.kind ) {
+            std::ostringstream oss;
+            if ( sv.e ) {
+              Printer p(oss,0,false);
+              p.print(sv.e);
+            }
+            sv = SolutionValue::mkText(oss.str());
+          }
+        if ( getOptions().getBoolParam(constants().opts.statistics.str()) ) {
+          std::ostringstream oss;
+          printStatistics(oss, 1);
+          snap.statistics = oss.str();
+        }
+      } );
+      return;
+    }
+    if ( mapOutputProgram() ) {
+      _snap.clear();
+      snapshotSolution(_snap);
+      evalOutputProgram(_snap);
+      if ( getOptions().getBoolParam(constants().opts.statistics.str()) )
+        printStatistics(std::cout, 1);
+      return;
+    }
     assignSolutionToOutput();
     SolverInstanceBase::printSolution();
   }
 
+  bool SolverInstanceBase2::mapOutputProgram() {
+    if ( _fOutputProgramMapped >= 0 )
+      return _fOutputProgramMapped;
+    _fOutputProgramMapped = 0;
+    OutputProgram* pProg = pS2Out ? pS2Out->getOutputProgram() : 0;
+    if ( 0==pProg )
+      return false;
+    collectVarsWithOutput();
+    /// Position and size of each output var in a snapshot
+    std::unordered_map<std::string, std::pair<int,int> > snapPos;
+    int iVal=0;
+    for(unsigned int i=0; i<_varsWithOutput.size(); i++) {
+      VarDecl* vd = _varsWithOutput[i];
+      if(getAnnotation(vd->ann(), constants().ann.output_array.aststr())) {
+        if(ArrayLit* al = vd->e()->dyn_cast<ArrayLit>()) {
+          snapPos[vd->id()->str().str()] = std::make_pair(iVal, static_cast<int>(al->v().size()));
+          iVal += al->v().size();
+        }
+      } else if(vd->ann().contains(constants().ann.output_var)) {
+        snapPos[vd->id()->str().str()] = std::make_pair(iVal, 1);
+        ++iVal;
+      }
+    }
+    _outputProgramMap.clear();
+    for(unsigned int i=0; i<pProg->vars().size(); i++) {
+      auto it = snapPos.find(pProg->vars()[i]->id()->str().str());
+      if ( snapPos.end()==it || it->second.second != pProg->varSize(i) )
+        return false;
+      for (int j=0; j<it->second.second; j++)
+        _outputProgramMap.push_back(it->second.first + j);
+    }
+    assert( _outputProgramMap.size() == static_cast<size_t>(pProg->nValues()) );
+    _fOutputProgramMapped = 1;
+    return true;
+  }
+
+  void SolverInstanceBase2::evalOutputProgram(const SolutionSnapshot& snap) {
+    _outputValues.resize(_outputProgramMap.size());
+    for (unsigned int i=0; i<_outputProgramMap.size(); i++)
+      _outputValues[i] = snap.values[_outputProgramMap[i]];
+    if ( _pipeline )
+      getSolns2Out()->renderOutput(_outputValues);
+    else {
+      getSolns2Out()->declNewOutput();
+      getSolns2Out()->evalOutput(_outputValues);
+    }
+  }
+
+  void SolverInstanceBase2::startOutput() {
+    if ( 0==pS2Out || !pS2Out->_opt.flag_output_async || _pipeline )
+      return;
+    /// The renderer only formats values for the compiled output program.
+    /// Anything else needs the AST, so is printed in this thread
+    if ( !mapOutputProgram() ) {
+      if ( getOptions().getBoolParam(constants().opts.verbose.str()) )
+        std::cerr << "  Asynchronous output: the output item cannot be compiled, printing synchronously." << std::endl;
+      return;
+    }
+    _pipeline.reset( new SolutionPipeline( [this](SolutionSnapshot& snap) {
+        evalOutputProgram(snap);
+        if ( !snap.statistics.empty() )
+          std::cout << snap.statistics;
+      },
+      pS2Out->_opt.flag_output_async_buffer, pS2Out->_opt.flag_output_coalesce ) );
+  }
+
+  void SolverInstanceBase2::finishOutput() {
+    if ( !_pipeline )
+      return;
+    _pipeline->drain();
+    if ( getOptions().getBoolParam(constants().opts.verbose.str()) )
+      std::cerr << "  Asynchronous output: " << _pipeline->nRendered() << " solutions rendered, "
+        << _pipeline->nCoalesced() << " coalesced." << std::endl;
+    _pipeline.reset();
+  }
+
 //   void
 //   SolverInstanceBase::assignSolutionToOutput(void) {
 //     for (VarDeclIterator it = getEnv()->output()->begin_vardecls(); it != getEnv()->output()->end_vardecls(); ++it) {
@@ -75,11 +193,8 @@ namespace MiniZinc {
 //       }
 //     }
 //   }
-  
-  void SolverInstanceBase2::assignSolutionToOutput() {
-    
-    MZN_ASSERT_HARD_MSG( 0!=pS2Out, "Setup a Solns2Out object to use default solution extraction/reporting procs" );
-    
+
+  void SolverInstanceBase2::collectVarsWithOutput() {
     if ( _varsWithOutput.empty() ) {
       for (VarDeclIterator it = getEnv()->flat()->begin_vardecls(); it != getEnv()->flat()->end_vardecls(); ++it) {
         if(!it->removed()) {
@@ -94,6 +209,34 @@ namespace MiniZinc {
         }
       }
     }
+  }
+
+  void SolverInstanceBase2::getOutputArrayDims(Call* output_array_ann, std::vector<std::pair<int,int> >& dims_v) {
+    GCLock lock;
+    ArrayLit* dims;
+    Expression* e = output_array_ann->args()[0];
+    if(ArrayLit* al = e->dyn_cast<ArrayLit>()) {
+      dims = al;
+    } else if(Id* id = e->dyn_cast<Id>()) {
+      dims = id->decl()->e()->cast<ArrayLit>();
+    } else {
+      throw InternalError("invalid argument of output_array annotation");
+    }
+    for( int i=0;i<dims->length();i++) {
+      IntSetVal* isv = eval_intset(getEnv()->envi(), dims->v()[i]);
+      if (isv->size()==0) {
+        dims_v.push_back(std::pair<int,int>(1,0));
+      } else {
+        dims_v.push_back(std::pair<int,int>(isv->min().toInt(),isv->max().toInt()));
+      }
+    }
+  }
+  
+  void SolverInstanceBase2::assignSolutionToOutput() {
+    
+    MZN_ASSERT_HARD_MSG( 0!=pS2Out, "Setup a Solns2Out object to use default solution extraction/reporting procs" );
+    
+    collectVarsWithOutput();
     
     pS2Out->declNewOutput();  // Even for empty output decl
     
@@ -127,24 +270,8 @@ namespace MiniZinc {
             }
           }
           GCLock lock;
-          ArrayLit* dims;
-          Expression* e = output_array_ann->args()[0];
-          if(ArrayLit* al = e->dyn_cast<ArrayLit>()) {
-            dims = al;
-          } else if(Id* id = e->dyn_cast<Id>()) {
-            dims = id->decl()->e()->cast<ArrayLit>();
-          } else {
-            throw -1;
-          }
           std::vector<std::pair<int,int> > dims_v;
-          for( int i=0;i<dims->length();i++) {
-            IntSetVal* isv = eval_intset(getEnv()->envi(), dims->v()[i]);
-            if (isv->size()==0) {
-              dims_v.push_back(std::pair<int,int>(1,0));
-            } else {
-              dims_v.push_back(std::pair<int,int>(isv->min().toInt(),isv->max().toInt()));
-            }
-          }
+          getOutputArrayDims(output_array_ann, dims_v);
           ArrayLit* array_solution = new ArrayLit(Location(),array_elems,dims_v);
           KeepAlive ka(array_solution);
           auto& de = getSolns2Out()->findOutputVar(vd->id()->str().str());
@@ -160,6 +287,81 @@ namespace MiniZinc {
 
   }
 
+  SolutionValue SolverInstanceBase2::getRawSolutionValue(Id* id) {
+    Expression* e = getSolutionValue(id);
+    if (e) {
+      if (IntLit* il = e->dyn_cast<IntLit>()) {
+        if (il->type().enumId()==0)
+          return SolutionValue::mkInt(il->v().toInt());
+      } else if (FloatLit* fl = e->dyn_cast<FloatLit>()) {
+        return SolutionValue::mkFloat(fl->v().toDouble());
+      } else if (BoolLit* bl = e->dyn_cast<BoolLit>()) {
+        return SolutionValue::mkBool(bl->v());
+      }
+    }
+    return SolutionValue::mkExpr(e);
+  }
+
+  void SolverInstanceBase2::snapshotSolution(SolutionSnapshot& snap) {
+    for(unsigned int i=0; i<_varsWithOutput.size(); i++) {
+      VarDecl* vd = _varsWithOutput[i];
+      if(getAnnotation(vd->ann(), constants().ann.output_array.aststr())) {
+        if(ArrayLit* al = vd->e()->dyn_cast<ArrayLit>()) {
+          ASTExprVec<Expression> array = al->v();
+          for(unsigned int j=0; j<array.size(); j++) {
+            if(Id* id = array[j]->dyn_cast<Id>())
+              snap.values.push_back(getRawSolutionValue(id));
+            else    // a literal of the flat model
+              snap.values.push_back(SolutionValue::mkExpr(array[j]));
+          }
+        }
+      } else if(vd->ann().contains(constants().ann.output_var)) {
+        snap.values.push_back(getRawSolutionValue(vd->id()));
+      }
+    }
+  }
+
+  /// Create a literal from a raw value
+  static Expression* solutionValueToLiteral(const SolutionValue& sv) {
+    switch (sv.kind) {
+      case SolutionValue::SV_INT: return IntLit::a(sv.i);
+      case SolutionValue::SV_FLOAT: return FloatLit::a(sv.f);
+      case SolutionValue::SV_BOOL: return constants().boollit(sv.i!=0);
+      default: return sv.e;
+    }
+  }
+
+  void SolverInstanceBase2::assignSnapshotToOutput(const SolutionSnapshot& snap) {
+    MZN_ASSERT_HARD_MSG( 0!=pS2Out, "Setup a Solns2Out object to use default solution extraction/reporting procs" );
+    GCLock lock;
+    pS2Out->declNewOutput();  // Even for empty output decl
+    size_t iVal=0;
+    for(unsigned int i=0; i<_varsWithOutput.size(); i++) {
+      VarDecl* vd = _varsWithOutput[i];
+      if(Call* output_array_ann = Expression::dyn_cast<Call>(getAnnotation(vd->ann(), constants().ann.output_array.aststr()))) {
+        if(ArrayLit* al = vd->e()->dyn_cast<ArrayLit>()) {
+          std::vector<Expression*> array_elems(al->v().size());
+          for(unsigned int j=0; j<array_elems.size(); j++) {
+            assert( iVal < snap.values.size() );
+            array_elems[j] = solutionValueToLiteral(snap.values[iVal++]);
+          }
+          std::vector<std::pair<int,int> > dims_v;
+          getOutputArrayDims(output_array_ann, dims_v);
+          ArrayLit* array_solution = new ArrayLit(Location(),array_elems,dims_v);
+          auto& de = getSolns2Out()->findOutputVar(vd->id()->str().str());
+          de.first->e(array_solution);
+        }
+      } else if(vd->ann().contains(constants().ann.output_var)) {
+        assert( iVal < snap.values.size() );
+        /// Unlike assignSolutionToOutput(), the flat model is not modified,
+        /// it may be in use by the solver thread
+        auto& de = getSolns2Out()->findOutputVar(vd->id()->str().str());
+        de.first->e(solutionValueToLiteral(snap.values[iVal++]));
+      }
+    }
+    assert( iVal == snap.values.size() );
+  }
+
  void 
   SolverInstanceBase::flattenSearchAnnotations(const Annotation& ann, std::vector<Expression*>& out) {
     for(ExpressionSetIter i = ann.begin(); i != ann.end(); ++i) {
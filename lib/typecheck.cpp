@@ -19,6 +19,10 @@
 #include <string>
 #include <sstream>
 #include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <atomic>
+#include <memory>
 
 #include <minizinc/prettyprinter.hh>
 
@@ -787,20 +791,124 @@ namespace MiniZinc {
     return addCoercion(env, m, e, funarg->type());
   }
   
+  namespace {
+    /// Check whether elements [from,to) of \a al are literals of kind \a eid
+    /// and type \a t without annotations
+    bool literalRange(ArrayLit* al, unsigned int from, unsigned int to,
+                      Expression::ExpressionId eid, const Type& t) {
+      ASTExprVec<Expression> v = al->v();
+      for (unsigned int i=from; i<to; i++) {
+        Expression* e = v[i];
+        if (e==NULL || e->eid() != eid || e->type() != t || !e->ann().isEmpty())
+          return false;
+      }
+      return true;
+    }
+    
+    /// Element type of \a al if the elements are uniform par literals that
+    /// need no coercion, so the generic bottom-up typing can be skipped
+    bool literalElementType(ArrayLit* al, Type& t, Expression::ExpressionId& eid) {
+      if (al->v().size()==0 || al->v()[0]==NULL || !al->ann().isEmpty())
+        return false;
+      eid = al->v()[0]->eid();
+      if (eid!=Expression::E_INTLIT && eid!=Expression::E_FLOATLIT &&
+          eid!=Expression::E_BOOLLIT && eid!=Expression::E_STRINGLIT)
+        return false;
+      t = al->v()[0]->type();
+      return t.dim()==0 && t.ispar() && !t.isopt() && !t.cv() && t.enumId()==0;
+    }
+    
+    /// Type of the homogeneous literal array \a al, computed with a tight loop
+    bool literalArrayType(ArrayLit* al, Type& ty) {
+      Expression::ExpressionId eid;
+      if (!literalElementType(al, ty, eid) || !literalRange(al, 1, al->v().size(), eid, ty))
+        return false;
+      ty.dim(al->dims());
+      return true;
+    }
+    
+    /// Type the homogeneous literal arrays in \a arrays using \a nThreads threads.
+    /// Large arrays are split into chunks, so a single big data array is
+    /// scanned in parallel, too. The scan only reads the AST; types are
+    /// assigned by the calling thread. Typed arrays are added to \a typed.
+    void typeLiteralArrays(const std::vector<ArrayLit*>& arrays, int nThreads,
+                           std::unordered_set<Expression*>& typed) {
+      const unsigned int chunkSize = 1<<16;
+      struct Chunk {
+        unsigned int a;
+        unsigned int from, to;
+      };
+      std::vector<Chunk> chunks;
+      std::vector<Type> types(arrays.size());
+      std::vector<Expression::ExpressionId> eids(arrays.size());
+      std::unique_ptr<std::atomic<bool>[]> ok(new std::atomic<bool>[arrays.size()]);
+      for (unsigned int i=0; i<arrays.size(); i++) {
+        ok[i] = literalElementType(arrays[i], types[i], eids[i]);
+        if (ok[i]) {
+          for (unsigned int j=0; j<arrays[i]->v().size(); j+=chunkSize) {
+            Chunk c = { i, j, std::min<unsigned int>(j+chunkSize, arrays[i]->v().size()) };
+            chunks.push_back(c);
+          }
+        }
+      }
+      std::atomic<unsigned int> next(0);
+      auto work = [&]() {
+        for (unsigned int c; (c = next++) < chunks.size(); ) {
+          const Chunk& ch = chunks[c];
+          if (ok[ch.a] && !literalRange(arrays[ch.a], ch.from, ch.to, eids[ch.a], types[ch.a]))
+            ok[ch.a] = false;
+        }
+      };
+      int nWorkers = std::min<int>(nThreads, chunks.size());
+      std::vector<std::thread> workers;
+      for (int i=1; i<nWorkers; i++)
+        workers.push_back(std::thread(work));
+      work();
+      for (unsigned int i=0; i<workers.size(); i++)
+        workers[i].join();
+      for (unsigned int i=0; i<arrays.size(); i++) {
+        if (ok[i]) {
+          types[i].dim(arrays[i]->dims());
+          arrays[i]->type(types[i]);
+          typed.insert(arrays[i]);
+        }
+      }
+    }
+  }
+  
   template<bool ignoreVarDecl>
   class Typer {
   public:
     EnvI& _env;
     Model* _model;
     std::vector<TypeError>& _typeErrors;
-    Typer(EnvI& env, Model* model, std::vector<TypeError>& typeErrors) : _env(env), _model(model), _typeErrors(typeErrors) {}
+    /// Array literals that have already been typed by the parallel scan
+    const std::unordered_set<Expression*>* _typed;
+    /// Array literals typed by enter() whose visit is still pending
+    std::unordered_set<Expression*> _typedHere;
+    Typer(EnvI& env, Model* model, std::vector<TypeError>& typeErrors,
+          const std::unordered_set<Expression*>* typed = NULL)
+      : _env(env), _model(model), _typeErrors(typeErrors), _typed(typed) {}
     /// Check annotations when expression is finished
     void exit(Expression* e) {
       for (ExpressionSetIter it = e->ann().begin(); it != e->ann().end(); ++it)
         if (!(*it)->type().isann())
           throw TypeError(_env,(*it)->loc(),"expected annotation, got `"+(*it)->type().toString(_env)+"'");
     }
-    bool enter(Expression*) { return true; }
+    /// Skip the elements of literal arrays (typically data)
+    bool enter(Expression* e) {
+      if (ArrayLit* al = Expression::dyn_cast<ArrayLit>(e)) {
+        if (_typed && _typed->count(al))
+          return false;
+        Type ty;
+        if (literalArrayType(al, ty)) {
+          al->type(ty);
+          _typedHere.insert(al);
+          return false;
+        }
+      }
+      return true;
+    }
     /// Visit integer literal
     void vIntLit(const IntLit&) {}
     /// Visit floating point literal
@@ -867,6 +975,9 @@ namespace MiniZinc {
     void vAnonVar(const AnonVar&) {}
     /// Visit array literal
     void vArrayLit(ArrayLit& al) {
+      // Nested arrays are still visited when enter() skipped their elements
+      if ((_typed && _typed->count(&al)) || _typedHere.erase(&al))
+        return;
       Type ty; ty.dim(al.dims());
       std::vector<AnonVar*> anons;
       bool haveInferredType = false;
@@ -1400,7 +1511,8 @@ namespace MiniZinc {
     void vTIId(TIId& id) {}
   };
   
-  void typecheck(Env& env, Model* m, std::vector<TypeError>& typeErrors, bool ignoreUndefinedParameters) {
+  void typecheck(Env& env, Model* m, std::vector<TypeError>& typeErrors, bool ignoreUndefinedParameters,
+                 int nThreads) {
     TopoSorter ts(m);
     
     std::vector<FunctionI*> functionItems;
@@ -1552,8 +1664,28 @@ namespace MiniZinc {
       }
     }
     
+    std::unordered_set<Expression*> typedArrays;
+    if (nThreads > 1) {
+      /// Data arrays are independent of each other, scan them concurrently
+      std::vector<ArrayLit*> arrays;
+      for (unsigned int i=0; i<ts.decls.size(); i++) {
+        Expression* e = ts.decls[i]->e();
+        if (!ts.decls[i]->toplevel() || e==NULL)
+          continue;
+        if (ArrayLit* al = e->dyn_cast<ArrayLit>()) {
+          arrays.push_back(al);
+        } else if (Call* c = e->dyn_cast<Call>()) {
+          /// arrayXd(...) coercions of data arrays
+          for (unsigned int j=0; j<c->args().size(); j++)
+            if (ArrayLit* al = c->args()[j]->dyn_cast<ArrayLit>())
+              arrays.push_back(al);
+        }
+      }
+      typeLiteralArrays(arrays, nThreads, typedArrays);
+    }
+    
     {
-      Typer<true> ty(env.envi(), m, typeErrors);
+      Typer<true> ty(env.envi(), m, typeErrors, &typedArrays);
       BottomUpIterator<Typer<true> > bu_ty(ty);
       
       class TSV2 : public ItemVisitor {
@@ -1716,6 +1848,74 @@ namespace MiniZinc {
     
   }
 
+  void typecheck_data(Env& env, Model* m, std::vector<TypeError>& typeErrors) {
+    TopoSorter ts(m);
+    std::vector<VarDecl*> decls;
+    std::vector<AssignI*> assignItems;
+
+    class TSVData : public ItemVisitor {
+    public:
+      EnvI& env;
+      TopoSorter& ts;
+      std::vector<VarDecl*>& decls;
+      std::vector<AssignI*>& ais;
+      TSVData(EnvI& env0, TopoSorter& ts0, std::vector<VarDecl*>& decls0, std::vector<AssignI*>& ais0)
+        : env(env0), ts(ts0), decls(decls0), ais(ais0) {}
+      void vVarDeclI(VarDeclI* i) {
+        ts.add(env, i, false, NULL);
+        decls.push_back(i->e());
+      }
+      void vAssignI(AssignI* i) { ais.push_back(i); }
+    } _tsvd(env.envi(),ts,decls,assignItems);
+    iterItems(_tsvd,m);
+
+    for (unsigned int i=0; i<assignItems.size(); i++) {
+      AssignI* ai = assignItems[i];
+      VarDecl* vd = ts.get(env.envi(),ai->id(),ai->loc());
+      if (vd->ti()->isEnum())
+        throw TypeError(env.envi(),ai->loc(),"enum `"+vd->id()->str().str()+
+                        "' cannot be defined after the model has been type checked");
+      // Undefined optional parameters have been set to absent by typecheck
+      if (vd->e() && !(vd->type().isopt() && vd->e()==constants().absent))
+        throw TypeError(env.envi(),ai->loc(),"multiple assignment to the same variable");
+      vd->e(ai->e());
+      ai->decl(vd);
+      ts.run(env.envi(), ai->e());
+    }
+
+    {
+      // Only declarations introduced by the data (e.g. generators) are new
+      Typer<false> ty(env.envi(), m, typeErrors);
+      BottomUpIterator<Typer<false> > bu_ty(ty);
+      for (unsigned int i=0; i<ts.decls.size(); i++) {
+        ts.decls[i]->payload(0);
+        if (ts.decls[i]->type().isunknown()) {
+          bu_ty.run(ts.decls[i]->ti());
+          ty.vVarDecl(*ts.decls[i]);
+        }
+      }
+    }
+    {
+      Typer<true> ty(env.envi(), m, typeErrors);
+      BottomUpIterator<Typer<true> > bu_ty(ty);
+      for (unsigned int i=0; i<assignItems.size(); i++) {
+        AssignI* ai = assignItems[i];
+        bu_ty.run(ai->e());
+        ty.vVarDecl(*ai->decl());
+        ai->remove();
+      }
+    }
+
+    for (unsigned int i=0; i<decls.size(); i++) {
+      if (decls[i]->toplevel() &&
+          decls[i]->type().ispar() && !decls[i]->type().isann() && decls[i]->e()==NULL) {
+        typeErrors.push_back(TypeError(env.envi(), decls[i]->loc(),
+                                       "  symbol error: variable `" + decls[i]->id()->str().str()
+                                       + "' must be defined (did you forget to specify a data file?)"));
+      }
+    }
+  }
+
   void typecheck_fzn(Env& env, Model* m) {
     ASTStringMap<int>::t declMap;
     for (unsigned int i=0; i<m->size(); i++) {
@@ -11,18 +11,396 @@
 
 #include <minizinc/values.hh>
 #include <climits>
+#include <cassert>
+#include <algorithm>
 
 namespace MiniZinc {
   
   const IntVal IntVal::minint(void) { return IntVal(INT_MIN); }
   const IntVal IntVal::maxint(void) { return IntVal(INT_MAX); }
   const IntVal IntVal::infinity(void) { return IntVal(1,true); }
+
+  void IntVal::throwInfinite(void) {
+    throw ArithmeticError("arithmetic operation on infinite value");
+  }
+
+  long long int int_array_sum(const long long int* x, size_t n) {
+    long long int s = 0;
+#ifdef MZN_HAS_OVERFLOW_BUILTINS
+    /// One pass, checking for overflow only once at the end
+    bool overflow = false;
+    for (size_t i=0; i<n; i++)
+      overflow |= __builtin_add_overflow(s, x[i], &s);
+    if (MZN_UNLIKELY(overflow))
+      MiniZincSafeIntExceptionHandler::SafeIntOnOverflow();
+#else
+    for (size_t i=0; i<n; i++)
+      s = IntVal::safePlus(s, x[i]);
+#endif
+    return s;
+  }
+
+  long long int int_array_dot(const long long int* x, const long long int* y, size_t n) {
+    long long int s = 0;
+#ifdef MZN_HAS_OVERFLOW_BUILTINS
+    bool overflow = false;
+    for (size_t i=0; i<n; i++) {
+      long long int p;
+      overflow |= __builtin_mul_overflow(x[i], y[i], &p);
+      overflow |= __builtin_add_overflow(s, p, &s);
+    }
+    if (MZN_UNLIKELY(overflow))
+      MiniZincSafeIntExceptionHandler::SafeIntOnOverflow();
+#else
+    for (size_t i=0; i<n; i++)
+      s = IntVal::safePlus(s, IntVal::safeMult(x[i], y[i]));
+#endif
+    return s;
+  }
+
+  long long int int_array_min(const long long int* x, size_t n) {
+    assert(n>0);
+    long long int m = x[0];
+    for (size_t i=1; i<n; i++)
+      m = std::min(m, x[i]);
+    return m;
+  }
+
+  long long int int_array_max(const long long int* x, size_t n) {
+    assert(n>0);
+    long long int m = x[0];
+    for (size_t i=1; i<n; i++)
+      m = std::max(m, x[i]);
+    return m;
+  }
  
   IntSetVal::IntSetVal(IntVal m, IntVal n) : ASTChunk(sizeof(Range)) {
     get(0).min = m;
     get(0).max = n;
   }
 
+  namespace {
+    typedef IntSetVal::Range Range;
+
+    /// Range buffer that lives on the stack for small results
+    class RangeBuffer {
+      Range _fixed[32];
+      std::vector<Range> _dyn;
+      Range* _r;
+    public:
+      RangeBuffer(int n) : _r(_fixed) {
+        if (n > 32) {
+          _dyn.resize(n);
+          _r = _dyn.data();
+        }
+      }
+      Range* data(void) { return _r; }
+    };
+
+    /// First index in \a r[from..n) whose maximum is at least \a v.
+    /// Gallops from \a from, so a sequence of increasing lookups costs
+    /// logarithmic time in the distance skipped.
+    int gallop(const Range* r, int n, int from, const IntVal& v) {
+      if (from >= n || r[from].max >= v)
+        return from;
+      int lo = from;   // r[lo].max < v
+      int step = 1;
+      int hi = from+1;
+      while (hi < n && r[hi].max < v) {
+        lo = hi;
+        step <<= 1;
+        hi = lo+step;
+      }
+      if (hi > n)
+        hi = n;
+      while (hi-lo > 1) {
+        int mid = lo+(hi-lo)/2;
+        if (r[mid].max < v)
+          lo = mid;
+        else
+          hi = mid;
+      }
+      return hi;
+    }
+
+    int set_union(const Range* a, int na, const Range* b, int nb, Range* r) {
+      int i=0, j=0, k=0;
+      while (i<na || j<nb) {
+        Range cur = (j==nb || (i<na && a[i].min <= b[j].min)) ? a[i++] : b[j++];
+        for (;;) {
+          if (i<na && cur.max.plus(1) >= a[i].min) {
+            if (a[i].max > cur.max)
+              cur.max = a[i].max;
+            ++i;
+          } else if (j<nb && cur.max.plus(1) >= b[j].min) {
+            if (b[j].max > cur.max)
+              cur.max = b[j].max;
+            ++j;
+          } else {
+            break;
+          }
+        }
+        r[k++] = cur;
+      }
+      return k;
+    }
+
+    int set_inter(const Range* a, int na, const Range* b, int nb, Range* r) {
+      int i=0, j=0, k=0;
+      while (i<na && j<nb) {
+        if (a[i].max < b[j].min) {
+          i = gallop(a, na, i, b[j].min);
+        } else if (b[j].max < a[i].min) {
+          j = gallop(b, nb, j, a[i].min);
+        } else {
+          r[k++] = Range(std::max(a[i].min,b[j].min), std::min(a[i].max,b[j].max));
+          if (a[i].max < b[j].max)
+            ++i;
+          else
+            ++j;
+        }
+      }
+      return k;
+    }
+
+    int set_diff(const Range* a, int na, const Range* b, int nb, Range* r) {
+      int j=0, k=0;
+      for (int i=0; i<na; i++) {
+        IntVal lo = a[i].min;
+        const IntVal& hi = a[i].max;
+        bool fEmpty = false;
+        j = gallop(b, nb, j, lo);
+        while (j<nb && b[j].min <= hi) {
+          if (b[j].min > lo)
+            r[k++] = Range(lo, b[j].min.minus(1));
+          if (b[j].max >= hi) {
+            fEmpty = true;
+            break;
+          }
+          lo = b[j].max.plus(1);
+          ++j;
+        }
+        if (!fEmpty)
+          r[k++] = Range(lo, hi);
+      }
+      return k;
+    }
+
+    bool same_ranges(const Range* r, int n, const IntSetVal* s) {
+      if (n != s->size())
+        return false;
+      const Range* sr = s->ranges();
+      for (int i=0; i<n; i++)
+        if (r[i].min != sr[i].min || r[i].max != sr[i].max)
+          return false;
+      return true;
+    }
+
+    /// Allocate the result \a r, reusing \a a or \a b if it is equal
+    IntSetVal* result(const Range* r, int n, IntSetVal* a, IntSetVal* b) {
+      if (same_ranges(r, n, a))
+        return a;
+      if (b && same_ranges(r, n, b))
+        return b;
+      return IntSetVal::a(r, n);
+    }
+  }
+
+  IntSetVal*
+  IntSetVal::unite(IntSetVal* a, IntSetVal* b) {
+    if (b->size()==0)
+      return a;
+    if (a->size()==0)
+      return b;
+    RangeBuffer buf(a->size()+b->size());
+    int n = set_union(a->ranges(), a->size(), b->ranges(), b->size(), buf.data());
+    return result(buf.data(), n, a, b);
+  }
+
+  IntSetVal*
+  IntSetVal::intersect(IntSetVal* a, IntSetVal* b) {
+    if (a->size()==0)
+      return a;
+    if (b->size()==0)
+      return b;
+    RangeBuffer buf(a->size()+b->size());
+    int n = set_inter(a->ranges(), a->size(), b->ranges(), b->size(), buf.data());
+    return result(buf.data(), n, a, b);
+  }
+
+  IntSetVal*
+  IntSetVal::diff(IntSetVal* a, IntSetVal* b) {
+    if (a->size()==0 || b->size()==0)
+      return a;
+    RangeBuffer buf(a->size()+b->size());
+    int n = set_diff(a->ranges(), a->size(), b->ranges(), b->size(), buf.data());
+    return result(buf.data(), n, a, NULL);
+  }
+
+  IntSetVal*
+  IntSetVal::symdiff(IntSetVal* a, IntSetVal* b) {
+    if (b->size()==0)
+      return a;
+    if (a->size()==0)
+      return b;
+    int na = a->size();
+    int nb = b->size();
+    RangeBuffer bufU(na+nb);
+    RangeBuffer bufI(na+nb);
+    RangeBuffer buf(2*(na+nb));
+    int nu = set_union(a->ranges(), na, b->ranges(), nb, bufU.data());
+    int ni = set_inter(a->ranges(), na, b->ranges(), nb, bufI.data());
+    int n = set_diff(bufU.data(), nu, bufI.data(), ni, buf.data());
+    return result(buf.data(), n, a, b);
+  }
+
+  bool
+  IntSetVal::subset(const IntSetVal* a, const IntSetVal* b) {
+    const Range* ar = a->ranges();
+    const Range* br = b->ranges();
+    int na = a->size();
+    int nb = b->size();
+    int j = 0;
+    for (int i=0; i<na; i++) {
+      j = gallop(br, nb, j, ar[i].min);
+      if (j==nb || ar[i].min < br[j].min || ar[i].max > br[j].max)
+        return false;
+    }
+    return true;
+  }
+
+  int
+  IntSetVal::lowerBoundRange(const IntVal& v, int from) const {
+    const Range* r = ranges();
+    int lo = from;
+    int hi = size();
+    while (lo < hi) {
+      int mid = lo+(hi-lo)/2;
+      if (r[mid].max < v)
+        lo = mid+1;
+      else
+        hi = mid;
+    }
+    return lo;
+  }
+
+  IntSetVal*
+  IntSetVal::aSorted(const long long int* x, size_t n) {
+    if (n==0)
+      return a();
+    std::vector<Range> ranges;
+    long long int min = x[0];
+    long long int max = min;
+    for (size_t i=1; i<n; i++) {
+      assert(x[i] >= max);
+      if (static_cast<unsigned long long int>(x[i])-static_cast<unsigned long long int>(max) > 1) {
+        ranges.push_back(Range(min,max));
+        min = x[i];
+      }
+      max = x[i];
+    }
+    ranges.push_back(Range(min,max));
+    return a(ranges);
+  }
+
+#ifndef MZN_HAS_CTZ_BUILTIN
+#if defined(__GNUC__)
+#define MZN_HAS_CTZ_BUILTIN 1
+#elif defined(__has_builtin)
+#if __has_builtin(__builtin_ctzll)
+#define MZN_HAS_CTZ_BUILTIN 1
+#endif
+#endif
+#endif
+
+  namespace {
+    /// Number of trailing zero bits of \a w, which must not be 0
+    inline unsigned int ctz(unsigned long long int w) {
+      assert(w != 0);
+#ifdef MZN_HAS_CTZ_BUILTIN
+      return __builtin_ctzll(w);
+#else
+      unsigned int n = 0;
+      while ((w & 1)==0) {
+        w >>= 1;
+        n++;
+      }
+      return n;
+#endif
+    }
+  }
+
+  IntSetVal*
+  IntSetVal::a(const std::vector<IntVal>& s0) {
+    if (s0.size()==0)
+      return a();
+    std::vector<long long int> s;
+    s.reserve(s0.size());
+    for (unsigned int i=0; i<s0.size(); i++) {
+      if (!s0[i].isFinite())
+        break;
+      s.push_back(s0[i].toInt());
+    }
+    if (s.size()==s0.size()) {
+      long long int lo = int_array_min(s.data(), s.size());
+      long long int hi = int_array_max(s.data(), s.size());
+      unsigned long long int span =
+        static_cast<unsigned long long int>(hi)-static_cast<unsigned long long int>(lo);
+      if (span < 64*s.size() && span < (1ull<<26)) {
+        /// Small dense domain: mark the values in a bitset and read off the runs
+        std::vector<unsigned long long int> bits(span/64+1, 0);
+        for (unsigned int i=0; i<s.size(); i++) {
+          unsigned long long int o = static_cast<unsigned long long int>(s[i]-lo);
+          bits[o/64] |= 1ull << (o%64);
+        }
+        std::vector<Range> ranges;
+        unsigned long long int o = 0;
+        while (o <= span) {
+          /// Find next set bit
+          unsigned long long int w = bits[o/64] >> (o%64);
+          if (w==0) {
+            o = (o/64+1)*64;
+            continue;
+          }
+          o += ctz(w);
+          unsigned long long int start = o;
+          /// Find next clear bit
+          for (;;) {
+            unsigned long long int c = ~bits[o/64] >> (o%64);
+            if (c==0) {
+              o = (o/64+1)*64;
+              if (o > span)
+                break;
+            } else {
+              o += ctz(c);
+              break;
+            }
+          }
+          ranges.push_back(Range(lo+static_cast<long long int>(start),
+                                 lo+static_cast<long long int>(o-1)));
+        }
+        return a(ranges);
+      }
+      std::sort(s.begin(), s.end());
+      return aSorted(s.data(), s.size());
+    }
+    std::vector<IntVal> s1 = s0;
+    std::sort(s1.begin(),s1.end());
+    std::vector<Range> ranges;
+    IntVal min=s1[0];
+    IntVal max=min;
+    for (unsigned int i=1; i<s1.size(); i++) {
+      if (s1[i]>max.plus(1)) {
+        ranges.push_back(Range(min,max));
+        min=s1[i]; max=min;
+      } else {
+        max=s1[i];
+      }
+    }
+    ranges.push_back(Range(min,max));
+    return a(ranges);
+  }
+
   FloatSetVal::FloatSetVal(FloatVal m, FloatVal n) : ASTChunk(sizeof(Range)) {
     get(0).min = m;
     get(0).max = n;
@@ -0,0 +1,214 @@
+/* -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+/// Micro-benchmarks of the integer arithmetic: IntVal operations against
+/// SafeInt and plain long long, and the int_array_* kernels against loops
+/// over IntVal. Every benchmark also checks that its variants agree.
+
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <limits>
+
+#include <minizinc/values.hh>
+#include <minizinc/gc.hh>
+#include <minizinc/timer.hh>
+#include <minizinc/exception.hh>
+
+using namespace MiniZinc;
+using namespace std;
+
+namespace {
+
+  typedef SafeInt<long long int, MiniZincSafeIntExceptionHandler> SI;
+
+  int nRepeats = 20;
+  bool fFailed = false;
+
+  /// Run \a f nRepeats times and return the time per run in ms
+  template<class F>
+  double timeIt(F f, long long int& result) {
+    Timer t;
+    for (int r=0; r<nRepeats; r++)
+      result = f();
+    return t.ms()/nRepeats;
+  }
+
+  void report(const char* name, const char* variant, double ms, long long int result, long long int expected) {
+    cout << "  " << left << setw(8) << name << setw(16) << variant
+         << right << setw(10) << fixed << setprecision(3) << ms << " ms";
+    if (result != expected) {
+      cout << "   MISMATCH: " << result << " != " << expected;
+      fFailed = true;
+    }
+    cout << endl;
+  }
+
+  void benchAdd(const vector<long long int>& x) {
+    long long int expected = 0, r = 0;
+    double ms = timeIt([&]() {
+      long long int s = 0;
+      for (size_t i=0; i<x.size(); i++)
+        s += x[i];
+      return s;
+    }, expected);
+    report("add", "long long", ms, expected, expected);
+    ms = timeIt([&]() {
+      SI s = 0;
+      for (size_t i=0; i<x.size(); i++)
+        s += x[i];
+      return static_cast<long long int>(s);
+    }, r);
+    report("add", "SafeInt", ms, r, expected);
+    ms = timeIt([&]() {
+      IntVal s = 0;
+      for (size_t i=0; i<x.size(); i++)
+        s += x[i];
+      return s.toInt();
+    }, r);
+    report("add", "IntVal", ms, r, expected);
+  }
+
+  void benchMult(const vector<long long int>& x, const vector<long long int>& y) {
+    long long int expected = 0, r = 0;
+    double ms = timeIt([&]() {
+      SI s = 0;
+      for (size_t i=0; i<x.size(); i++)
+        s += SI(x[i])*y[i];
+      return static_cast<long long int>(s);
+    }, expected);
+    report("mult", "SafeInt", ms, expected, expected);
+    ms = timeIt([&]() {
+      IntVal s = 0;
+      for (size_t i=0; i<x.size(); i++)
+        s += IntVal(x[i])*IntVal(y[i]);
+      return s.toInt();
+    }, r);
+    report("mult", "IntVal", ms, r, expected);
+  }
+
+  void benchKernels(const vector<long long int>& x, const vector<long long int>& y) {
+    long long int expected = 0, r = 0;
+    double ms = timeIt([&]() {
+      IntVal s = 0;
+      for (size_t i=0; i<x.size(); i++)
+        s += x[i];
+      return s.toInt();
+    }, expected);
+    report("sum", "IntVal loop", ms, expected, expected);
+    ms = timeIt([&]() { return int_array_sum(x.data(), x.size()); }, r);
+    report("sum", "int_array_sum", ms, r, expected);
+
+    ms = timeIt([&]() {
+      IntVal s = 0;
+      for (size_t i=0; i<x.size(); i++)
+        s += IntVal(x[i])*IntVal(y[i]);
+      return s.toInt();
+    }, expected);
+    report("dot", "IntVal loop", ms, expected, expected);
+    ms = timeIt([&]() { return int_array_dot(x.data(), y.data(), x.size()); }, r);
+    report("dot", "int_array_dot", ms, r, expected);
+
+    ms = timeIt([&]() {
+      IntVal m = x[0];
+      for (size_t i=1; i<x.size(); i++)
+        m = std::min(m, IntVal(x[i]));
+      return m.toInt();
+    }, expected);
+    report("min", "IntVal loop", ms, expected, expected);
+    ms = timeIt([&]() { return int_array_min(x.data(), x.size()); }, r);
+    report("min", "int_array_min", ms, r, expected);
+
+    ms = timeIt([&]() {
+      IntVal m = x[0];
+      for (size_t i=1; i<x.size(); i++)
+        m = std::max(m, IntVal(x[i]));
+      return m.toInt();
+    }, expected);
+    report("max", "IntVal loop", ms, expected, expected);
+    ms = timeIt([&]() { return int_array_max(x.data(), x.size()); }, r);
+    report("max", "int_array_max", ms, r, expected);
+  }
+
+  void benchCard(size_t n) {
+    GCLock lock;
+    vector<IntSetVal::Range> ranges;
+    long long int expected = 0;
+    for (size_t i=0; i<n/2; i++) {
+      long long int lb = 4*static_cast<long long int>(i);
+      ranges.push_back(IntSetVal::Range(lb, lb+1+i%2));
+      expected += 2+i%2;
+    }
+    IntSetVal* isv = IntSetVal::a(ranges);
+    long long int r = 0;
+    double ms = timeIt([&]() { return isv->card().toInt(); }, r);
+    report("card", "IntSetVal", ms, r, expected);
+  }
+
+  /// The kernels must still detect overflow
+  void checkOverflow(void) {
+    vector<long long int> big(4, std::numeric_limits<long long int>::max()/2);
+    bool fThrown = false;
+    try {
+      int_array_sum(big.data(), big.size());
+    } catch (ArithmeticError&) {
+      fThrown = true;
+    }
+    cout << "  overflow of int_array_sum " << (fThrown ? "detected" : "NOT DETECTED") << endl;
+    if (!fThrown)
+      fFailed = true;
+    fThrown = false;
+    try {
+      int_array_dot(big.data(), big.data(), big.size());
+    } catch (ArithmeticError&) {
+      fThrown = true;
+    }
+    cout << "  overflow of int_array_dot " << (fThrown ? "detected" : "NOT DETECTED") << endl;
+    if (!fThrown)
+      fFailed = true;
+  }
+
+}
+
+int main(int argc, char** argv) {
+  size_t n = 1000000;
+  for (int i=1; i<argc; i++) {
+    if ((string(argv[i])=="-n" || string(argv[i])=="--size") && i+1<argc) {
+      n = strtoul(argv[++i], NULL, 10);
+    } else if ((string(argv[i])=="-r" || string(argv[i])=="--repeats") && i+1<argc) {
+      nRepeats = atoi(argv[++i]);
+    } else {
+      cerr << "Usage: " << argv[0] << " [-n <size>] [-r <repeats>]" << endl
+           << "  Micro-benchmarks of integer arithmetic on arrays of <size> values" << endl
+           << "  (default 1000000), each run <repeats> times (default 20)." << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (n < 2 || nRepeats < 1) {
+    cerr << "Size must be at least 2, repeats at least 1" << endl;
+    return EXIT_FAILURE;
+  }
+
+  vector<long long int> x(n), y(n);
+  srand(42);
+  for (size_t i=0; i<n; i++) {
+    x[i] = rand()%2000001-1000000;
+    y[i] = rand()%201-100;
+  }
+
+  cout << "Size " << n << ", " << nRepeats << " repeats, time per run:" << endl;
+  benchAdd(x);
+  benchMult(x, y);
+  benchKernels(x, y);
+  benchCard(n);
+  checkOverflow();
+  return fFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,363 @@
+// * -*- mode: C++; c-basic-offset: 2; indent-tabs-mode: nil -*- */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace std;
+
+#include <minizinc/solvers/MIP/MIP_lpwrite_wrap.hh>
+#include <minizinc/utils.hh>
+
+/// Linking this module provides these functions:
+MIP_wrapper* MIP_WrapperFactory::GetDefaultMIPWrapper() {
+  return new MIP_lpwrite_wrapper;
+}
+
+string MIP_WrapperFactory::getVersion( ) {
+  string v = "  MIP wrapper writing LP/MPS files (no solver)";
+  v += "  Compiled  " __DATE__ "  " __TIME__;
+  return v;
+}
+
+void MIP_WrapperFactory::printHelp(ostream& os) {
+  os
+  << "LP/MPS writer options:" << std::endl
+  << "--writeModel <file> write model to <file>: MPS format if it ends with .mps, LP format otherwise.\n"
+     "      The model is not solved. Use with -Glinear" << std::endl
+  << std::endl;
+}
+
+ static   string sExportModel;
+
+bool MIP_WrapperFactory::processOption(int& i, int argc, const char** argv) {
+  MiniZinc::CLOParser cop( i, argc, argv );
+  if (string(argv[i])=="-f") {
+//     std::cerr << "  Flag -f: ignoring fixed strategy anyway." << std::endl;
+  } else if ( cop.get( "--writeModel", &sExportModel ) ) {
+  } else
+    return false;
+  return true;
+}
+
+/// Output through a large buffer, numbers formatted without iostreams
+class MIP_lpwrite_wrapper::File {
+  FILE* f;
+  vector<char> buf;
+  size_t n = 0;
+  /// Characters since the last newline, for wrapping long LP lines
+  size_t nLine = 0;
+public:
+  File(const string& name) : f(fopen(name.c_str(), "w")), buf(1<<20) { }
+  ~File() { close(); }
+  bool ok() const { return f!=0; }
+  void flush() {
+    if (n && f)
+      fwrite(buf.data(), 1, n, f);
+    n = 0;
+  }
+  /// Close the file, return false on a write error
+  bool close() {
+    if (!f)
+      return false;
+    flush();
+    bool fOk = !ferror(f);
+    fOk = (0==fclose(f)) && fOk;
+    f = 0;
+    return fOk;
+  }
+  void put(const char* s, size_t len) {
+    if (n+len > buf.size())
+      flush();
+    if (len > buf.size()) {
+      fwrite(s, 1, len, f);
+    } else {
+      memcpy(buf.data()+n, s, len);
+      n += len;
+    }
+    // The current line starts after the last newline of s, if any
+    const char* nl = s+len;
+    while (nl != s && nl[-1] != '\n')
+      --nl;
+    nLine = nl != s ? s+len-nl : nLine+len;
+  }
+  size_t lineLength() const { return nLine; }
+  File& operator<<(const char* s) { put(s, strlen(s)); return *this; }
+  File& operator<<(const string& s) { put(s.data(), s.size()); return *this; }
+  File& operator<<(char c) { put(&c, 1); return *this; }
+  File& operator<<(int i) {
+    char b[16];
+    put(b, snprintf(b, sizeof(b), "%d", i));
+    return *this;
+  }
+  /// Shortest of %.15g and %.17g that reads back exactly
+  File& operator<<(double d) {
+    char b[32];
+    int len = snprintf(b, sizeof(b), "%.15g", d);
+    if (strtod(b, 0) != d)
+      len = snprintf(b, sizeof(b), "%.17g", d);
+    put(b, len);
+    return *this;
+  }
+};
+
+void MIP_lpwrite_wrapper::addRow
+  (int nnz, int *rmatind, double* rmatval, MIP_wrapper::LinConType sense,
+   double rhs, int mask, string rowName)
+{
+  rowInd.insert(rowInd.end(), rmatind, rmatind+nnz);
+  rowVal.insert(rowVal.end(), rmatval, rmatval+nnz);
+  rowStart.push_back(static_cast<int>(rowInd.size()));
+  rowSense.push_back(sense);
+  rowRhs.push_back(rhs);
+  rowMask.push_back(mask);
+  rowNames.push_back(rowName);
+}
+
+  /// Make \a s a name both LP and MPS readers accept. LP names must not
+  /// start with a digit or a period, nor with e/E (read as an exponent)
+  static string fileName(const string& s, char prefix, int idx) {
+    if (s.empty())
+      return prefix + to_string(idx);
+    string r = s;
+    for (unsigned int i=0; i<r.size(); i++) {
+      char c = r[i];
+      if (!isalnum(static_cast<unsigned char>(c)) && c!='_' && c!='.')
+        r[i] = '_';
+    }
+    if (isdigit(static_cast<unsigned char>(r[0])) || r[0]=='.' || r[0]=='e' || r[0]=='E')
+      r = string("_") + r;
+    return r;
+  }
+
+void MIP_lpwrite_wrapper::makeNames(vector<string>& colN, vector<string>& rowN) {
+  unordered_set<string> used;
+  used.insert("obj");
+  auto unique = [&used](string n, int idx) {
+    if (!used.insert(n).second) {
+      n += "_" + to_string(idx);
+      while (!used.insert(n).second)
+        n += "_";
+    }
+    return n;
+  };
+  colN.resize(colObj.size());
+  for (unsigned int j=0; j<colN.size(); j++)
+    colN[j] = unique(fileName(colNames[j], 'x', j), j);
+  rowN.resize(rowSense.size());
+  for (unsigned int i=0; i<rowN.size(); i++)
+    rowN[i] = unique(fileName(rowNames[i], 'r', i), i);
+}
+
+void MIP_lpwrite_wrapper::writeLP
+  (File& f, const vector<string>& colN, const vector<string>& rowN)
+{
+  const double inf = getInfBound();
+  /// Write one term, wrapping long lines (some readers limit the line length)
+  auto term = [&f,&colN](double c, int j) {
+    if (f.lineLength() > 200)
+      f << "\n   ";
+    f << (c<0.0 ? " - " : " + ") << fabs(c) << ' ' << colN[j];
+  };
+  f << "\\ Model written by the MiniZinc LP/MPS writer\n";
+  f << (objSense==1 ? "Maximize\n" : "Minimize\n") << " obj:";
+  bool fObj = false;
+  for (unsigned int j=0; j<colObj.size(); j++)
+    if (colObj[j] != 0.0) {
+      term(colObj[j], j);
+      fObj = true;
+    }
+  if (!fObj && !colObj.empty())
+    term(0.0, 0);
+  f << '\n';
+  /// Normal rows, then lazy constraints, then user cuts
+  const char* section[3] = { "Subject To\n", "Lazy Constraints\n", "User Cuts\n" };
+  for (int s=0; s<3; s++) {
+    bool fSection = false;
+    for (unsigned int i=0; i<rowSense.size(); i++) {
+      int sRow = (rowMask[i] & MaskConsType_Normal) ? 0 :
+        (rowMask[i] & MaskConsType_Lazy) ? 1 : 2;
+      if (sRow != s)
+        continue;
+      if (!fSection) {
+        f << section[s];
+        fSection = true;
+      }
+      f << ' ' << rowN[i] << ':';
+      if (rowStart[i]==rowStart[i+1] && !colObj.empty())
+        term(0.0, 0);
+      for (int k=rowStart[i]; k<rowStart[i+1]; k++)
+        term(rowVal[k], rowInd[k]);
+      f << (LQ==rowSense[i] ? " <= " : GQ==rowSense[i] ? " >= " : " = ") << rowRhs[i] << '\n';
+    }
+    if (0==s && !fSection)
+      f << section[0];
+  }
+  /// Bounds differing from the default [0, +inf)
+  f << "Bounds\n";
+  for (unsigned int j=0; j<colObj.size(); j++) {
+    double lb = colLB[j], ub = colUB[j];
+    if (BINARY==colTypes[j] && 0.0==lb && 1.0==ub)
+      continue;
+    if (lb==ub) {
+      f << ' ' << colN[j] << " = " << lb << '\n';
+    } else if (lb <= -inf && ub >= inf) {
+      f << ' ' << colN[j] << " free\n";
+    } else if (lb != 0.0 || ub < inf) {
+      f << ' ';
+      if (lb <= -inf)
+        f << "-inf";
+      else
+        f << lb;
+      f << " <= " << colN[j] << " <= ";
+      if (ub >= inf)
+        f << "+inf";
+      else
+        f << ub;
+      f << '\n';
+    }
+  }
+  /// Binaries with other bounds are written as general integers
+  bool fSection = false;
+  for (unsigned int j=0; j<colObj.size(); j++)
+    if (INT==colTypes[j] || (BINARY==colTypes[j] && (0.0!=colLB[j] || 1.0!=colUB[j]))) {
+      if (!fSection) {
+        f << "General\n";
+        fSection = true;
+      }
+      f << ' ' << colN[j] << '\n';
+    }
+  fSection = false;
+  for (unsigned int j=0; j<colObj.size(); j++)
+    if (BINARY==colTypes[j] && 0.0==colLB[j] && 1.0==colUB[j]) {
+      if (!fSection) {
+        f << "Binary\n";
+        fSection = true;
+      }
+      f << ' ' << colN[j] << '\n';
+    }
+  f << "End\n";
+}
+
+void MIP_lpwrite_wrapper::writeMPS
+  (File& f, const vector<string>& colN, const vector<string>& rowN)
+{
+  const double inf = getInfBound();
+  f << "* Model written by the MiniZinc LP/MPS writer\n";
+  f << "NAME          MiniZinc\n";
+  if (1==objSense)
+    f << "OBJSENSE\n    MAX\n";
+  /// All rows are written as constraints, including lazy ones and user cuts
+  f << "ROWS\n N  obj\n";
+  for (unsigned int i=0; i<rowSense.size(); i++)
+    f << (LQ==rowSense[i] ? " L  " : GQ==rowSense[i] ? " G  " : " E  ") << rowN[i] << '\n';
+  /// Transpose the rows
+  const int nc = static_cast<int>(colObj.size());
+  vector<int> colStart(nc+1, 0);
+  for (unsigned int k=0; k<rowInd.size(); k++)
+    ++colStart[rowInd[k]+1];
+  for (int j=0; j<nc; j++)
+    colStart[j+1] += colStart[j];
+  vector<int> colRow(rowInd.size());
+  vector<double> colVal(rowInd.size());
+  {
+    vector<int> pos(colStart.begin(), colStart.end()-1);
+    for (unsigned int i=0; i<rowSense.size(); i++)
+      for (int k=rowStart[i]; k<rowStart[i+1]; k++) {
+        int p = pos[rowInd[k]]++;
+        colRow[p] = i;
+        colVal[p] = rowVal[k];
+      }
+  }
+  f << "COLUMNS\n";
+  bool fInt = false;
+  int nMarker = 0;
+  for (int j=0; j<nc; j++) {
+    bool fIntCol = (INT==colTypes[j] || BINARY==colTypes[j]);
+    if (fIntCol != fInt) {
+      f << "    MARKER" << nMarker++ << "  'MARKER'  " << (fIntCol ? "'INTORG'\n" : "'INTEND'\n");
+      fInt = fIntCol;
+    }
+    bool fEntry = false;
+    if (colObj[j] != 0.0) {
+      f << "    " << colN[j] << "  obj  " << colObj[j] << '\n';
+      fEntry = true;
+    }
+    for (int k=colStart[j]; k<colStart[j+1]; k++) {
+      f << "    " << colN[j] << "  " << rowN[colRow[k]] << "  " << colVal[k] << '\n';
+      fEntry = true;
+    }
+    if (!fEntry)
+      f << "    " << colN[j] << "  obj  0\n";
+  }
+  if (fInt)
+    f << "    MARKER" << nMarker++ << "  'MARKER'  'INTEND'\n";
+  f << "RHS\n";
+  for (unsigned int i=0; i<rowSense.size(); i++)
+    if (rowRhs[i] != 0.0)
+      f << "    rhs  " << rowN[i] << "  " << rowRhs[i] << '\n';
+  /// All bounds explicitly: readers differ in the defaults for integers
+  f << "BOUNDS\n";
+  for (int j=0; j<nc; j++) {
+    double lb = colLB[j], ub = colUB[j];
+    if (BINARY==colTypes[j] && 0.0==lb && 1.0==ub) {
+      f << " BV bnd  " << colN[j] << '\n';
+    } else if (lb==ub) {
+      f << " FX bnd  " << colN[j] << "  " << lb << '\n';
+    } else if (lb <= -inf && ub >= inf) {
+      f << " FR bnd  " << colN[j] << '\n';
+    } else {
+      if (lb <= -inf)
+        f << " MI bnd  " << colN[j] << '\n';
+      else
+        f << " LO bnd  " << colN[j] << "  " << lb << '\n';
+      if (ub >= inf)
+        f << " PL bnd  " << colN[j] << '\n';
+      else
+        f << " UP bnd  " << colN[j] << "  " << ub << '\n';
+    }
+  }
+  f << "ENDATA\n";
+}
+
+void MIP_lpwrite_wrapper::writeModel(const string& filename) {
+  File f(filename);
+  if (!f.ok())
+    throw runtime_error("  MIP_lpwrite_wrapper: cannot open file '" + filename + "' for writing");
+  vector<string> colN, rowN;
+  makeNames(colN, rowN);
+  if (filename.size()>=4 && filename.compare(filename.size()-4, 4, ".mps")==0)
+    writeMPS(f, colN, rowN);
+  else
+    writeLP(f, colN, rowN);
+  if (!f.close())
+    throw runtime_error("  MIP_lpwrite_wrapper: error writing file '" + filename + "'");
+}
+
+void MIP_lpwrite_wrapper::solve() {
+  if (sExportModel.empty())
+    throw runtime_error("  MIP_lpwrite_wrapper: no output file, use --writeModel <file>");
+  if (fVerbose)
+    cerr << "  MIP_lpwrite_wrapper: writing " << getNCols() << " columns and "
+      << getNRows() << " rows to '" << sExportModel << "'..." << flush;
+  writeModel(sExportModel);
+  if (fVerbose)
+    cerr << " done." << endl;
+  output.status = UNKNOWN;
+  output.statusName = "Model written";
+  output.nCols = getNCols();
+}
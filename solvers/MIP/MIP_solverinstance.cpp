@@ -23,13 +23,20 @@
 #include <string>
 #include <memory>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
 
 using namespace std;
 
 #include <minizinc/solvers/MIP/MIP_solverinstance.hh>
+#include <minizinc/utils.hh>
 
 using namespace MiniZinc;
 
+            /// CUT SEPARATION PARAMS
+ static   int nCutThreads=1;
+ static   double dCutMinViol=1e-6;
+
 SolverFactory* MiniZinc::SolverFactory::createF_MIP() {
   return new MIP_SolverFactory;
 }
@@ -41,6 +48,24 @@ string MIP_SolverFactory::getVersion()
   return v;
 }
 
+bool MIP_SolverFactory::processOption(int& i, int argc, const char** argv) {
+  MiniZinc::CLOParser cop( i, argc, argv );
+  if ( cop.get( "--cut-threads", &nCutThreads ) ) {
+  } else if ( cop.get( "--cut-min-viol", &dCutMinViol ) ) {
+  } else
+    return MIP_WrapperFactory::processOption(i, argc, argv);
+  return true;
+}
+
+void MIP_SolverFactory::printHelp(std::ostream& os) {
+  MIP_WrapperFactory::printHelp(os);
+  os
+  << "MIP cut generator options:" << std::endl
+  << "--cut-threads <N>   run the cut generators with N threads, default: 1" << std::endl
+  << "--cut-min-viol <n>  discard cuts violated by less than n, after scaling the largest coefficient to 1. Default 1e-6" << std::endl
+  << std::endl;
+}
+
 
 MIP_solver::Variable MIP_solverinstance::exprToVar(Expression* arg) {
   if (Id* ident = arg->dyn_cast<Id>()) {
@@ -290,6 +315,15 @@ void MIP_solverinstance::printStatistics(ostream& os, bool fLegend)
       if (mip_wrap->getNOpen())
         os << " ( " << mip_wrap->getNOpen() << " )";
       os << "    " << std::ctime( &n_c );
+      if ( cutStats.nCalls ) {
+        if (fLegend)
+          os << "  % cut callbacks, time, separation time, cuts generated, duplicate, weak, added: ";
+        else
+          os << "  % cut callbacks: ";
+        os << cutStats.nCalls << ",  " << cutStats.dTime << ",  " << cutStats.dTimeSep << ",  "
+          << cutStats.nGenerated << ",  " << cutStats.nDuplicate << ",  "
+          << cutStats.nWeak << ",  " << cutStats.nAdded << endl;
+      }
       os << endl;
       os.copyfmt( oldState );
 //       os.precision(nPrec);
@@ -314,7 +348,7 @@ void HandleSolutionCallback(const MIP_wrapper::Output& out, void* pp) {
     pSI->lastIncumbent = out.objVal;
   
   try {     /// Sometimes the intermediate output is wrong, especially in SCIP
-    pSI->printSolution();            // The solution in [out] is not used  TODO 
+    pSI->printSolution();            // reads the output columns of out.x via getValues()
   } catch (const Exception& e) {
     std::cerr << std::endl;
     std::cerr << "  Error when evaluating an intermediate solution:  " << e.what() << ": " << e.msg() << std::endl;
@@ -373,8 +407,11 @@ SolverInstance::Status MIP_solverinstance::solve(void) {
     return _status;
   if ( getMIPWrapper()->getNCols() ) {     // If any variables, we need to run solver just to get values?
     getMIPWrapper()->provideSolutionCallback(HandleSolutionCallback, this);
-    if ( cutGenerators.size() )  // only then, can modify presolve
+    if ( cutGenerators.size() ) { // only then, can modify presolve
+      if ( nCutThreads > 1 && cutGenerators.size() > 1 )
+        cutThreads.reset( new CutGenThreads( min( nCutThreads, (int)cutGenerators.size() ) ) );
       getMIPWrapper()->provideCutCallback(HandleCutCallback, this);
+    }
     getMIPWrapper()->solve();
   //   printStatistics(cout, 1);   MznSolver does this (if it wants)
     sw = getMIPWrapper()->getStatus();
@@ -534,8 +571,77 @@ void MIP_solverinstance::processFlatZinc(void) {
     cerr << "  MIP_solverinstance: overall,  "
       << mip_wrap->nLitVars << " literals with "
       << mip_wrap-> sLitValues.size() << " values used." << endl;
+  mapOutputColumns();
 }  // processFlatZinc
 
+void MIP_solverinstance::mapOutputColumns() {
+  /// Does nothing if processFlatZinc() has already found them
+  collectVarsWithOutput();
+  outputColumns.clear();
+  outputValuesFixed.clear();
+  auto addId = [this](Id* id) {
+    id = id->decl()->id();
+    if (id->type().isvar()) {
+      SolutionValue sv;
+      switch (id->type().bt()) {
+        case Type::BT_INT: sv.kind = SolutionValue::SV_INT; break;
+        case Type::BT_FLOAT: sv.kind = SolutionValue::SV_FLOAT; break;
+        case Type::BT_BOOL: sv.kind = SolutionValue::SV_BOOL; break;
+        default: break;     // SV_EXPR with a NULL value, as getSolutionValue()
+      }
+      outputColumns.push_back(SolutionValue::SV_EXPR==sv.kind ? -1 : exprToVar(id));
+      outputValuesFixed.push_back(sv);
+    } else {
+      outputColumns.push_back(-1);
+      outputValuesFixed.push_back(SolverInstanceBase2::getRawSolutionValue(id));
+    }
+  };
+  for (unsigned int i=0; i<_varsWithOutput.size(); i++) {
+    VarDecl* vd = _varsWithOutput[i];
+    if (getAnnotation(vd->ann(), constants().ann.output_array.aststr())) {
+      if (ArrayLit* al = vd->e()->dyn_cast<ArrayLit>()) {
+        ASTExprVec<Expression> array = al->v();
+        for (unsigned int j=0; j<array.size(); j++) {
+          if (Id* id = array[j]->dyn_cast<Id>())
+            addId(id);
+          else {    // a literal of the flat model
+            outputColumns.push_back(-1);
+            outputValuesFixed.push_back(SolutionValue::mkExpr(array[j]));
+          }
+        }
+      }
+    } else if (vd->ann().contains(constants().ann.output_var)) {
+      addId(vd->id());
+    }
+  }
+}
+
+void MIP_solverinstance::snapshotSolution(SolutionSnapshot& snap) {
+  const double* x = getMIPWrapper()->getValues();
+  snap.values.assign(outputValuesFixed.begin(), outputValuesFixed.end());
+  for (unsigned int i=0; i<outputColumns.size(); i++) {
+    if (outputColumns[i] < 0)
+      continue;
+    SolutionValue& sv = snap.values[i];
+    double val = x[outputColumns[i]];
+    if (SolutionValue::SV_FLOAT==sv.kind)
+      sv.f = val;
+    else
+      sv.i = round_to_longlong(val);
+  }
+}
+
+void MIP_solverinstance::printSolution() {
+  if ( _pipeline || mapOutputProgram() ) {
+    SolverInstanceBase2::printSolution();
+    return;
+  }
+  _snap.clear();
+  snapshotSolution(_snap);
+  assignSnapshotToOutput(_snap);
+  SolverInstanceBase::printSolution();
+}
+
 Expression* MIP_solverinstance::getSolutionValue(Id* id) {
   id = id->decl()->id();
 
@@ -555,11 +661,155 @@ Expression* MIP_solverinstance::getSolutionValue(Id* id) {
 
 void MIP_solverinstance::genCuts(const MIP_wrapper::Output& slvOut,
                                  MIP_wrapper::CutInput& cutsIn, bool fMIPSol) {
-  for ( auto& pCG : cutGenerators ) {
-    if ( !fMIPSol || pCG->getMask()&MIP_wrapper::MaskConsType_Lazy )
-      pCG->generate( slvOut, cutsIn );
+  lock_guard<mutex> lock( mtxCuts );
+  auto tStart = std::chrono::steady_clock::now();
+  /// Each generator fills its own vector, so that the order of the cuts
+  /// does not depend on the threads
+  vector<MIP_wrapper::CutInput> aCuts( cutGenerators.size() );
+  vector<exception_ptr> aErrors( cutGenerators.size() );
+  std::function<void(size_t)> task = [&]( size_t i ) {
+    CutGen* pCG = cutGenerators[i].get();
+    if ( !fMIPSol || pCG->getMask()&MIP_wrapper::MaskConsType_Lazy ) {
+      try {
+        pCG->generate( slvOut, aCuts[i] );
+      } catch ( ... ) {
+        aErrors[i] = current_exception();
+      }
+    }
+  };
+  if ( cutThreads )
+    cutThreads->run( cutGenerators.size(), task );
+  else
+    for ( size_t i=0; i<cutGenerators.size(); ++i )
+      task( i );
+  auto tSep = std::chrono::steady_clock::now();
+  cutPool.clear();
+  for ( size_t i=0; i<aCuts.size(); ++i ) {
+    if ( aErrors[i] )
+      rethrow_exception( aErrors[i] );
+    for ( auto& cut : aCuts[i] ) {
+      ++cutStats.nGenerated;
+      /// Lazy constraints may have to be given again [Gurobi]
+      if ( !(cut.mask & MIP_wrapper::MaskConsType_Lazy) ) {
+        CutPool::Verdict v = cutPool.add( cut, slvOut.x, slvOut.nCols, dCutMinViol );
+        if ( CutPool::DUPLICATE==v ) {
+          ++cutStats.nDuplicate;
+          continue;
+        } else if ( CutPool::WEAK==v ) {
+          ++cutStats.nWeak;
+          continue;
+        }
+      }
+      ++cutStats.nAdded;
+      cutsIn.push_back( move( cut ) );
+    }
+  }
+  auto tEnd = std::chrono::steady_clock::now();
+  ++cutStats.nCalls;
+  cutStats.dTimeSep += std::chrono::duration<double>( tSep-tStart ).count();
+  cutStats.dTime += std::chrono::duration<double>( tEnd-tStart ).count();
+}
+
+CutPool::Verdict CutPool::add( const MIP_wrapper::CutDef& cut, const double* x, int nCols, double dMinViol ) {
+  assert( MIP_wrapper::EQ != cut.sense );
+  /// Sort && merge the terms
+  vector<pair<int,double> > terms( cut.rmatind.size() );
+  for ( size_t i=0; i<terms.size(); ++i )
+    terms[i] = make_pair( cut.rmatind[i], cut.rmatval[i] );
+  sort( terms.begin(), terms.end() );
+  size_t n=0;
+  for ( size_t i=0; i<terms.size(); ++i ) {
+    if ( n && terms[n-1].first==terms[i].first )
+      terms[n-1].second += terms[i].second;
+    else
+      terms[n++] = terms[i];
+  }
+  terms.resize( n );
+  double dMax = 0.0;
+  for ( auto& t : terms )
+    dMax = max( dMax, fabs( t.second ) );
+  if ( 0.0==dMax )
+    return WEAK;
+  /// Scale to <= with the largest coefficient 1
+  const double dScale = ( MIP_wrapper::GQ==cut.sense ? -1.0 : 1.0 ) / dMax;
+  Key key;
+  double dLHS = 0.0;
+  for ( auto& t : terms ) {
+    const double c = t.second * dScale;
+    if ( 0.0==c )
+      continue;
+    assert( t.first>=0 && t.first<nCols );
+    dLHS += c * x[ t.first ];
+    key.ind.push_back( t.first );
+    key.val.push_back( llround( c * 1e9 ) );
+    key.hash ^= std::hash<int>()( t.first ) + 0x9e3779b9 + (key.hash << 6) + (key.hash >> 2);
+    key.hash ^= std::hash<long long>()( key.val.back() ) + 0x9e3779b9 + (key.hash << 6) + (key.hash >> 2);
+  }
+  const double dRHS = cut.rhs * dScale;
+  if ( dLHS - dRHS < dMinViol )
+    return WEAK;
+  auto it = rhs.find( key );
+  if ( rhs.end()==it ) {
+    rhs.insert( make_pair( move( key ), dRHS ) );
+    return NEW;
+  }
+  if ( it->second <= dRHS + 1e-9 )
+    return DUPLICATE;
+  it->second = dRHS;
+  return NEW;
+}
+
+CutGenThreads::CutGenThreads( int nThreads ) : iNext( 0 ) {
+  for ( int i=1; i<nThreads; ++i )
+    aWorkers.emplace_back( &CutGenThreads::work, this );
+}
+
+CutGenThreads::~CutGenThreads() {
+  {
+    lock_guard<mutex> lock( mtx );
+    fStop = true;
+  }
+  cvStart.notify_all();
+  for ( auto& th : aWorkers )
+    th.join();
+}
+
+void CutGenThreads::run( size_t n, const std::function<void(size_t)>& task ) {
+  {
+    lock_guard<mutex> lock( mtx );
+    pTask = &task;
+    nTasks = n;
+    iNext = 0;
+    nBusy = aWorkers.size();
+    ++nRound;
+  }
+  cvStart.notify_all();
+  for ( size_t i; (i = iNext++) < n; )
+    task( i );
+  unique_lock<mutex> lock( mtx );
+  cvDone.wait( lock, [this] { return 0==nBusy; } );
+}
+
+void CutGenThreads::work() {
+  unsigned long nSeen = 0;
+  for ( ;; ) {
+    const std::function<void(size_t)>* task;
+    size_t n;
+    {
+      unique_lock<mutex> lock( mtx );
+      cvStart.wait( lock, [&] { return fStop || nRound != nSeen; } );
+      if ( fStop )
+        return;
+      nSeen = nRound;
+      task = pTask;
+      n = nTasks;
+    }
+    for ( size_t i; (i = iNext++) < n; )
+      (*task)( i );
+    lock_guard<mutex> lock( mtx );
+    if ( 0 == --nBusy )
+      cvDone.notify_one();
   }
-  /// Select some most violated? TODO
 }
 
 void XBZCutGen::generate(const MIP_wrapper::Output& slvOut, MIP_wrapper::CutInput& cutsIn) {
@@ -589,7 +839,8 @@ void XBZCutGen::generate(const MIP_wrapper::Output& slvOut, MIP_wrapper::CutInpu
   double dViol = cut.computeViol( slvOut.x, slvOut.nCols );
   if ( dViol > 0.01 ) {   // ?? PARAM?  TODO
     cutsIn.push_back( cut );
-    cerr << " vi" << dViol << flush;
+    if ( pMIP->fVerbose )
+      cerr << " vi" << dViol << flush;
 //     cout << cut.rmatind.size() << ' '
 //       << cut.rhs << "  cutlen, rhs. (Sense fixed to GQ) " << endl;
 //     for ( int i=0; i<cut.rmatind.size(); ++i )
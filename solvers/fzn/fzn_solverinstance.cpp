@@ -28,6 +28,7 @@ const auto SolverInstance__ERROR = MiniZinc::SolverInstance::ERROR;  // before w
 #include <minizinc/typecheck.hh>
 #include <minizinc/builtins.hh>
 #include <minizinc/eval_par.hh>
+#include <minizinc/flat_components.hh>
 
 #ifdef _WIN32
 #define NOMINMAX
@@ -83,6 +84,12 @@ namespace MiniZinc {
     << "  -k, --keep-files\n     For compatibility only: to produce .ozn and .fzn, use mzn2fzn\n"
                            "     or <this_exe> --fzn ..., --ozn ...\n"
     << "  -r <n>, --seed <n>, --random-seed <n>\n     For compatibility only: use solver flags instead.\n"
+    << "  --portfolio <exe>\n     Run FlatZinc solver <exe> in parallel with the main one, with the same flags;\n"
+       "     can be repeated. Only improving solutions are printed, the first solver\n"
+       "     to finish the search decides. Cannot be combined with --split-components.\n"
+    << "  --split-components <n>\n     Solve the independent components of the model separately, in up to <n>\n"
+       "     solver processes running in parallel. Prints only one, combined solution,\n"
+       "     so it is ignored with -a or -n.\n"
     ;
   }
 
@@ -114,6 +121,21 @@ namespace MiniZinc {
       _options.setBoolParam(constants().opts.solver.allSols.str(), true);
     } else if ( cop.getOption( "-p --parallel", &nn) ) {
       _options.setIntParam(constants().opts.solver.fzn_flag.str(), nn);
+    } else if ( cop.getOption( "--portfolio", &buffer) ) {
+      if ( _options.getIntParam("split_components", 0) > 0 ) {
+        std::cerr << "  Error: --portfolio cannot be combined with --split-components" << std::endl;
+        return false;
+      }
+      string old = _options.getStringParam("portfolio", "");
+      if ( old.size() )
+        old += '\n';
+      _options.setStringParam("portfolio", old + buffer);
+    } else if ( cop.getOption( "--split-components", &nn) ) {
+      if ( nn > 0 && _options.hasParam("portfolio") ) {
+        std::cerr << "  Error: --split-components cannot be combined with --portfolio" << std::endl;
+        return false;
+      }
+      _options.setIntParam("split_components", nn);
     } else if ( cop.getOption( "-k --keep-files" ) ) {
     } else if ( cop.getOption( "-r --seed --random-seed", &dd) ) {
     } else {
@@ -150,18 +172,31 @@ namespace MiniZinc {
     }
 #endif
 
+    /// Serialises the solver's stderr when several processes run at once
+    mutex mtxErr;
+
     class FznProcess {
     protected:
       vector<string> _fzncmd;
       bool _canPipe;
       Model* _flat=0;
       Solns2Out* pS2Out=0;
+      /// A FlatZinc file written beforehand, and the buffer collecting
+      /// the solver's output instead of pS2Out
+      string _fznFile;
+      string* _pOutput=0;
     public:
       FznProcess(vector<string>& fzncmd, bool pipe, Model* flat, Solns2Out* pso)
         : _fzncmd(fzncmd), _canPipe(pipe), _flat(flat), pS2Out(pso) {
         assert( 0!=_flat );
         assert( 0!=pS2Out );
       }
+      /// Run the solver on \a fznFile, collecting its output in \a pOutput.
+      /// run() can then be called from any thread
+      FznProcess(vector<string>& fzncmd, const string& fznFile, string* pOutput)
+        : _fzncmd(fzncmd), _canPipe(false), _fznFile(fznFile), _pOutput(pOutput) {
+        assert( 0!=_pOutput );
+      }
       std::string run(void) {
 #ifdef _WIN32
         std::stringstream result;
@@ -305,8 +340,8 @@ namespace MiniZinc {
         pipe(pipes[1]);
         pipe(pipes[2]);
 
-        std::string fznFile;
-        if (!_canPipe) {
+        std::string fznFile = _fznFile;
+        if (!_canPipe && fznFile.empty()) {
           char tmpfile[] = "/tmp/fznfileXXXXXX.fzn";
           mkstemps(tmpfile, 4);
           fznFile = tmpfile;
@@ -319,10 +354,20 @@ namespace MiniZinc {
           }
         }
 
+        // The command line is built before forking: the child of a
+        // multi-threaded process should not allocate
+        std::vector<char*> cmd_line;
+        for (auto& iCmdl: _fzncmd)
+          cmd_line.push_back( strdup(iCmdl.c_str()) );
+        cmd_line.push_back(strdup(_canPipe ? "-" : fznFile.c_str()));
+        cmd_line.push_back(0);
+
         // Make sure to reap child processes to avoid creating zombies
         signal(SIGCHLD, SIG_IGN);
             
         if (int childPID = fork()) {
+          for (auto pArg: cmd_line)
+            free(pArg);
           close(pipes[0][0]);
           close(pipes[1][1]);
           close(pipes[2][1]);
@@ -350,7 +395,8 @@ namespace MiniZinc {
             if ( 0>=select(FD_SETSIZE, &fdset, NULL, NULL, NULL) )
             {
               kill(childPID, SIGKILL);
-              pS2Out->feedRawDataChunk( "\n" );   // in case last chunk did not end with \n
+              if (pS2Out)
+                pS2Out->feedRawDataChunk( "\n" );   // in case last chunk did not end with \n
               done = true;
             } else {
               for ( int i=1; i<=2; ++i )
@@ -363,14 +409,19 @@ namespace MiniZinc {
                     if ( 1==i ) {
 //                       cerr << "mzn-fzn: raw chunk stdout:::  " << flush;
 //                       cerr << buffer << flush;
-                      pS2Out->feedRawDataChunk( buffer );
+                      if (pS2Out)
+                        pS2Out->feedRawDataChunk( buffer );
+                      else
+                        _pOutput->append( buffer );
                     }
                     else {
+                      lock_guard<mutex> lck(mtxErr);
                       cerr << buffer << flush;
                     }
                   }
                   else if ( 1==i ) {
-                    pS2Out->feedRawDataChunk("\n");   // in case last chunk did not end with \n
+                    if (pS2Out)
+                      pS2Out->feedRawDataChunk("\n");   // in case last chunk did not end with \n
                     done = true;
                   }
                 }
@@ -396,17 +447,13 @@ namespace MiniZinc {
           close(pipes[2][1]);
           close(pipes[2][0]);
 
-          std::vector<char*> cmd_line;
-          for (auto& iCmdl: _fzncmd)
-            cmd_line.push_back( strdup(iCmdl.c_str()) );
-          cmd_line.push_back(strdup(_canPipe ? "-" : fznFile.c_str()));
-
-          char** argv = new char*[cmd_line.size() + 1];
-          for (unsigned int i = 0; i < cmd_line.size(); i++)
-            argv[i] = cmd_line[i];
-          argv[cmd_line.size()] = 0;
-
+          char** argv = cmd_line.data();
           int status = execvp(argv[0], argv);
+          if (status == -1 && _pOutput) {
+            static const char msg[] = "=====ERROR=====\n";
+            write(STDOUT_FILENO, msg, sizeof(msg)-1);
+            _exit(EXIT_FAILURE);
+          }
           if (status == -1) {
             std::stringstream ssm;
             ssm << "Error occurred when executing FZN solver with command \"" << argv[0] << " " << argv[1] << " " << argv[2] << "\".";
@@ -417,6 +464,243 @@ namespace MiniZinc {
     }
 #endif
     };
+
+#ifndef _WIN32
+    /// Several FlatZinc solvers racing on the same FlatZinc file.
+    /// Their outputs are merged into one Solns2Out: for optimisation
+    /// problems only strictly improving solutions are passed on, for
+    /// satisfaction problems the solutions of the first solver to find one.
+    /// The first proof of optimality or unsatisfiability ends the race, and
+    /// so does the first solution of a satisfaction problem, unless several
+    /// solutions are requested.
+    class FznPortfolio {
+    protected:
+      struct Member {
+        vector<string> cmd;
+        int pid = -1;
+        int fdOut = -1;
+        int fdErr = -1;
+        /// Incomplete last line of stdout, and the current solution
+        string linePart;
+        string solution;
+      };
+      vector<Member> _members;
+      string _fznFile;
+      Solns2Out* pS2Out;
+      /// +1/-1 to minimise/maximise, 0 for satisfaction
+      int _objSense;
+      /// Objective in the solver output, removed from solutions unless
+      /// it is an output variable
+      string _objName;
+      bool _stripObjective;
+      /// Integer objectives are compared exactly
+      bool _objInt;
+      /// Whether -a or -n was given
+      bool _fAllSolutions;
+      bool _fVerbose;
+      /// Solver whose solutions are passed on for satisfaction problems
+      int _leader = -1;
+      bool _hasBest = false;
+      double _best = 0.0;
+      long long int _bestInt = 0;
+      int _nForwarded = 0;
+      bool _decided = false;
+      string _lastMarker;
+    public:
+      FznPortfolio(const vector<vector<string> >& cmds, const string& fznFile, Solns2Out* pso,
+                   int objSense, const string& objName, bool stripObjective, bool objInt,
+                   bool fAllSolutions, bool fVerbose)
+        : _fznFile(fznFile), pS2Out(pso), _objSense(objSense), _objName(objName),
+          _stripObjective(stripObjective), _objInt(objInt), _fAllSolutions(fAllSolutions),
+          _fVerbose(fVerbose) {
+        _members.resize(cmds.size());
+        for (unsigned int i=0; i<cmds.size(); i++)
+          _members[i].cmd = cmds[i];
+      }
+      void run(void) {
+        signal(SIGCHLD, SIG_IGN);
+        for (unsigned int i=0; i<_members.size(); i++)
+          start(_members[i]);
+        while (!_decided) {
+          fd_set fdset;
+          FD_ZERO(&fdset);
+          bool any = false;
+          for (auto& m: _members) {
+            if (m.fdOut >= 0) { FD_SET(m.fdOut, &fdset); any = true; }
+            if (m.fdErr >= 0) { FD_SET(m.fdErr, &fdset); any = true; }
+          }
+          if (!any)
+            break;
+          if ( 0>=select(FD_SETSIZE, &fdset, NULL, NULL, NULL) )
+            break;
+          for (unsigned int i=0; i<_members.size() && !_decided; i++) {
+            Member& m = _members[i];
+            char buffer[1000];
+            if (m.fdErr >= 0 && FD_ISSET(m.fdErr, &fdset)) {
+              int count = read(m.fdErr, buffer, sizeof(buffer) - 1);
+              if (count > 0) {
+                buffer[count] = 0;
+                cerr << buffer << flush;
+              } else {
+                close(m.fdErr);
+                m.fdErr = -1;
+              }
+            }
+            if (m.fdOut >= 0 && FD_ISSET(m.fdOut, &fdset)) {
+              int count = read(m.fdOut, buffer, sizeof(buffer) - 1);
+              if (count > 0) {
+                m.linePart.append(buffer, count);
+                size_t pos;
+                while (!_decided && (pos = m.linePart.find('\n')) != string::npos) {
+                  string line = m.linePart.substr(0, pos);
+                  m.linePart.erase(0, pos+1);
+                  feedLine(i, line);
+                }
+              } else {
+                if (!m.linePart.empty())
+                  feedLine(i, m.linePart);
+                close(m.fdOut);
+                m.fdOut = -1;
+                // The leader has printed all the solutions it will find
+                if (0==_objSense && _leader==static_cast<int>(i) && _nForwarded > 0)
+                  _decided = true;
+              }
+            }
+          }
+        }
+        for (auto& m: _members) {
+          if (m.fdOut >= 0) {
+            kill(m.pid, SIGKILL);
+            close(m.fdOut);
+          }
+          if (m.fdErr >= 0)
+            close(m.fdErr);
+        }
+        if (!_decided && 0==_nForwarded && !_lastMarker.empty())
+          pS2Out->feedRawDataChunk(_lastMarker.c_str());
+      }
+    protected:
+      void start(Member& m) {
+        int pipes[2][2];
+        pipe(pipes[0]);
+        pipe(pipes[1]);
+        std::vector<char*> argv;
+        for (auto& iCmdl: m.cmd)
+          argv.push_back( strdup(iCmdl.c_str()) );
+        argv.push_back(strdup(_fznFile.c_str()));
+        argv.push_back(0);
+        if (int childPID = fork()) {
+          for (auto pArg: argv)
+            free(pArg);
+          close(pipes[0][1]);
+          close(pipes[1][1]);
+          m.pid = childPID;
+          m.fdOut = pipes[0][0];
+          m.fdErr = pipes[1][0];
+        } else {
+          close(STDIN_FILENO);
+          dup2(pipes[0][1], STDOUT_FILENO);
+          dup2(pipes[1][1], STDERR_FILENO);
+          close(pipes[0][0]);
+          close(pipes[0][1]);
+          close(pipes[1][0]);
+          close(pipes[1][1]);
+          execvp(argv[0], argv.data());
+          static const char msg[] = "=====ERROR=====\n";
+          write(STDOUT_FILENO, msg, sizeof(msg)-1);
+          _exit(EXIT_FAILURE);
+        }
+      }
+      void feedLine(int i, string& line) {
+        Member& m = _members[i];
+        if (line.size() && '\r' == line.back())
+          line.pop_back();
+        if (beginswith(line, "----------")) {
+          feedSolution(i);
+        } else if (beginswith(line, "==========")) {
+          // Proves our best solution optimal, or that all solutions were
+          // passed on if this solver is the leader
+          if (0!=_objSense || _leader==i || _leader<0)
+            decide(i, line);
+        } else if (beginswith(line, "=====UNKNOWN=====") || beginswith(line, "=====ERROR=====")) {
+          _lastMarker = line + "\n";
+        } else if (beginswith(line, "=====")) {
+          decide(i, line);
+        } else if (!beginswith(line, "%")) {
+          m.solution += line;
+          m.solution += '\n';
+        }
+      }
+      void feedSolution(int i) {
+        Member& m = _members[i];
+        string sol;
+        sol.swap(m.solution);
+        if (0==_objSense) {
+          if (_leader<0) {
+            _leader = i;
+            if (_fVerbose)
+              cerr << "  Portfolio: following " << m.cmd[0] << endl;
+          }
+          if (_leader!=i)
+            return;
+        } else {
+          // Find and possibly remove the objective value
+          istringstream iss(sol);
+          string line, rest;
+          bool found = false;
+          double val = 0.0;
+          long long int valInt = 0;
+          while (getline(iss, line)) {
+            if (beginswith(line, _objName) && line.find('=') != string::npos &&
+                line.substr(_objName.size(), line.find('=')-_objName.size()).find_first_not_of(" \t")==string::npos) {
+              const char* sVal = line.c_str()+line.find('=')+1;
+              if (_objInt)
+                valInt = strtoll(sVal, NULL, 10);
+              else
+                val = strtod(sVal, NULL);
+              found = true;
+              if (_stripObjective)
+                continue;
+            }
+            rest += line;
+            rest += '\n';
+          }
+          if (found) {
+            if (_hasBest && (_objInt ? (_objSense>0 ? valInt >= _bestInt : valInt <= _bestInt)
+                                     : _objSense*val >= _objSense*_best))
+              return;
+            _hasBest = true;
+            _best = val;
+            _bestInt = valInt;
+            if (_fVerbose) {
+              cerr << "  Portfolio: objective ";
+              if (_objInt)
+                cerr << valInt;
+              else
+                cerr << val;
+              cerr << " from " << m.cmd[0] << endl;
+            }
+          }
+          sol.swap(rest);
+        }
+        sol += "----------\n";
+        pS2Out->feedRawDataChunk(sol.c_str());
+        ++_nForwarded;
+        if (0==_objSense && !_fAllSolutions) {
+          if (_fVerbose)
+            cerr << "  Portfolio: " << m.cmd[0] << " found a solution" << endl;
+          _decided = true;
+        }
+      }
+      void decide(int i, const string& line) {
+        if (_fVerbose)
+          cerr << "  Portfolio: " << _members[i].cmd[0] << " finished with " << line << endl;
+        string marker = line + "\n";
+        pS2Out->feedRawDataChunk(marker.c_str());
+        _decided = true;
+      }
+    };
+#endif
   }
 
   FZNSolverInstance::FZNSolverInstance(Env& env, const Options& options)
@@ -497,6 +781,19 @@ namespace MiniZinc {
       cerr << std::endl;
     }
     
+    int nSplit = _options.getIntParam("split_components", 0);
+    /// The solutions of the parts cannot be enumerated separately
+    if ( nSplit > 0 && ( _options.hasParam(constants().opts.solver.numSols.str()) ||
+                         _options.getBoolParam(constants().opts.solver.allSols.str(), false) ) ) {
+      if (_options.getBoolParam(constants().opts.verbose.str(), false))
+        std::cerr << "  FZN: not splitting components, as several solutions are requested" << std::endl;
+      nSplit = 0;
+    }
+    if ( nSplit > 0 )
+      return solveComponents(cmd_line, nSplit);
+    if ( _options.hasParam("portfolio") )
+      return solvePortfolio(cmd_line);
+
     FznProcess proc(cmd_line, false, _fzn, getSolns2Out());
     proc.run();
 
@@ -582,6 +879,176 @@ namespace MiniZinc {
     return getSolns2Out()->status;
   }
 
+  SolverInstance::Status
+  FZNSolverInstance::solvePortfolio(vector<string>& cmd_line) {
+    vector<vector<string> > cmds(1, cmd_line);
+    istringstream iss(_options.getStringParam("portfolio"));
+    string solver;
+    while (getline(iss, solver)) {
+      cmds.push_back(cmd_line);
+      cmds.back()[0] = solver;
+    }
+#ifdef _WIN32
+    std::cerr << "  Warning: --portfolio is not supported on this platform" << std::endl;
+    FznProcess proc(cmd_line, false, _fzn, getSolns2Out());
+    proc.run();
+    return getSolns2Out()->status;
+#else
+    bool fVerbose = _options.getBoolParam(constants().opts.verbose.str(), false);
+    if (fVerbose)
+      std::cerr << "  FZN: portfolio of " << cmds.size() << " solvers" << std::endl;
+    // The objective is made an output variable to compare solutions
+    int objSense = 0;
+    string objName;
+    bool stripObjective = false;
+    bool objInt = false;
+    VarDecl* objDecl = NULL;
+    SolveI* si = _fzn->solveItem();
+    if (si && si->st() != SolveI::ST_SAT && si->e()->isa<Id>() && si->e()->cast<Id>()->decl()) {
+      objSense = si->st()==SolveI::ST_MIN ? 1 : -1;
+      objDecl = si->e()->cast<Id>()->decl()->id()->decl();
+      ostringstream oss;
+      oss << *objDecl->id();
+      objName = oss.str();
+      stripObjective = !objDecl->ann().contains(constants().ann.output_var);
+      objInt = objDecl->type().isint();
+    }
+    bool fAllSolutions = _options.hasParam(constants().opts.solver.numSols.str()) ||
+      _options.getBoolParam(constants().opts.solver.allSols.str(), false);
+    char tmpfile[] = "/tmp/fznfileXXXXXX.fzn";
+    int fd = mkstemps(tmpfile, 4);
+    if (fd >= 0)
+      close(fd);
+    {
+      GCLock lock;
+      if (stripObjective)
+        objDecl->addAnnotation(constants().ann.output_var);
+      std::ofstream os(tmpfile);
+      for (Model::iterator it = _fzn->begin(); it != _fzn->end(); ++it) {
+        if(!(*it)->removed())
+          os << **it;
+      }
+      if (stripObjective)
+        objDecl->ann().remove(constants().ann.output_var);
+    }
+    FznPortfolio portfolio(cmds, tmpfile, getSolns2Out(), objSense, objName, stripObjective,
+                           objInt, fAllSolutions, fVerbose);
+    portfolio.run();
+    remove(tmpfile);
+    return getSolns2Out()->status;
+#endif
+  }
+
+  namespace {
+    /// The last solution in the output of a FlatZinc solver, and its final status
+    SolverInstance::Status lastSolution(const string& output, string& sol, string& marker) {
+      SolverInstance::Status status = SolverInstance::UNKNOWN;
+      bool hadSolution = false;
+      string cur;
+      istringstream iss(output);
+      string line;
+      while (getline(iss, line)) {
+        if (beginswith(line, "----------")) {
+          sol = cur;
+          cur.clear();
+          hadSolution = true;
+        } else if (beginswith(line, "==========")) {
+          status = SolverInstance::OPT;
+        } else if (beginswith(line, "=====")) {
+          marker = line + "\n";
+          if (beginswith(line, "=====UNSATISFIABLE====="))
+            status = SolverInstance::UNSAT;
+          else if (beginswith(line, "=====UNBOUNDED====="))
+            status = SolverInstance::UNBND;
+          else if (beginswith(line, "=====UNSATorUNBOUNDED====="))
+            status = SolverInstance::UNSATorUNBND;
+          else if (beginswith(line, "=====ERROR====="))
+            status = SolverInstance__ERROR;
+        } else if (!beginswith(line, "%")) {
+          cur += line;
+          cur += '\n';
+        }
+      }
+      if (hadSolution && SolverInstance::OPT != status)
+        status = SolverInstance::SAT;
+      return status;
+    }
+  }
+
+  SolverInstance::Status
+  FZNSolverInstance::solveComponents(vector<string>& cmd_line, int nParts) {
+#ifdef _WIN32
+    std::cerr << "  Warning: --split-components is not supported on this platform" << std::endl;
+    FznProcess proc(cmd_line, false, _fzn, getSolns2Out());
+    proc.run();
+    return getSolns2Out()->status;
+#else
+    bool fVerbose = _options.getBoolParam(constants().opts.verbose.str(), false);
+    FlatComponents comps(_env);
+    if (comps.size() <= 1) {
+      if (fVerbose)
+        std::cerr << "  FZN: the model has " << comps.size() << " component, solving it as a whole" << std::endl;
+      FznProcess proc(cmd_line, false, _fzn, getSolns2Out());
+      proc.run();
+      return getSolns2Out()->status;
+    }
+    comps.group(nParts);
+    nParts = comps.nParts();
+    if (fVerbose)
+      std::cerr << "  FZN: solving " << comps.size() << " independent components in "
+        << nParts << " parts" << (comps.objectiveSplit() ? ", objective split" : "") << std::endl;
+
+    vector<string> files(nParts);
+    vector<string> outputs(nParts);
+    for (int p=0; p<nParts; p++) {
+      char tmpfile[] = "/tmp/fznfileXXXXXX.fzn";
+      int fd = mkstemps(tmpfile, 4);
+      if (fd >= 0)
+        close(fd);
+      files[p] = tmpfile;
+      std::ofstream os(tmpfile);
+      comps.writePart(p, os);
+    }
+    vector<thread> threads;
+    for (int p=0; p<nParts; p++) {
+      threads.push_back(thread([&cmd_line, &files, &outputs, p]() {
+        FznProcess proc(cmd_line, files[p], &outputs[p]);
+        proc.run();
+      }));
+    }
+    for (auto& t: threads)
+      t.join();
+    for (int p=0; p<nParts; p++)
+      remove(files[p].c_str());
+
+    // One combined solution, if every part has one
+    vector<string> sols(nParts);
+    string noSolution;
+    bool complete = true;
+    for (int p=0; p<nParts; p++) {
+      string marker;
+      Status st = lastSolution(outputs[p], sols[p], marker);
+      if (SolverInstance::UNSAT == st) {
+        noSolution = marker;
+        break;
+      }
+      if (SolverInstance::SAT != st && SolverInstance::OPT != st && noSolution.empty())
+        noSolution = marker.empty() ? "=====UNKNOWN=====\n" : marker;
+      complete = complete && SolverInstance::OPT == st;
+    }
+    if (noSolution.empty()) {
+      string merged = comps.mergeSolutions(sols);
+      merged += "----------\n";
+      if (complete)
+        merged += "==========\n";
+      getSolns2Out()->feedRawDataChunk(merged.c_str());
+    } else {
+      getSolns2Out()->feedRawDataChunk(noSolution.c_str());
+    }
+    return getSolns2Out()->status;
+#endif
+  }
+
 //   void FZNSolverInstance::printSolution(ostream& os) {
 //     assert(hadSolution);
 //     _env.evalOutput(os);
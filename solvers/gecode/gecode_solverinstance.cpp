@@ -18,6 +18,10 @@
 #include "aux_brancher.hh"
 #include <minizinc/solvers/gecode/fzn_space.hh>
 
+#include <thread>
+#include <atomic>
+#include <chrono>
+
 using namespace std;
 using namespace Gecode;
 
@@ -57,6 +61,11 @@ namespace MiniZinc {
       int passes = atoi(argv[i]);
       if(passes >= 0)
         _options.setIntParam(std::string("pre_passes"), passes);
+    } else if (string(argv[i])=="--sac-threads") {
+      if (++i==argc) return false;
+      int threads = atoi(argv[i]);
+      if(threads >= 1)
+        _options.setIntParam(std::string("sac_threads"), threads);
     } else if (string(argv[i])=="--node") {
       if (++i==argc) return false;
       int nodes = atoi(argv[i]);
@@ -88,6 +97,8 @@ namespace MiniZinc {
     << "    shave domains" << std::endl
     << "  --pre-passes <n>" << std::endl
     << "    n passes of sac/shaving, 0 for fixed point" << std::endl
+    << "  --sac-threads <n>" << std::endl
+    << "    distribute sac/shaving probes over n threads" << std::endl
     << "  --node <n>" << std::endl
     << "    node cutoff (0 = none, solution mode)" << std::endl
     << "  --fail <f>" << std::endl
@@ -354,6 +365,9 @@ namespace MiniZinc {
     _run_sac = _options.getBoolParam(std::string("sac"), false);
     _run_shave = _options.getBoolParam(std::string("shave"), false);
     _pre_passes = _options.getIntParam(std::string("pre_passes"), 1);
+    _sac_threads = _options.getIntParam(std::string("sac_threads"), 1);
+    _sac_probes = 0;
+    _sac_removed = 0;
     _print_stats = _options.getBoolParam(std::string("statistics"), false);
     _current_space = new FznSpace();
 
@@ -960,6 +974,30 @@ namespace MiniZinc {
     }
   }
 
+  SolutionValue
+  GecodeSolverInstance::getRawSolutionValue(Id* id) {
+    id = id->decl()->id();
+    if(id->type().isvar()) {
+      GecodeVariable var = resolveVar(id->decl()->id());
+      switch (id->type().bt()) {
+        case Type::BT_INT:
+          if (id->type().enumId()!=0)
+            break;
+          assert(var.intVar(_solution).assigned());
+          return SolutionValue::mkInt(var.intVar(_solution).val());
+        case Type::BT_BOOL:
+          assert(var.boolVar(_solution).assigned());
+          return SolutionValue::mkBool(var.boolVar(_solution).val());
+        case Type::BT_FLOAT:
+          assert(var.floatVar(_solution).assigned());
+          return SolutionValue::mkFloat((var.floatVar(_solution).val()).med());
+        default:
+          break;
+      }
+    }
+    return SolverInstanceBase2::getRawSolutionValue(id);
+  }
+
   void
   GecodeSolverInstance::prepareEngine(void) {
     if (engine==NULL) {
@@ -1112,6 +1150,8 @@ namespace MiniZinc {
   };
 
   bool GecodeSolverInstance::sac(bool toFixedPoint = false, bool shaving = false) {
+    if(_sac_threads > 1)
+      return sac_parallel(toFixedPoint, shaving);
     if(_current_space->status() == SS_FAILED) return false;
     bool modified;
     std::vector<int> sorted_iv;
@@ -1128,8 +1168,10 @@ namespace MiniZinc {
           for (int val = bvar.min(); val <= bvar.max(); ++val) {
             FznSpace* f = static_cast<FznSpace*>(_current_space->clone());
             rel(*f, f->bv[idx], IRT_EQ, val);
+            _sac_probes++;
             if(f->status() == SS_FAILED) {
               rel(*_current_space, bvar, IRT_NQ, val);
+              _sac_removed++;
               modified = true;
               if(_current_space->status() == SS_FAILED)
                 return false;
@@ -1149,6 +1191,7 @@ namespace MiniZinc {
         for (IntVarValues vv(ivar); vv() && !tight; ++vv) {
           FznSpace* f = static_cast<FznSpace*>(_current_space->clone());
           rel(*f, f->iv[idx], IRT_EQ, vv.val());
+          _sac_probes++;
           if (f->status() == SS_FAILED) {
             nq[nnq++] = vv.val();
           } else {
@@ -1163,6 +1206,7 @@ namespace MiniZinc {
             for (int i=vr.max(); i>=vr.min() && i>=fwd_min; i--) {
               FznSpace* f = static_cast<FznSpace*>(_current_space->clone());
               rel(*f, f->iv[idx], IRT_EQ, i);
+              _sac_probes++;
               if (f->status() == SS_FAILED)
                 nq[nnq++] = i;
               else
@@ -1172,6 +1216,7 @@ namespace MiniZinc {
           }
         }
         if(nnq) modified = true;
+        _sac_removed += nnq;
         while (nnq--)
           rel(*_current_space, ivar, IRT_NQ, nq[nnq]);
         if (_current_space->status() == SS_FAILED)
@@ -1181,11 +1226,147 @@ namespace MiniZinc {
     return true;
   }
 
+  namespace {
+    /// A value to be removed from a variable after a failed probe
+    struct SacPruning {
+      bool isBool;
+      unsigned int idx;
+      int val;
+    };
+
+    /// Probe all values of Boolean variable \a idx in \a s
+    void sac_probe_bool(FznSpace* s, unsigned int idx, std::vector<SacPruning>& out,
+                        unsigned long long& probes) {
+      BoolVar bvar = s->bv[idx];
+      for (int val = bvar.min(); val <= bvar.max(); ++val) {
+        FznSpace* f = static_cast<FznSpace*>(s->clone());
+        rel(*f, f->bv[idx], IRT_EQ, val);
+        probes++;
+        if (f->status() == SS_FAILED) {
+          SacPruning p = { true, idx, val };
+          out.push_back(p);
+        }
+        delete f;
+      }
+    }
+
+    /// Probe the values of integer variable \a idx in \a s, only from
+    /// both ends of the domain when \a shaving
+    void sac_probe_int(FznSpace* s, unsigned int idx, bool shaving, std::vector<SacPruning>& out,
+                       unsigned long long& probes) {
+      IntVar ivar = s->iv[idx];
+      bool tight = false;
+      int fwd_min = ivar.max()+1;
+      for (IntVarValues vv(ivar); vv() && !tight; ++vv) {
+        FznSpace* f = static_cast<FznSpace*>(s->clone());
+        rel(*f, f->iv[idx], IRT_EQ, vv.val());
+        probes++;
+        if (f->status() == SS_FAILED) {
+          SacPruning p = { false, idx, vv.val() };
+          out.push_back(p);
+        } else {
+          fwd_min = vv.val();
+          tight = shaving;
+        }
+        delete f;
+      }
+      if (shaving) {
+        tight = false;
+        for (IntVarRangesBwd vr(ivar); vr() && !tight; ++vr) {
+          for (int i=vr.max(); i>=vr.min() && i>fwd_min && !tight; i--) {
+            FznSpace* f = static_cast<FznSpace*>(s->clone());
+            rel(*f, f->iv[idx], IRT_EQ, i);
+            probes++;
+            if (f->status() == SS_FAILED) {
+              SacPruning p = { false, idx, i };
+              out.push_back(p);
+            } else {
+              tight = true;
+            }
+            delete f;
+          }
+        }
+      }
+    }
+  }
+
+  bool GecodeSolverInstance::sac_parallel(bool toFixedPoint, bool shaving) {
+    if(_current_space->status() == SS_FAILED) return false;
+    bool modified;
+    do {
+      modified = false;
+      /// Tasks are variables: Booleans first, then integers with small domains first
+      std::vector<SacPruning> tasks;
+      for (unsigned int idx = 0; idx < _current_space->bv.size(); idx++) {
+        if (!_current_space->bv[idx].assigned()) {
+          SacPruning t = { true, idx, 0 };
+          tasks.push_back(t);
+        }
+      }
+      std::vector<int> sorted_iv;
+      for (unsigned int i=0; i<_current_space->iv.size(); i++)
+        if (!_current_space->iv[i].assigned())
+          sorted_iv.push_back(i);
+      IntVarComp ivc(_current_space->iv);
+      sort(sorted_iv.begin(), sorted_iv.end(), ivc);
+      for (unsigned int i=0; i<sorted_iv.size(); i++) {
+        SacPruning t = { false, static_cast<unsigned int>(sorted_iv[i]), 0 };
+        tasks.push_back(t);
+      }
+      if (tasks.empty())
+        break;
+
+      /// Each worker probes on its own copy of the current space. Copies must not
+      /// share data with the master, as they are used by other threads.
+      unsigned int nWorkers = std::min<size_t>(_sac_threads, tasks.size());
+      std::vector<FznSpace*> spaces(nWorkers);
+      for (unsigned int w=0; w<nWorkers; w++)
+        spaces[w] = static_cast<FznSpace*>(_current_space->clone(false));
+      std::vector<std::vector<SacPruning> > prunings(nWorkers);
+      std::vector<unsigned long long> probes(nWorkers, 0);
+      std::atomic<unsigned int> next(0);
+      auto work = [&](unsigned int w) {
+        for (unsigned int t; (t = next++) < tasks.size(); ) {
+          if (tasks[t].isBool)
+            sac_probe_bool(spaces[w], tasks[t].idx, prunings[w], probes[w]);
+          else
+            sac_probe_int(spaces[w], tasks[t].idx, shaving, prunings[w], probes[w]);
+        }
+      };
+      std::vector<std::thread> threads;
+      for (unsigned int w=1; w<nWorkers; w++)
+        threads.push_back(std::thread(work, w));
+      work(0);
+      for (unsigned int i=0; i<threads.size(); i++)
+        threads[i].join();
+
+      /// Values failing on the round's snapshot also fail on the (stronger) master
+      for (unsigned int w=0; w<nWorkers; w++) {
+        delete spaces[w];
+        _sac_probes += probes[w];
+        for (unsigned int i=0; i<prunings[w].size(); i++) {
+          const SacPruning& p = prunings[w][i];
+          if (p.isBool)
+            rel(*_current_space, _current_space->bv[p.idx], IRT_NQ, p.val);
+          else
+            rel(*_current_space, _current_space->iv[p.idx], IRT_NQ, p.val);
+        }
+        _sac_removed += prunings[w].size();
+        if (!prunings[w].empty())
+          modified = true;
+      }
+      if (_current_space->status() == SS_FAILED)
+        return false;
+    } while(toFixedPoint && modified);
+    return true;
+  }
+
   bool GecodeSolverInstance::presolve(Model* orig_model) {
     GCLock lock;
     if(_current_space->status() == SS_FAILED) return false;
     // run SAC?
     if(_run_sac || _run_shave) {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
       unsigned int iters = _pre_passes;
       if(iters) {
         for(unsigned int i=0; i<iters; i++)
@@ -1193,6 +1374,14 @@ namespace MiniZinc {
       } else {
         sac(true, _run_shave);
       }
+      if(_print_stats) {
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        std::cerr << "%%  sac probes:    " << _sac_probes;
+        if(t > 0)
+          std::cerr << " (" << static_cast<unsigned long long>(_sac_probes/t) << " probes/s)";
+        std::cerr << std::endl
+          << "%%  sac removed:   " << _sac_removed << std::endl;
+      }
     }
 
     if(orig_model != NULL) {
@@ -1205,9 +1394,10 @@ namespace MiniZinc {
         vds[vd->id()->str().str()] = vd;
       }
 
-      IdMap<GecodeVariable>::iterator it;
-      for(it = _variableMap.begin(); it != _variableMap.end(); it++) {
-        VarDecl* vd = it->first->decl();
+      for(unsigned int i = 0; i < _variableMap.size(); i++) {
+        if (_variableMap.id(i) == NULL)
+          continue;
+        VarDecl* vd = _variableMap.id(i)->decl();
         long long int old_domsize = 0;
         bool holes = false;
 
@@ -1223,14 +1413,14 @@ namespace MiniZinc {
           }
         }
 
-        std::string name = it->first->str().str();
+        std::string name = _variableMap.id(i)->str().str();
 
 
         if(vds.find(name) != vds.end()) {
           VarDecl* nvd = vds[name];
           Type::BaseType bt = vd->type().bt();
           if(bt == Type::BaseType::BT_INT) {
-            IntVar intvar = it->second.intVar(_current_space);
+            IntVar intvar = _variableMap[i].intVar(_current_space);
             const long long int l = intvar.min(), u = intvar.max();
 
             if(l==u) {
@@ -1250,7 +1440,7 @@ namespace MiniZinc {
               }
             }
           } else if(bt == Type::BaseType::BT_BOOL) {
-            BoolVar boolvar = it->second.boolVar(_current_space);
+            BoolVar boolvar = _variableMap[i].boolVar(_current_space);
             int l = boolvar.min(),
                 u = boolvar.max();
             if(l == u) {
@@ -1263,7 +1453,7 @@ namespace MiniZinc {
               }
             }
           } else if(bt == Type::BaseType::BT_FLOAT) {
-            Gecode::FloatVar floatvar = it->second.floatVar(_current_space);
+            Gecode::FloatVar floatvar = _variableMap[i].floatVar(_current_space);
             if(floatvar.assigned() && !nvd->e()) {
               FloatNum l = floatvar.min();
               nvd->type(Type::parfloat());